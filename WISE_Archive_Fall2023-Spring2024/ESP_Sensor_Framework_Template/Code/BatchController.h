@@ -0,0 +1,130 @@
+/**
+ * @file BatchController.h
+ * @brief Runtime control of the Influx batch size from the observed link quality.
+ *
+ * This file contains the controller that decides how many points are collected
+ * before a batch is handed to the network transmit task. Larger batches spread the
+ * per-request overhead over more points, smaller batches finish before the server
+ * times out on a weak link. The controller adjusts the threshold between a minimum
+ * and maximum set at compile time:
+ *
+ * - A write that succeeds well under the target latency grows the threshold by
+ *   one eighth, as long as the recent error rate is low.
+ * - A write slower than the target latency shrinks it by one quarter.
+ * - A failed write halves it.
+ * - The WiFi signal strength caps it: at or below the weak RSSI only the minimum
+ *   batch is allowed, at or above the strong RSSI the maximum, linear in between.
+ *
+ * `onFlush()` is called by the transmit task after every write and `onRssi()` by
+ * the RSSI sensor; each updates only its own value, so `threshold()` can be read
+ * from loop() without a lock.
+ */
+
+#ifndef BatchControllerCode
+#define BatchControllerCode
+
+#include <atomic>
+#include <stdint.h>
+
+class BatchController {
+public:
+  /**
+   * @brief Sets the bounds and the starting point of the controller.
+   *
+   * @param minPoints Smallest flush threshold, in points.
+   * @param maxPoints Largest flush threshold, in points (at most the batch capacity).
+   * @param startPoints Initial flush threshold, in points.
+   * @param targetMs Write latency, in milliseconds, above which batches shrink.
+   * @param weakRssi RSSI (dBm) at or below which batches are capped at `minPoints`.
+   * @param strongRssi RSSI (dBm) at or above which batches may reach `maxPoints`.
+   *
+   * @return void
+   */
+  void begin(uint16_t minPoints, uint16_t maxPoints, uint16_t startPoints, uint32_t targetMs, int weakRssi, int strongRssi) {
+    MinPoints = minPoints;
+    MaxPoints = maxPoints > minPoints ? maxPoints : minPoints;
+    TargetMs = targetMs;
+    WeakRssi = weakRssi;
+    StrongRssi = strongRssi > weakRssi ? strongRssi : weakRssi + 1;
+    ErrorRate = 0;
+    Threshold = clamp(startPoints);
+    RssiCap = MaxPoints;
+  }
+
+  /**
+   * @brief Adapts the threshold to the result of one write.
+   *
+   * @param latencyMs How long the write took, in milliseconds.
+   * @param success Whether the server accepted the batch.
+   *
+   * @return void
+   */
+  void onFlush(uint32_t latencyMs, bool success) {
+    // Error rate as a moving average in 1/1000, each write weighted 1/8
+    ErrorRate = ErrorRate - ErrorRate / 8 + (success ? 0 : 1000 / 8);
+
+    uint32_t threshold = Threshold.load(std::memory_order_relaxed);
+    if (!success)
+      threshold /= 2;
+    else if (latencyMs > TargetMs)
+      threshold -= threshold / 4;
+    else if (latencyMs < TargetMs / 2 && ErrorRate < MaxGrowErrorRate)
+      threshold += threshold / 8 > 0 ? threshold / 8 : 1;
+    Threshold.store(clamp(threshold), std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Caps the threshold from the current WiFi signal strength.
+   *
+   * @param rssi Signal strength of the connected network, in dBm. 0 (what
+   * `WiFi.RSSI()` returns while disconnected) is not a reading and keeps the cap.
+   *
+   * @return void
+   */
+  void onRssi(int rssi) {
+    if (rssi == 0)
+      return;
+    uint32_t cap;
+    if (rssi <= WeakRssi)
+      cap = MinPoints;
+    else if (rssi >= StrongRssi)
+      cap = MaxPoints;
+    else
+      cap = MinPoints + (uint32_t)(MaxPoints - MinPoints) * (rssi - WeakRssi) / (StrongRssi - WeakRssi);
+    RssiCap.store(cap, std::memory_order_relaxed);
+  }
+
+  // Number of points at which the current batch should be handed to the transmit task
+  uint16_t threshold() const {
+    uint16_t threshold = Threshold.load(std::memory_order_relaxed);
+    uint16_t cap = RssiCap.load(std::memory_order_relaxed);
+    return threshold < cap ? threshold : cap;
+  }
+
+  // Recent share of failed writes, in 1/1000
+  uint16_t errorRate() const {
+    return ErrorRate;
+  }
+
+private:
+  static const uint16_t MaxGrowErrorRate = 100;  // Batches only grow while fewer than 10% of recent writes failed
+
+  uint16_t clamp(uint32_t points) const {
+    if (points < MinPoints)
+      return MinPoints;
+    if (points > MaxPoints)
+      return MaxPoints;
+    return points;
+  }
+
+  uint16_t MinPoints = 1;
+  uint16_t MaxPoints = 1;
+  uint32_t TargetMs = 1000;
+  int WeakRssi = -85;
+  int StrongRssi = -65;
+  volatile uint16_t ErrorRate = 0;
+  std::atomic<uint16_t> Threshold{ 1 };
+  std::atomic<uint16_t> RssiCap{ 1 };
+};
+
+#endif  // BatchControllerCode
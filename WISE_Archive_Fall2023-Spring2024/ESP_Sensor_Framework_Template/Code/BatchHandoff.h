@@ -0,0 +1,69 @@
+/**
+ * @file BatchHandoff.h
+ * @brief Double buffer of Influx batches between loop() and the network transmit task.
+ *
+ * This file contains the hand-off of the line protocol batches: loop() fills one
+ * batch while the transmit task sends the other. `handOff()` swaps the two once
+ * the transmit task released its batch, and never waits: while the task is still
+ * sending (the server is slow or unreachable), it returns nullptr and loop() keeps
+ * filling its batch, and drops points once that is full, instead of holding up
+ * the sensors.
+ *
+ * The transmit task clears its batch before `release()`, so loop() always gets an
+ * empty batch next. How the full batch reaches the task (a FreeRTOS queue in the
+ * sketch) is up to the caller.
+ */
+
+#ifndef BatchHandoffCode
+#define BatchHandoffCode
+
+#include <atomic>
+
+template<typename Batch>
+class BatchHandoff {
+public:
+  // Sets the two batches; loop() fills `first` first
+  void begin(Batch* first, Batch* second) {
+    Batches[0] = first;
+    Batches[1] = second;
+    Filling = first;
+    InFlight.store(false, std::memory_order_relaxed);
+  }
+
+  // loop(): the batch being filled
+  Batch* filling() const {
+    return Filling;
+  }
+
+  /**
+   * @brief Swaps the batches (loop() only).
+   *
+   * @return The full batch, to be passed to the transmit task, or nullptr if the
+   *         task still owns the other batch; nothing is swapped then.
+   */
+  Batch* handOff() {
+    if (InFlight.load(std::memory_order_acquire))  // Pairs with release(), the other batch is cleared
+      return nullptr;
+    Batch* full = Filling;
+    Filling = full == Batches[0] ? Batches[1] : Batches[0];
+    InFlight.store(true, std::memory_order_relaxed);
+    return full;
+  }
+
+  // Transmit task: done with the batch it was handed, loop() may fill it again
+  void release() {
+    InFlight.store(false, std::memory_order_release);
+  }
+
+  // `true` while the transmit task owns the other batch
+  bool inFlight() const {
+    return InFlight.load(std::memory_order_relaxed);
+  }
+
+private:
+  Batch* Batches[2] = { nullptr, nullptr };
+  Batch* Filling = nullptr;
+  std::atomic<bool> InFlight{ false };
+};
+
+#endif  // BatchHandoffCode
@@ -0,0 +1,183 @@
+/**
+ * @file ClockServo.h
+ * @brief PI clock discipline that locks the sample timestamp clock to the GPS PPS.
+ *
+ * This file contains the servo that keeps the timestamp clock (`TimestampClock`)
+ * on the GPS pulse-per-second. The PPS interrupt only records the monotonic time
+ * of the pulse; the servo later compares what the clock read at that instant with
+ * the whole second the pulse marks, and corrects the clock:
+ *
+ * - Small errors are slewed: a proportional-integral controller sets the rate
+ *   correction of the clock, so the error is removed over the following seconds
+ *   and the timestamps never jump. The integral term converges to the frequency
+ *   error of the local oscillator (the drift).
+ * - Errors above the step threshold (the first pulse after boot, or after a GPS
+ *   outage) are corrected at once by stepping the clock to the pulse. While locked,
+ *   a single outlier pulse is ignored instead; only repeated ones step the clock.
+ *
+ * Because the pulse time is captured in the interrupt, the correction does not
+ * depend on how late loop() processes the pulse. The error is measured at every
+ * pulse, so missed pulses only lengthen the interval the correction is spread over.
+ *
+ * `onPulse()` and the readers are only called from loop().
+ */
+
+#ifndef ClockServoCode
+#define ClockServoCode
+
+#include <stdint.h>
+
+class ClockServo {
+public:
+  /**
+   * @brief Sets the controller gains and thresholds, and resets the servo.
+   *
+   * @param kp Proportional gain, in parts per billion per nanosecond of error.
+   * @param ki Integral gain, in parts per billion per nanosecond of error.
+   * @param maxRatePpb Largest rate correction, in parts per billion.
+   * @param stepThresholdUs Error, in microseconds, above which the clock is stepped.
+   * @param lockThresholdUs Error, in microseconds, below which the clock counts as locked.
+   * @param holdoverUs How long, in microseconds, the lock is kept without pulses.
+   * @param pulseOffsetUs Microseconds past the whole second the clock should read at a pulse.
+   *
+   * @return void
+   */
+  void begin(float kp, float ki, int32_t maxRatePpb, uint32_t stepThresholdUs, uint32_t lockThresholdUs, int64_t holdoverUs, int32_t pulseOffsetUs) {
+    Kp = kp;
+    Ki = ki;
+    MaxRatePpb = maxRatePpb;
+    StepThresholdUs = stepThresholdUs;
+    LockThresholdUs = lockThresholdUs;
+    HoldoverUs = holdoverUs;
+    PulseOffsetUs = pulseOffsetUs;
+    Integral = 0;
+    Rate = 0;
+    Offset = 0;
+    Good = 0;
+    Outliers = 0;
+    Locked = false;
+    Pulses = Steps = Ignored = 0;
+  }
+
+  /**
+   * @brief Measures the clock error at one PPS pulse and computes the correction.
+   *
+   * @param monotonicUs Monotonic time the pulse was captured at, in microseconds.
+   * @param clockUs Epoch time the clock read at `monotonicUs`, in microseconds.
+   *
+   * @return `true` if the clock should be moved to read `epochUs()` at `monotonicUs`
+   *         and run at `ratePpb()` from there, `false` if the pulse was ignored.
+   */
+  bool onPulse(int64_t monotonicUs, int64_t clockUs) {
+    if (Pulses > 0 && monotonicUs - LastPulseUs < MinPulseIntervalUs) {
+      Ignored++;  // Contact bounce or noise on the PPS line
+      return false;
+    }
+    int64_t intervalUs = Pulses > 0 ? monotonicUs - LastPulseUs : 1000000;
+    int32_t seconds = (int32_t)((intervalUs + 500000) / 1000000);
+    LastPulseUs = monotonicUs;
+    Pulses++;
+
+    // The pulse marks the whole second nearest to the clock
+    int64_t pulseUs = (clockUs - PulseOffsetUs + 500000) / 1000000 * 1000000 + PulseOffsetUs;
+    int64_t error = clockUs - pulseUs;
+    Offset = (int32_t)error;
+
+    if (error > (int64_t)StepThresholdUs || error < -(int64_t)StepThresholdUs) {
+      if (Locked && ++Outliers < MaxOutliers) {
+        Ignored++;
+        return false;
+      }
+      // Step to the pulse, keep running at the drift estimate
+      Epoch = pulseUs;
+      Rate = clampRate(-Integral);
+      Good = 0;
+      Outliers = 0;
+      Locked = false;
+      Steps++;
+      return true;
+    }
+    Outliers = 0;
+
+    // Slew: PI controller on the error in nanoseconds, spread over the pulse interval
+    double errorNs = (double)error * 1000.0 / seconds;
+    Integral = clampRate(Integral + Ki * errorNs);
+    Rate = clampRate(-(Kp * errorNs + Integral));
+    Epoch = clockUs;
+
+    if (error <= (int64_t)LockThresholdUs && error >= -(int64_t)LockThresholdUs) {
+      if (Good < LockPulses)
+        Good++;
+    } else
+      Good = 0;
+    Locked = Good >= LockPulses;
+    return true;
+  }
+
+  // Epoch time the clock should read at the last pulse, in microseconds
+  int64_t epochUs() const {
+    return Epoch;
+  }
+  // Rate correction the clock should run at from the last pulse, in parts per billion
+  int32_t ratePpb() const {
+    return (int32_t)Rate;
+  }
+  // Clock error measured at the last pulse, in microseconds (positive: clock was ahead)
+  int32_t offsetUs() const {
+    return Offset;
+  }
+  // Estimated frequency error of the local oscillator, in parts per billion (positive: runs fast)
+  int32_t driftPpb() const {
+    return (int32_t)Integral;
+  }
+  // Whether the clock is locked to pulses that are still arriving
+  bool tracking(int64_t monotonicUs) const {
+    return Locked && monotonicUs - LastPulseUs < HoldoverUs;
+  }
+  bool locked() const {
+    return Locked;
+  }
+  uint32_t pulses() const {
+    return Pulses;
+  }
+  uint32_t steps() const {
+    return Steps;
+  }
+  uint32_t ignored() const {
+    return Ignored;
+  }
+
+private:
+  static const int32_t MinPulseIntervalUs = 500000;
+  static const uint8_t LockPulses = 4;   // Consecutive pulses within the lock threshold to lock
+  static const uint8_t MaxOutliers = 3;  // Consecutive pulses above the step threshold to step while locked
+
+  double clampRate(double ratePpb) const {
+    if (ratePpb > MaxRatePpb)
+      return MaxRatePpb;
+    if (ratePpb < -MaxRatePpb)
+      return -MaxRatePpb;
+    return ratePpb;
+  }
+
+  float Kp = 0.7;
+  float Ki = 0.3;
+  int32_t MaxRatePpb = 500000;
+  uint32_t StepThresholdUs = 500;
+  uint32_t LockThresholdUs = 20;
+  int64_t HoldoverUs = 10000000;
+  int32_t PulseOffsetUs = 0;
+  double Integral = 0;
+  double Rate = 0;
+  int64_t Epoch = 0;
+  int64_t LastPulseUs = 0;
+  int32_t Offset = 0;
+  uint8_t Good = 0;
+  uint8_t Outliers = 0;
+  bool Locked = false;
+  uint32_t Pulses = 0;
+  uint32_t Steps = 0;
+  uint32_t Ignored = 0;
+};
+
+#endif  // ClockServoCode
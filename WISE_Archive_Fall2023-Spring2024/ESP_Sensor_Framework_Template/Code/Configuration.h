@@ -13,6 +13,7 @@
 // #define TransmitDetailDebugging
 // #define HighRateDetailDebugging
 // #define InterruptDebugging
+// #define SensorTimingHistograms  // Record poll jitter, execution time, latency and skipped ticks of the high-rate sensors (see SensorTiming.h)
 #define SerialBaudRate 115200
 // #define OLEDDebugging // Not fully implemented, Untested
 #define HasNeopixel
@@ -27,11 +28,18 @@
 // Device
 #define DEVICE "ESP32-X"  // Update This! <-------------------------------------------------------------------------------------
 #define GPS_PPS_PIN 27    // Pulse-Per-Second Pin used for GPS Time Synchronization
-#define PPSOffsetSeconds 0
-#define PPSOffsetMicroseconds 0
+#define PPSOffsetMicroseconds 0  // Microseconds past the whole second the clock should read at the PPS pulse
 #define GPSSerial Serial1
 #define GPSBaudRate 115200
 
+// GPS PPS Clock Servo (see ClockServo.h)
+#define PPSServoKp 0.3            // Proportional gain, ppb per ns of error
+#define PPSServoKi 0.05           // Integral gain, ppb per ns of error
+#define PPSMaxRatePpb 500000      // Largest rate correction of the timestamp clock (500 ppm)
+#define PPSStepThresholdUs 500    // Larger errors step the clock instead of slewing it
+#define PPSLockThresholdUs 20     // Errors within this count as locked
+#define PPSHoldoverSeconds 10     // How long without pulses the lock is kept (NTP updates are ignored while locked)
+
 // WiFi Network(s) for Setup/Initialization - Any additions or subtractions made here also need to be made to setWifiConfig() in Functions.cpp
 #define WIFICONNECTTIME 30         // How many seconds to wait while attempting to connect to a network before moving on
 #define I_WIFI_SSID "fgcu-campus"  // Update This! <--------------------------------------------------------------------------
@@ -53,24 +61,57 @@
 #define INFLUXDB_ORG "867116c343b9f084"  // Update This! <--------------------------------------------------------------------
 // InfluxDB v2 bucket name (Use: InfluxDB UI ->  Data -> Buckets)
 #define INFLUXDB_BUCKET "OutdoorESP1"  // Update This! <-----------------------------------------------------------------------------
+// InfluxDB v2 write endpoint used by the transmit task (organization and bucket must not need URL encoding)
+#define INFLUXDB_WRITE_URL INFLUXDB_URL "/api/v2/write?org=" INFLUXDB_ORG "&bucket=" INFLUXDB_BUCKET "&precision=us"
 
 // MQTT Server information
 #define MQTT_SERVER "69.88.163.33"
 #define MQTT_PORT 1883
 #define MQTT_TOPIC_SUBCRIBE "topic/fromNR"
 #define MQTT_TOPIC_PUBLISH "topic/toNR"
+#define MQTT_TOPIC_STATS "topic/stats/" DEVICE  // Pipeline health counters, published as JSON
+#define StatsPublishSeconds 30
+#define MQTT_TOPIC_TIMING MQTT_TOPIC_STATS "/timing"  // High-rate sensor timing histograms (SensorTimingHistograms), one JSON message per sensor
+#define StatsMessageSize 1024
 
 // NODE-RED Commands
 #define NODE_RED_START "start"
 #define NODE_RED_STOP "stop"
 #define NODE_RED_RESET "reset"
+#define NODE_RED_RATE "rate"  // "rate <sensor> <frames per second>", see SensorCommand.h
+#define SensorMinRateHz (1.0f / 3600)  // Lowest rate a rate command may set (one frame an hour)
+
+// Logged Values
+#define FloatFieldPrecision 6  // Decimal places kept when float values are written to InfluxDB or the SD card
 
 // Transmission Batching Controls
-#define BATCH_SIZE 150
-#define BATCH_SIZE 250
-#define StartTransmissionPercentage 50
-#define HighRateMutexWaitTicks 10
-#define InfluxSequentialTransmitLimit 10
+#define BATCH_SIZE 250  // Largest batch in points, sets the size of the batch buffers
+#define StartTransmissionPercentage 50  // Initial flush threshold as a percentage of BATCH_SIZE, adapted at runtime
+#define InfluxMinBatchPoints 25  // Smallest flush threshold the batch controller will use
+#define InfluxTargetFlushMs 1000  // Writes slower than this shrink the batches, writes under half of it grow them
+#define InfluxWeakRssi -85  // At or below this RSSI (dBm) batches are capped at InfluxMinBatchPoints
+#define InfluxStrongRssi -65  // At or above this RSSI (dBm) batches may grow up to BATCH_SIZE
+#define InfluxBytesPerPoint 192  // Worst-case encoded line protocol size of one point
+#define InfluxBatchBufferSize (BATCH_SIZE * InfluxBytesPerPoint)
+#define InfluxMaxBytesPerSecond 32768  // Uplink budget: worst-case line protocol the sensors may log per second, before compression
+#define InfluxNameCacheSize 512  // Escaped measurement, tag and field names
+#define HighRateRingSize 512  // Samples buffered between the high-rate callbacks and loop(), must be a power of two
+
+// Network Transmit Task
+#define InfluxTransmitCore 1  // Kept off core 0, which runs the high-rate sensor timers
+#define InfluxTransmitPriority 1  // Same as loop(), so both share core 1 while the task waits on the network
+#define InfluxTransmitStackSize 8192
+#define InfluxHttpTimeout 10000  // Milliseconds before a write that gets no response is counted as failed
+#define InfluxCompressedWrites  // Send batches gzip compressed (Content-Encoding: gzip) to save airtime, comment out to send plain text
+#define InfluxCompressionLevel 4  // 1 (fastest) to 9 (smallest output)
+#define InfluxCompressionWindowBits 12  // Match window of 2^bits bytes, uses 2^bits * 4 bytes of RAM
+#define InfluxCompressedBufferSize (InfluxBatchBufferSize / 2)  // Batches that do not compress to this size are sent uncompressed
+
+// Flash Spill Queue (Influx outages)
+#define InfluxSpillToFlash  // Keep batches the server did not accept on the flash file system and send them again later
+#define InfluxSpillDirectory "/spill"  // On the LittleFS data partition of the selected partition scheme
+#define InfluxSpillMaxBytes (1024 * 1024)  // Oldest batches are dropped beyond this, must fit the data partition
+#define InfluxSpillReplayIntervalMs 500  // Idle time without live batches before a stored batch is sent again (one is also sent after every live batch)
 
 // Time
 #define TimeZoneOffset "EST+5EDT,M3.2.0/2,M11.1.0/2"  // Check This! <--------------------------------------------------------
@@ -78,36 +119,73 @@
 #define ntpServer2 "time.nis.gov"
 
 // SD Card (Adalogger)
-#define STR_HELPER(x) #x
-#define STR(x) STR_HELPER(x)
-#define FILENAME "/" STR(DEVICE) "_Log.txt"
+#define SDBinaryLogging  // Log compact binary records (decode with SD_Log_Decoder) instead of one text line per value
+#define SDLogDirectory "/log"  // Numbered log files, oldest first: /log/0000000001.bin, /log/0000000002.bin, ...
+#define SDLogIndexFile SDLogDirectory "/current.idx"  // Number of the current log file, so it is found without listing the directory
+#ifdef SDBinaryLogging
+#define SDLogExtension "bin"
+#define SDBinaryRecordSize 256  // Largest sensor definition plus frame entry, grows with the module and field name lengths
+#else
+#define SDLogExtension "txt"
+#endif
+#define SDRotateBytes (16UL * 1024 * 1024)  // A new log file is started once the current one reaches this size,
+#define SDRotateSeconds 3600                // has been open this long, and at every boot
+#define SDBlockSize 4096  // RAM block of the log file, written in one go when full (a multiple of the 512 byte card sectors)
+#define SDBlockCount 4  // Blocks shared with the SD writer task, they cover a card stall of (SDBlockCount - 1) * SDBlockSize bytes of data
+#define SDFlushIntervalMs 1000  // Longest time a logged line waits in RAM before it is written and the file is synced
+#define SDRecoveryWindow (2 * SDBlockSize)  // End of the newest log file checked for a torn write at boot (must cover SdLogMaxEntry)
+#define SDMountPoint "/sd"  // Mount point of SD.begin(), for truncate()
+
+// SD Writer Task
+#define SDWriterCore 0  // Next to the high-rate sensor timers and DRDY task, which preempt it, so a slow card never holds up loop() on core 1
+#define SDWriterPriority 1  // Below every sensor task
+#define SDWriterStackSize 4096
+#define SDCloseTimeoutMs 2000  // Longest wait for the writer task to finish the log file before a restart
 
 
 // Global Variables:
 /*****************************************************************************/
+SampleRing<SampleFrame, HighRateRingSize> HighRateRing;  // Filled by the high-rate timer callbacks, drained by loop()
+PipelineStats pipelineStats;                             // Health counters, published over MQTT
+char StatsMessage[StatsMessageSize];                     // JSON of the stats messages, built by loop() one at a time (kept off its stack)
 #ifdef HasNeopixel
 Adafruit_NeoPixel pixel(1, PIN_NEOPIXEL, NEO_GRB + NEO_KHZ800);
 #endif
 #ifdef InfluxLogging
-InfluxDBClient client(INFLUXDB_URL, INFLUXDB_ORG, INFLUXDB_BUCKET, INFLUXDB_TOKEN);
-Point* fast_datapoints[BATCH_SIZE];
-SemaphoreHandle_t InfluxClientMutex = NULL;
+LineProtocolBatch InfluxBatches[2];                  // Double buffer: loop() fills one while the transmit task sends the other
+BatchHandoff<LineProtocolBatch> influxHandoff;       // Swaps InfluxBatches between loop() and the transmit task
+BatchController influxBatchControl;                  // Flush threshold, adapted from write latency, errors and RSSI
+#ifdef InfluxSpillToFlash
+SpillQueue influxSpill;                              // Batches waiting to be sent again after a failed write
+#endif
+QueueHandle_t InfluxTransmitQueue;                   // Full batches handed from loop() to the transmit task
+volatile int influxLastStatus = 0;                   // HTTP status (or negative HTTPClient error) of the last write
+volatile unsigned long influxLastFlushMs = 0;        // Duration of the last write
+volatile unsigned long influxMaxFlushMs = 0;         // Longest write since boot
 #endif
 #ifdef SDLogging
-fs::File dataLog;
+SdBlockQueue<SDBlockSize, SDBlockCount> sdBlocks;  // Blocks between loop() and the SD writer task
+SdBlockWriter<SDBlockSize, SdBlockQueue<SDBlockSize, SDBlockCount>> dataLog;  // Fills the blocks of the log file (see logDataSD())
+fs::File dataLogFile;                   // Open log file, only used by the SD writer task
+bool dataLogFileUsed = false;           // Set once the file numbered dataLogSequence was opened
+volatile uint32_t dataLogSequence = 1;  // Number of the log file being written (see beginDataLogSD())
+unsigned long dataLogOpenedMs = 0;      // millis() when loop() started the log file
+uint32_t dataLogRecoveredBytes = 0;     // Bytes of a torn write cut off the previous log file at boot
 #endif
 #ifdef OLEDDebugging
 Adafruit_SH1107 display = Adafruit_SH1107(64, 128, &Wire);
 #endif
 bool writeError = false;
-bool GPSSync = false;
-int slowPointCount = 0;
-int fastPointCount = 0;
-int fastPointCountAlt = 0;
+volatile bool GPSSync = false;
+volatile bool NTPSync = false;
 // struct timeval tv;
-unsigned long GPS_us;
-TaskHandle_t Task1;
-TaskHandle_t Task2;
+volatile int64_t GPS_us;  // esp_timer_get_time() at the last PPS pulse
+portMUX_TYPE GPSMux = portMUX_INITIALIZER_UNLOCKED;
+TimestampClock timestampClock;  // Maps esp_timer_get_time() to the epoch, set by the time synchronization
+portMUX_TYPE TimestampClockMux = portMUX_INITIALIZER_UNLOCKED;
+ClockServo ppsServo;
+TaskHandle_t Task1;  // Network transmit task
+TaskHandle_t Task2;  // SD writer task
 TinyGPSPlus gps;
 WiFiMulti wifiMulti;
 EspMQTTClient mqttClient(
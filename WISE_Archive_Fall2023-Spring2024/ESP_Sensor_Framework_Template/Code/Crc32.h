@@ -0,0 +1,47 @@
+/**
+ * @file Crc32.h
+ * @brief Table-driven CRC-32 (IEEE 802.3, as used by gzip and zlib).
+ *
+ * This file contains the CRC-32 used to check data written by the framework, such
+ * as the trailer of gzip compressed Influx writes. The lookup table is built once,
+ * on first use.
+ */
+
+#ifndef Crc32Code
+#define Crc32Code
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Crc32Table {
+  uint32_t Entries[256];
+
+  Crc32Table() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (uint8_t bit = 0; bit < 8; bit++)
+        c = (c & 1) ? (0xEDB88320UL ^ (c >> 1)) : (c >> 1);
+      Entries[i] = c;
+    }
+  }
+};
+
+/**
+ * @brief Updates a running CRC-32 with more data.
+ *
+ * @param crc The CRC of the data so far, 0 to start a new CRC.
+ * @param data The data to add.
+ * @param length Number of bytes of data.
+ *
+ * @return The CRC of all data so far (same result as zlib's crc32()).
+ */
+inline uint32_t crc32Update(uint32_t crc, const void* data, size_t length) {
+  static const Crc32Table table;
+  const uint8_t* bytes = (const uint8_t*)data;
+  crc = ~crc;
+  while (length--)
+    crc = table.Entries[(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+#endif  // Crc32Code
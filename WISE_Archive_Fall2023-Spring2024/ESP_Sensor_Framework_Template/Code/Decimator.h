@@ -0,0 +1,162 @@
+/**
+ * @file Decimator.h
+ * @brief Fixed-point anti-alias filter and decimator for high-rate sensor channels.
+ *
+ * This file contains the filter used to log a sensor at a lower rate than it is
+ * sampled without aliasing: vibration above half the logged rate would otherwise
+ * fold back into the logged band. `FirDecimator` low-pass filters every channel
+ * with a windowed-sinc FIR filter and keeps one output per `Ratio` inputs. Only
+ * the kept outputs are computed (the polyphase form), so a filter of `Taps` taps
+ * costs `Taps / Ratio` multiply-accumulates per input sample and channel.
+ *
+ * The filter is designed at compile time from the decimation ratio: the cutoff is
+ * the Nyquist frequency of the output rate, the window is a Blackman window (about
+ * 74 dB stopband), and the coefficients are rounded to Q15 with a gain of exactly
+ * one at DC. Samples are int16 raw sensor readings and are filtered with 32 bit
+ * integer arithmetic only.
+ *
+ * Every output is timestamped with the input sample at the centre of the filter
+ * window, so the filter delay does not shift the logged timestamps.
+ */
+
+#ifndef DecimatorCode
+#define DecimatorCode
+
+#include <stdint.h>
+
+// Compile-time filter design (C++11 constexpr: single return statements)
+constexpr double FirPi = 3.14159265358979323846;
+
+constexpr double firSinSeries(double x2, double term, int n, double sum) {
+  return n > 20 ? sum : firSinSeries(x2, -term * x2 / ((2 * n + 2) * (2 * n + 3)), n + 1, sum + term);
+}
+
+// Reduces an angle to [-pi, pi] so the series converges quickly
+constexpr double firWrap(double x) {
+  return x - 2 * FirPi * (double)(long long)(x / (2 * FirPi) + (x >= 0 ? 0.5 : -0.5));
+}
+
+constexpr double firSin(double x) {
+  return firSinSeries(firWrap(x) * firWrap(x), firWrap(x), 0, 0.0);
+}
+
+constexpr double firCos(double x) {
+  return firSin(x + FirPi / 2);
+}
+
+// Windowed-sinc tap `i` of a `taps` long low-pass filter, cutoff in cycles per input sample
+constexpr double firTap(int taps, double cutoff, int i) {
+  return (i == (taps - 1) / 2 ? 2 * cutoff : firSin(2 * FirPi * cutoff * (i - (taps - 1) / 2)) / (FirPi * (i - (taps - 1) / 2))) * (0.42 - 0.5 * firCos(2 * FirPi * i / (taps - 1)) + 0.08 * firCos(4 * FirPi * i / (taps - 1)));
+}
+
+constexpr double firTapSum(int taps, double cutoff, int i) {
+  return i >= taps ? 0.0 : firTap(taps, cutoff, i) + firTapSum(taps, cutoff, i + 1);
+}
+
+// Tap rounded to Q15 (unit gain), `sum` is the sum of all unrounded taps
+constexpr int32_t firRoundedTap(int taps, double cutoff, double sum, int i) {
+  return (int32_t)(firTap(taps, cutoff, i) / sum * 32768 + (firTap(taps, cutoff, i) >= 0 ? 0.5 : -0.5));
+}
+
+// Sum of the rounded taps, except the centre tap
+constexpr int32_t firRoundedSum(int taps, double cutoff, double sum, int i) {
+  return i >= taps ? 0 : (i == (taps - 1) / 2 ? 0 : firRoundedTap(taps, cutoff, sum, i)) + firRoundedSum(taps, cutoff, sum, i + 1);
+}
+
+// Q15 tap; the centre tap takes up the rounding so the taps sum to exactly 32768 (unit gain at DC)
+constexpr int16_t firCoefficient(int taps, double cutoff, double sum, int32_t roundedSum, int i) {
+  return (int16_t)(i == (taps - 1) / 2 ? 32768 - roundedSum : firRoundedTap(taps, cutoff, sum, i));
+}
+
+// Sum of the magnitudes of the Q15 taps: the largest gain for any input
+constexpr int32_t firAbsSum(int taps, double cutoff, double sum, int32_t roundedSum, int i) {
+  return i >= taps ? 0 : (firCoefficient(taps, cutoff, sum, roundedSum, i) < 0 ? -firCoefficient(taps, cutoff, sum, roundedSum, i) : firCoefficient(taps, cutoff, sum, roundedSum, i)) + firAbsSum(taps, cutoff, sum, roundedSum, i + 1);
+}
+
+template<int... I>
+struct FirIndices {};
+template<int N, int... I>
+struct FirMakeIndices : FirMakeIndices<N - 1, N - 1, I...> {};
+template<int... I>
+struct FirMakeIndices<0, I...> {
+  typedef FirIndices<I...> Type;
+};
+
+// Coefficient table of a decimation filter, generated by the compiler
+template<uint8_t Ratio, uint16_t Taps, typename = typename FirMakeIndices<Taps>::Type>
+struct FirDesign;
+
+template<uint8_t Ratio, uint16_t Taps, int... I>
+struct FirDesign<Ratio, Taps, FirIndices<I...>> {
+  static constexpr double Cutoff = 0.5 / Ratio;  // Output Nyquist frequency, in cycles per input sample
+  static constexpr double Sum = firTapSum(Taps, Cutoff, 0);
+  static constexpr int32_t RoundedSum = firRoundedSum(Taps, Cutoff, Sum, 0);
+  static constexpr int16_t Coefficients[Taps] = { firCoefficient(Taps, Cutoff, Sum, RoundedSum, I)... };
+  static constexpr int32_t AbsSum = firAbsSum(Taps, Cutoff, Sum, RoundedSum, 0);
+};
+
+template<uint8_t Ratio, uint16_t Taps, int... I>
+constexpr int16_t FirDesign<Ratio, Taps, FirIndices<I...>>::Coefficients[Taps];
+
+template<uint8_t Channels, uint8_t Ratio, uint16_t Taps>
+class FirDecimator {
+  static_assert(Ratio >= 2, "Decimation needs a ratio of at least 2");
+  static_assert(Taps % 2 == 1, "The filter needs an odd number of taps, so its centre is a sample");
+  static_assert(FirDesign<Ratio, Taps>::AbsSum < 65536, "The filter could overflow the 32 bit accumulator");
+
+public:
+  /**
+   * @brief Adds one input sample of every channel.
+   *
+   * No outputs are produced until the filter window is full, so the first
+   * `Taps - 1` inputs after `reset()` only fill the history.
+   *
+   * @param timestamp Timestamp of the input sample.
+   * @param in One value per channel (may be the same array as `out`).
+   * @param outTimestamp Set to the timestamp of the output, if there is one.
+   * @param out Set to one filtered value per channel, if there is an output.
+   *
+   * @return `true` if this input completed an output.
+   */
+  bool push(uint64_t timestamp, const int16_t* in, uint64_t& outTimestamp, int16_t* out) {
+    for (uint8_t channel = 0; channel < Channels; channel++)
+      History[channel][Position] = History[channel][Position + Taps] = in[channel];
+    Timestamps[Position] = timestamp;
+    Position = Position + 1 == Taps ? 0 : Position + 1;  // Now the oldest sample
+    if (Filled < Taps)
+      Filled++;
+    if (++Phase < Ratio)
+      return false;
+    Phase = 0;
+    if (Filled < Taps)
+      return false;
+
+    const int16_t* coefficients = FirDesign<Ratio, Taps>::Coefficients;
+    for (uint8_t channel = 0; channel < Channels; channel++) {
+      const int16_t* window = &History[channel][Position];  // Oldest to newest, contiguous
+      int32_t sum = 1 << 14;                                // Rounds the Q15 result
+      for (uint16_t tap = 0; tap < Taps; tap++)
+        sum += (int32_t)coefficients[tap] * window[tap];
+      sum >>= 15;
+      out[channel] = sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : (int16_t)sum;
+    }
+    outTimestamp = Timestamps[(Position + Taps / 2) % Taps];
+    return true;
+  }
+
+  // Clears the history, e.g. after a gap in the input
+  void reset() {
+    Position = 0;
+    Filled = 0;
+    Phase = 0;
+  }
+
+private:
+  int16_t History[Channels][2 * Taps];  // Every sample is stored twice, so the window never wraps
+  uint64_t Timestamps[Taps];
+  uint16_t Position = 0;
+  uint16_t Filled = 0;
+  uint8_t Phase = 0;
+};
+
+#endif  // DecimatorCode
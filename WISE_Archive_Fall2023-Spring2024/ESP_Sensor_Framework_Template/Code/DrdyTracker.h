@@ -0,0 +1,105 @@
+/**
+ * @file DrdyTracker.h
+ * @brief Bookkeeping for sampling a sensor on its data-ready interrupt.
+ *
+ * This file contains the logic that decides, for every wake-up of a data-ready
+ * (DRDY) driven sampling task, whether the data read is a new sample, and how many
+ * samples were lost before it. The sensor's own clock sets the sampling instants:
+ * the interrupt captures the time of every DRDY edge, and that edge time is the
+ * timestamp of the sample read after it.
+ *
+ * - A read whose status register shows no new data is a duplicate of the previous
+ *   sample (e.g. a spurious wake-up) and is not logged.
+ * - An edge less than half a period after the last logged one is a glitch on the
+ *   interrupt line; it is counted as a duplicate too, and neither its time nor its
+ *   interval is used.
+ * - The time between the edges of two logged samples, in sensor periods, shows how
+ *   many samples were overwritten before the task could read them (the task was
+ *   late, or edges were coalesced or lost).
+ * - The sensor period is measured from the edges of consecutive samples, so the
+ *   missed sample count follows the actual output data rate of the sensor rather
+ *   than its nominal value.
+ *
+ * `onRead()` is only called from the sampling task; the counters may be read from
+ * other tasks.
+ */
+
+#ifndef DrdyTrackerCode
+#define DrdyTrackerCode
+
+#include <stdint.h>
+
+class DrdyTracker {
+public:
+  /**
+   * @brief Resets the tracker.
+   *
+   * @param nominalPeriodNs The sensor sample period from its data sheet, in nanoseconds.
+   *
+   * @return void
+   */
+  void begin(uint32_t nominalPeriodNs) {
+    PeriodNs = nominalPeriodNs;
+    HaveEdge = false;
+    Samples = Missed = Duplicates = 0;
+  }
+
+  /**
+   * @brief Accounts for one read of the sensor after a DRDY wake-up.
+   *
+   * @param edgeUs Time of the latest DRDY edge, in microseconds.
+   * @param fresh Whether the sensor status register showed new data.
+   *
+   * @return `true` if the data read is a new sample and should be logged with the
+   *         timestamp `edgeUs`.
+   */
+  bool onRead(int64_t edgeUs, bool fresh) {
+    if (!fresh || (HaveEdge && edgeUs == LastEdgeUs)) {
+      Duplicates++;
+      return false;
+    }
+    if (HaveEdge) {
+      int64_t intervalNs = (edgeUs - LastEdgeUs) * 1000;
+      int64_t periods = (intervalNs + PeriodNs / 2) / PeriodNs;
+      if (periods <= 0) {  // Glitch, or the edge time went backwards
+        Duplicates++;
+        return false;
+      }
+      if (periods > 1)
+        Missed += (uint32_t)(periods - 1);
+      else  // Consecutive samples: follow the sensor clock, weighted 1/16
+        PeriodNs = (uint32_t)(PeriodNs + (intervalNs - (int64_t)PeriodNs) / 16);
+    }
+    LastEdgeUs = edgeUs;
+    HaveEdge = true;
+    Samples++;
+    return true;
+  }
+
+  // Samples logged since `begin()`
+  uint32_t samples() const {
+    return Samples;
+  }
+  // Samples the sensor produced but the task did not read in time
+  uint32_t missed() const {
+    return Missed;
+  }
+  // Reads without new data, or after a glitch edge
+  uint32_t duplicates() const {
+    return Duplicates;
+  }
+  // Measured sensor sample period, in nanoseconds
+  uint32_t periodNs() const {
+    return PeriodNs;
+  }
+
+private:
+  volatile uint32_t PeriodNs = 1;
+  int64_t LastEdgeUs = 0;
+  bool HaveEdge = false;
+  volatile uint32_t Samples = 0;
+  volatile uint32_t Missed = 0;
+  volatile uint32_t Duplicates = 0;
+};
+
+#endif  // DrdyTrackerCode
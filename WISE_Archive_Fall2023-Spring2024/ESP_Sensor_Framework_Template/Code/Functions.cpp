@@ -19,16 +19,316 @@
 #include "Configuration.h"
 
 #ifdef InfluxLogging
+// Escaped line protocol names, filled once by cacheInfluxNames()
+char InfluxNameCache[InfluxNameCacheSize];
+const char* InfluxPointPrefix[SampleSensorCount];  // "<measurement>,device=<DEVICE>" for each sensor
+const char* InfluxFieldKey[SampleFieldCount];
+
+/**
+ * @brief Escapes the measurement, tag and field names once for line protocol encoding.
+ *
+ * For every sensor of `SampleSensorTable`, this function stores the escaped
+ * "<measurement>,device=<DEVICE>" prefix in `InfluxNameCache`, and for every entry
+ * of `SampleFieldTable` the escaped field name.
+ *
+ * If `InfluxNameCacheSize` is too small for the configured names, the function
+ * enters an infinite loop.
+ *
+ * @return void
+ */
+void cacheInfluxNames() {
+  char device[48];
+  size_t used = 0;
+  bool fits = LineProtocolBatch::escapeKey(device, sizeof(device), DEVICE) > 0;
+
+  for (int sensor = 0; fits && sensor < SampleSensorCount; sensor++) {
+    size_t length = LineProtocolBatch::escapeMeasurement(InfluxNameCache + used, sizeof(InfluxNameCache) - used, SampleSensorTable[sensor].Module);
+    int tag = snprintf(InfluxNameCache + used + length, sizeof(InfluxNameCache) - used - length, ",device=%s", device);
+    fits = length > 0 && tag > 0 && used + length + tag + 1 <= sizeof(InfluxNameCache);
+    InfluxPointPrefix[sensor] = InfluxNameCache + used;
+    used += length + tag + 1;
+  }
+
+  for (int field = 0; fits && field < SampleFieldCount; field++) {
+    size_t length = LineProtocolBatch::escapeKey(InfluxNameCache + used, sizeof(InfluxNameCache) - used, SampleFieldTable[field].Name);
+    fits = length > 0;
+    InfluxFieldKey[field] = InfluxNameCache + used;
+    used += length + 1;
+  }
+
+  if (!fits) {
+#ifdef SerialDebugMode
+    Serial.println("InfluxNameCacheSize too small for the configured fields");
+#endif
+    while (1) {
+      delay(10);
+    }
+  }
+}
+
+/**
+ * @brief Sends one write body to the InfluxDB v2 write endpoint.
+ *
+ * This function POSTs a line protocol body to `INFLUXDB_WRITE_URL` with the API
+ * token, either from RAM (`Body`) or streamed from a file (`BodyFile`), so a batch
+ * stored on flash does not need to be loaded into memory first.
+ *
+ * @param http The HTTP client of the transmit task.
+ * @param Body The write body in RAM, or `NULL` if `BodyFile` is used.
+ * @param BodyFile The write body as an open file, or `NULL` if `Body` is used.
+ * @param Length Size of the write body in bytes.
+ * @param Gzip Whether the body is gzip compressed.
+ *
+ * @return The HTTP status, or a negative HTTPClient error if the request could not
+ *         be sent.
+ */
+int postInfluxWrite(HTTPClient& http, const uint8_t* Body, Stream* BodyFile, size_t Length, bool Gzip) {
+  if (WiFi.status() != WL_CONNECTED || !http.begin(INFLUXDB_WRITE_URL))
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  http.addHeader("Authorization", "Token " INFLUXDB_TOKEN);
+  http.addHeader("Content-Type", "text/plain; charset=utf-8");
+  if (Gzip)
+    http.addHeader("Content-Encoding", "gzip");
+  int status = BodyFile ? http.sendRequest("POST", BodyFile, Length) : http.POST((uint8_t*)Body, Length);
+  http.end();
+  return status;
+}
+
+// Whether a failed write may succeed later: no connection, server errors and rate limiting (a rejected body never will)
+bool influxWriteRetryable(int Status) {
+  return Status < 0 || Status == 429 || Status >= 500;
+}
+
+#ifdef InfluxSpillToFlash
+/**
+ * @brief Sends the oldest batch stored in the flash spill queue.
+ *
+ * This function streams the oldest segment of `influxSpill` to the database and
+ * removes it once the server accepted it. A segment the server rejects (not
+ * retryable) is discarded, so it cannot block the queue.
+ *
+ * If `SerialDebugMode` and `TransmitDetailDebugging` are defined, the size, status
+ * and duration of the write and the remaining queue depth are printed to the
+ * serial monitor.
+ *
+ * @param http The HTTP client of the transmit task.
+ *
+ * @return `false` if the write failed and should be tried again later, `true`
+ *         otherwise.
+ */
+bool replayInfluxSpill(HTTPClient& http) {
+  bool compressed;
+  fs::File file = influxSpill.openOldest(compressed);
+  if (!file)
+    return true;
+  size_t length = file.size();
+
+#if defined(SerialDebugMode) && defined(TransmitDetailDebugging)
+  unsigned long start = millis();
+#endif
+  int status = postInfluxWrite(http, NULL, &file, length, compressed);
+  file.close();
+  bool success = status >= 200 && status <= 299;
+  if (success)
+    influxSpill.pop(length);
+  else if (!influxWriteRetryable(status))
+    influxSpill.discard(length);
+
+#if defined(SerialDebugMode) && defined(TransmitDetailDebugging)
+  Serial.print(xPortGetCoreID());
+  Serial.print(" Core - Replayed ");
+  Serial.print(length);
+  Serial.print(" bytes - Status ");
+  Serial.print(status);
+  Serial.print(" in ");
+  Serial.print(millis() - start);
+  Serial.print(" ms, ");
+  Serial.print(influxSpill.depth());
+  Serial.println(" batches left");
+#endif
+  return success || !influxWriteRetryable(status);
+}
+#endif
+
+/**
+ * @brief Network transmit task, sends full Influx batches to the database.
+ *
+ * This task owns the HTTP client and runs on `InfluxTransmitCore`. It waits for
+ * `transmitInfluxBuffer()` to hand it a full line protocol batch through
+ * `InfluxTransmitQueue`, then:
+ *
+ * 1. Compresses the batch with gzip (if `InfluxCompressedWrites` is defined). A
+ *    batch that does not compress into `InfluxCompressedBufferSize` bytes, or any
+ *    batch if the compressor could not be allocated, is sent uncompressed.
+ * 2. POSTs the batch to the InfluxDB v2 write endpoint (`INFLUXDB_WRITE_URL`),
+ *    reusing the connection between batches.
+ * 3. Records the HTTP status and how long the write took (`influxLastStatus`,
+ *    `influxLastFlushMs`, `influxMaxFlushMs` and `pipelineStats`) and reports both
+ *    to the batch controller (`influxBatchControl`).
+ * 4. Stores the batch in the flash spill queue (`influxSpill`) if the write failed
+ *    and may succeed later (if `InfluxSpillToFlash` is defined).
+ * 5. Clears the batch and releases it back to loop() (`influxHandoff`).
+ *
+ * While batches are stored in the spill queue, the task sends the oldest stored
+ * batch after every successful live write, and whenever no live batch arrived for
+ * `InfluxSpillReplayIntervalMs` while the link is up. Live data always goes first
+ * and the replay takes at most every other write, however small the batch
+ * controller has made the live batches after an outage.
+ *
+ * Because only this task waits on the network, a slow or unreachable server delays
+ * the next batch swap but never the low-rate sensors or the MQTT client in loop().
+ *
+ * If `SerialDebugMode` and `TransmitDetailDebugging` are defined, the size, status
+ * and duration of every write are printed to the serial monitor.
+ *
+ * @param Parameters Unused.
+ *
+ * @note If the server does not accept a batch and it can not be stored in the
+ *       spill queue, the batch is dropped. The `writeError` flag is set for every
+ *       failed write.
+ *
+ * @return void
+ */
+void influxTransmitTask(void* Parameters) {
+  HTTPClient http;
+  http.setReuse(true);  // Keep the connection open between batches
+  http.setTimeout(InfluxHttpTimeout);
+
+#ifdef InfluxCompressedWrites
+  GzipEncoder gzip;
+  uint8_t* compressed = (uint8_t*)malloc(InfluxCompressedBufferSize);
+  if (!compressed || !gzip.begin(InfluxCompressionWindowBits, InfluxCompressionLevel)) {
+    free(compressed);
+    compressed = NULL;
+#ifdef SerialDebugMode
+    Serial.println("Failed to allocate Influx compressor, sending uncompressed");
+#endif
+  }
+#endif
+
+  LineProtocolBatch* batch;
+#ifdef InfluxSpillToFlash
+  bool linkUp = true;  // Last write succeeded, stored batches may be replayed
+#endif
+  while (1) {
+    TickType_t wait = portMAX_DELAY;
+#ifdef InfluxSpillToFlash
+    if (linkUp && !influxSpill.empty())
+      wait = pdMS_TO_TICKS(InfluxSpillReplayIntervalMs);
+#endif
+    if (xQueueReceive(InfluxTransmitQueue, &batch, wait) != pdTRUE) {
+#ifdef InfluxSpillToFlash
+      linkUp = replayInfluxSpill(http);  // No live batch for a while
+#endif
+      continue;
+    }
+
+    unsigned long start = millis();
+    const uint8_t* body = (const uint8_t*)batch->data();
+    size_t bodyLength = batch->length();
+    bool gzipped = false;
+#ifdef InfluxCompressedWrites
+    size_t compressedLength = compressed ? gzip.compress(body, bodyLength, compressed, InfluxCompressedBufferSize) : 0;
+    if (compressedLength) {
+      body = compressed;
+      bodyLength = compressedLength;
+      gzipped = true;
+    }
+#endif
+
+    int status = postInfluxWrite(http, body, NULL, bodyLength, gzipped);
+    unsigned long elapsed = millis() - start;
+
+    influxLastStatus = status;
+    influxLastFlushMs = elapsed;
+    if (elapsed > influxMaxFlushMs)
+      influxMaxFlushMs = elapsed;
+    bool success = status >= 200 && status <= 299;  // InfluxDB answers 204 No Content on success
+    if (!success)
+      writeError = true;
+    influxBatchControl.onFlush(elapsed, success);
+    pipelineStats.recordFlush(elapsed, success);
+#ifdef InfluxSpillToFlash
+    linkUp = success;
+    if (!success && influxWriteRetryable(status))
+      influxSpill.push(body, bodyLength, gzipped);
+#endif
+
+#if defined(SerialDebugMode) && defined(TransmitDetailDebugging)
+    Serial.print(xPortGetCoreID());
+    Serial.print(" Core - Transmitted ");
+    Serial.print(batch->points());
+    Serial.print(" points, ");
+    Serial.print(batch->length());
+    Serial.print(" bytes (");
+    Serial.print(bodyLength);
+    Serial.print(" sent) - Status ");
+    Serial.print(status);
+    Serial.print(" in ");
+    Serial.print(elapsed);
+    Serial.println(" ms");
+#endif
+
+    batch->clear();
+    influxHandoff.release();  // loop() may fill this batch again
+
+#ifdef InfluxSpillToFlash
+    if (success && !influxSpill.empty())
+      linkUp = replayInfluxSpill(http);  // One stored batch per live batch
+#endif
+  }
+}
+
 /**
  * @brief Configures the Influx client settings.
  * 
- * This function enables batching and sets the timestamp precision to microseconds.
+ * This function allocates both line protocol batch buffers (`InfluxBatches`),
+ * caches the escaped measurement, tag and field names used to encode each point,
+ * sets the bounds of the batch controller (`influxBatchControl`), mounts the flash
+ * file system for the spill queue (`influxSpill`, if `InfluxSpillToFlash` is
+ * defined) and starts the network transmit task (`influxTransmitTask()`) on
+ * `InfluxTransmitCore`. Timestamps are written with microsecond precision.
+ * 
+ * @note If the batch buffers, the queue or the task can not be created, the
+ *       device halts, since no data could be transmitted. Without the spill queue
+ *       the device keeps running, but failed batches are dropped.
  * 
  * @return void
  */
 void setInfluxConfig() {
-  // Enable batching and timestamp precision
-  client.setWriteOptions(WriteOptions().writePrecision(WritePrecision::US).batchSize(BATCH_SIZE));
+  InfluxTransmitQueue = xQueueCreate(1, sizeof(LineProtocolBatch*));
+  if (!InfluxBatches[0].begin(InfluxBatchBufferSize) || !InfluxBatches[1].begin(InfluxBatchBufferSize) || InfluxTransmitQueue == NULL) {
+#ifdef SerialDebugMode
+    Serial.println("Failed to allocate Influx batch buffers");
+#endif
+    while (1) {
+      delay(10);
+    }
+  }
+  influxHandoff.begin(&InfluxBatches[0], &InfluxBatches[1]);
+  cacheInfluxNames();
+  influxBatchControl.begin(InfluxMinBatchPoints, BATCH_SIZE, BATCH_SIZE * StartTransmissionPercentage / 100, InfluxTargetFlushMs, InfluxWeakRssi, InfluxStrongRssi);
+
+#ifdef InfluxSpillToFlash
+  if (!LittleFS.begin(true) || !influxSpill.begin(LittleFS, InfluxSpillDirectory, InfluxSpillMaxBytes)) {  // Formats the partition on first use
+#ifdef SerialDebugMode
+    Serial.println("Flash spill queue unavailable, failed batches will be dropped");
+#endif
+  }
+#ifdef SerialDebugMode
+  Serial.print(influxSpill.depth());
+  Serial.println(" batches waiting in the flash spill queue");
+#endif
+#endif
+
+  if (xTaskCreatePinnedToCore(influxTransmitTask, "InfluxTransmit", InfluxTransmitStackSize, NULL, InfluxTransmitPriority, &Task1, InfluxTransmitCore) != pdPASS) {
+#ifdef SerialDebugMode
+    Serial.println("Failed to start Influx transmit task");
+#endif
+    while (1) {
+      delay(10);
+    }
+  }
 }
 #endif
 
@@ -191,6 +491,10 @@ void setWifiMultiConfig() {
  * The function also prints debug messages to the serial monitor and OLED display
  * (if available) during the time synchronization process.
  *
+ * Once the system time is set, the sample timestamp clock is synchronized to it
+ * (`syncTimestampClock()`), and again after every later NTP update unless the
+ * clock is locked to the GPS PPS.
+ *
  * @return void
  */
 void setTime() {
@@ -199,6 +503,7 @@ void setTime() {
   pixel.show();
 #endif
   setenv("TZ", TimeZoneOffset, 1);
+  sntp_set_time_sync_notification_cb(onNtpTimeSync);
 
   bool useGPSTime = true;
 
@@ -239,6 +544,7 @@ void setTime() {
 #endif
     setUnixtime(getGPSTime());
   }
+  syncTimestampClock();
 
 // Time Sync completed
 #ifdef HasNeopixel
@@ -273,19 +579,19 @@ bool tryTimeSync(bool WiFi_Connected) {
     return false;
   int attemptCount = 1;
   struct timeval tv;
-  // Update Stored System Time
+  // Update Stored System Time (read directly, the sample timestamp clock is only synchronized afterwards)
   gettimeofday(&tv, nullptr);
 #ifdef SerialDebugMode
   Serial.print("Time: ");
-  Serial.println(getSeconds());
+  Serial.println(tv.tv_sec);
 #endif
 #ifdef OLEDDebugging
   display.print("Time: ");
-  display.println(getSeconds());
+  display.println(tv.tv_sec);
   display.display();
 #endif
 
-  while (getSeconds() < 1000) {  // Retry Set Initial System Epoch Time from Internet
+  while (tv.tv_sec < 1000) {  // Retry Set Initial System Epoch Time from Internet
 #ifdef SerialDebugMode
     Serial.print("Attempt ");
     Serial.println(attemptCount);
@@ -418,11 +724,14 @@ int setUnixtime(int32_t unixtime) {  // From https://github.com/espressif/arduin
  *
  * The function performs the following tasks:
  *
- * 1. Records the current time in microseconds using `micros()` and stores it in
- *    the `GPS_us` variable.
+ * 1. Records the monotonic time of the pulse in microseconds using
+ *    `esp_timer_get_time()` and stores it in the `GPS_us` variable.
  * 2. Sets the `GPSSync` flag to `true`, indicating that a GPS synchronization
  *    event has occurred.
  *
+ * The clock is not changed here; loop() passes the captured time to the clock
+ * servo (`disciplineTimestampClock()`).
+ *
  * If `SerialDebugMode` and `InterruptDebugging` are defined, it prints a debug
  * message to the serial monitor.
  *
@@ -435,8 +744,11 @@ int setUnixtime(int32_t unixtime) {  // From https://github.com/espressif/arduin
  * @return void
  */
 void ARDUINO_ISR_ATTR GPS_PPS_ISR() {
-  GPS_us = micros();
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL_ISR(&GPSMux);
+  GPS_us = now;
   GPSSync = true;
+  portEXIT_CRITICAL_ISR(&GPSMux);
 
 #ifdef SerialDebugMode
 #ifdef InterruptDebugging
@@ -484,361 +796,570 @@ unsigned long long getTime() {  // unsigned long long type to match the type use
 
 
 /**
- * @brief Get the number of seconds since the epoch.
+ * @brief Get the current time as microseconds since the epoch.
  *
- * This function retrieves the number of seconds elapsed since January 1, 1970,
- * 00:00:00 UTC.
+ * This function is the single timestamp source for all samples. It returns the
+ * monotonic `esp_timer_get_time()` plus the epoch offset kept by the time
+ * synchronization code (`timestampClock`), as one consistent 64-bit value: a
+ * second boundary or a clock correction can not fall between reading the seconds
+ * and the microseconds. It is safe to call from the sensor callbacks.
  *
- * @return The number of seconds since the epoch as an unsigned long long integer.
+ * @return The number of microseconds since January 1, 1970, 00:00:00 UTC.
  */
-unsigned long long getSeconds() {
-  struct timeval tv;
-  gettimeofday(&tv, nullptr);
-  return tv.tv_sec;
+uint64_t getTimestampUs() {
+  return timestampClock.at(esp_timer_get_time());
 }
 
+// Epoch time of an earlier esp_timer_get_time() reading, in microseconds (e.g. a sample time reconstructed from a sensor FIFO)
+uint64_t getTimestampUsAt(int64_t MonotonicUs) {
+  return timestampClock.at(MonotonicUs);
+}
 
 /**
- * @brief Get the number of microseconds since the epoch.
+ * @brief Moves the sample timestamp clock.
+ *
+ * The clock is written inside a critical section, so a sensor reading the clock
+ * on the same core can not interrupt the update and time synchronization from
+ * different tasks can not interleave.
  *
- * This function retrieves the number of microseconds elapsed since January 1, 1970,
- * 00:00:00 UTC.
+ * @param MonotonicUs `esp_timer_get_time()` at the anchor point, in microseconds.
+ * @param EpochUs Epoch time the clock reads at the anchor point, in microseconds.
+ * @param RatePpb Rate correction from the anchor point on, in parts per billion.
  *
- * @return The number of microseconds since the epoch as an unsigned long long integer.
+ * @return void
  */
-unsigned long long getuSeconds() {
+void setTimestampClock(int64_t MonotonicUs, int64_t EpochUs, int32_t RatePpb) {
+  portENTER_CRITICAL(&TimestampClockMux);
+  timestampClock.set(MonotonicUs, EpochUs, RatePpb);
+  portEXIT_CRITICAL(&TimestampClockMux);
+}
+
+/**
+ * @brief Synchronizes the sample timestamp clock to the system time.
+ *
+ * Called after the system time was set by NTP or from the GPS time. The system
+ * time is read between two reads of `esp_timer_get_time()` and the clock is
+ * anchored at their midpoint. The oscillator drift estimated by the PPS clock servo
+ * is still corrected, so the clock keeps its rate without the PPS. The servo's
+ * correction of the offset at its last pulse is not kept, the new anchor replaces it.
+ *
+ * @return void
+ */
+void syncTimestampClock() {
   struct timeval tv;
+  int64_t before = esp_timer_get_time();
   gettimeofday(&tv, nullptr);
-  return tv.tv_usec;
+  int64_t after = esp_timer_get_time();
+  int64_t epochUs = (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+  setTimestampClock(before + (after - before) / 2, epochUs, -ppsServo.driftPpb());  // A clock running fast is slowed down
 }
 
+// Called by the SNTP client after every NTP update of the system time, applied in loop()
+void onNtpTimeSync(struct timeval* tv) {
+  NTPSync = true;
+}
 
-
-#ifdef InfluxLogging
 /**
- * @brief Transmits the Influx buffer to the database.
- *
- * This function transmits the data points stored in the Influx buffer to the
- * database. It performs the following steps:
- *
- * 1. Acquires the `InfluxClientMutex` mutex to ensure exclusive access to the
- *    Influx client.
- * 2. Flushes the Influx client buffer, forcing the buffered data points to be
- *    sent to the database.
- * 3. Releases the `InfluxClientMutex` mutex.
- * 4. Resets the `fastPointCount` and `slowPointCount` counters.
- * 5. Iterates over the `fast_datapoints` array and writes any queued fast-rate
- *    data points to the database using the Influx client.
- * 6. Resets the `fastPointCountAlt` counter.
- * 7. Iterates over the `fast_datapoints` array and deallocates the memory used
- *    by the data points.
+ * @brief Corrects the sample timestamp clock at a GPS PPS pulse.
  *
- * If `SerialDebugMode` and `TransmitDetailDebugging` are defined, debug messages
- * are printed to the serial monitor.
+ * Passes the time the pulse was captured at, and what the timestamp clock read at
+ * that instant, to the PPS clock servo (`ppsServo`), and moves the clock to the
+ * correction it computes: small errors are slewed by adjusting the clock rate,
+ * large ones step the clock to the pulse. See ClockServo.h.
  *
- * @note If there is an error writing a data point to the database, the
- *       `writeError` flag is set.
+ * If `SerialDebugMode` and `InterruptDebugging` are defined, it prints the measured
+ * error and the drift estimate to the serial monitor.
  *
- * @return void
+ * @param PulseUs `esp_timer_get_time()` at the pulse, as captured by `GPS_PPS_ISR()`.
  *
  * @return void
  */
-void transmitInfluxBuffer() {
-#if defined(SerialDebugMode) && defined(TransmitDetailDebugging)
-  Serial.print(xPortGetCoreID());
-  Serial.print(" Core - Transmit Buffer");
-#endif
-  // Transmit Buffered Datapoints
-  if (xSemaphoreTake(InfluxClientMutex, (TickType_t)1000) == pdTRUE) {
+void disciplineTimestampClock(int64_t PulseUs) {
+  if (ppsServo.onPulse(PulseUs, timestampClock.at(PulseUs)))
+    setTimestampClock(PulseUs, ppsServo.epochUs(), ppsServo.ratePpb());
 
-#if defined(SerialDebugMode) && defined(TransmitDetailDebugging)
-    Serial.print("Transmit take Mutex");
+#ifdef SerialDebugMode
+#ifdef InterruptDebugging
+  Serial.print("GPS PPS: offset ");
+  Serial.print(ppsServo.offsetUs());
+  Serial.print(" us, drift ");
+  Serial.print(ppsServo.driftPpb());
+  Serial.print(" ppb, rate ");
+  Serial.print(ppsServo.ratePpb());
+  Serial.println(ppsServo.locked() ? " ppb, locked" : " ppb, unlocked");
 #endif
-
-    // Force Influx Client buffer to send
-    client.flushBuffer();
-
-#if defined(SerialDebugMode) && defined(TransmitDetailDebugging)
-    Serial.print("Transmit Done");
 #endif
+}
 
-#if defined(SerialDebugMode) && defined(TransmitDetailDebugging)
-      Serial.print("Transmit Return Mutex");
-      Serial.print(" Aux Buffer Size: ");
-      Serial.print(fastPointCountAlt);
-#endif
 
-      for (int i = 0; i < fastPointCountAlt; i++) {                         // Buffer Queued Fast Rate Datapoints
-        writeError = writeError || client.writePoint(*fast_datapoints[i]);  // Dereference pointer to get the Point object
-      }
+/**
+ * @brief Get the number of seconds since the epoch.
+ *
+ * This function retrieves the number of seconds elapsed since January 1, 1970,
+ * 00:00:00 UTC, from the sample timestamp clock (`getTimestampUs()`).
+ *
+ * @return The number of seconds since the epoch as an unsigned long long integer.
+ */
+unsigned long long getSeconds() {
+  return getTimestampUs() / 1000000ULL;
+}
 
-#if defined(SerialDebugMode) && defined(TransmitDetailDebugging)
-      Serial.print(" - Queued Buffer into Influx ");
-#endif
 
-    fastPointCount = fastPointCountAlt;
-    slowPointCount = 0;
+/**
+ * @brief Get the microseconds part of the current time.
+ *
+ * This function retrieves the microseconds elapsed within the current second,
+ * from the sample timestamp clock (`getTimestampUs()`). Use `getTimestampUs()`
+ * when both the seconds and the microseconds are needed.
+ *
+ * @return The microseconds within the current second as an unsigned long long integer.
+ */
+unsigned long long getuSeconds() {
+  return getTimestampUs() % 1000000ULL;
+}
 
-    xSemaphoreGive(InfluxClientMutex);  // After accessing the shared resource give the mutex and allow other processes to access it
-  }
-  
-
-  fastPointCountAlt = 0;
-  // Iterate through the entire array and delete each element
-  for (int i = 0; i < BATCH_SIZE; i++) {
-    if (fast_datapoints[i] != nullptr) {  // Check if the element is not already deleted
-      delete fast_datapoints[i];          // Delete the element
-      fast_datapoints[i] = nullptr;       // Set the pointer to nullptr
-    }
-  }
 
 
+#ifdef InfluxLogging
+/**
+ * @brief Hands the Influx buffer to the network transmit task.
+ *
+ * This function passes the line protocol batch being filled to
+ * `influxTransmitTask()` and switches loop() to the other buffer of `InfluxBatches`
+ * (`influxHandoff`), so new data points can be encoded while the full batch is
+ * sent. It never waits on the network.
+ *
+ * If the transmit task is still sending the previous batch, nothing is handed
+ * over and the current batch keeps filling.
+ *
+ * If `SerialDebugMode` and `TransmitDetailDebugging` are defined, debug messages
+ * are printed to the serial monitor, including the batch size in bytes and points.
+ *
+ * @return `true` if the batch was handed over (or was empty), `false` if the
+ *         transmit task was busy.
+ */
+bool transmitInfluxBuffer() {
+  if (influxHandoff.filling()->points() == 0)
+    return true;
+  LineProtocolBatch* full = influxHandoff.handOff();
+  if (full == nullptr)
+    return false;
+
 #if defined(SerialDebugMode) && defined(TransmitDetailDebugging)
-  Serial.println("Emptied Buffer, Done");
+  Serial.print(xPortGetCoreID());
+  Serial.print(" Core - Transmit Buffer ");
+  Serial.print(full->points());
+  Serial.print(" points, ");
+  Serial.print(full->length());
+  Serial.println(" bytes");
 #endif
+
+  xQueueSend(InfluxTransmitQueue, &full, 0);  // Never blocks, the queue only ever holds this one batch
+  return true;
 } // end transmitInfluxBuffer()
 
 /**
- * @brief Logs data to an Influx database.
- *
- * This function logs a data point to an Influx database. It creates a Point object
- * and adds the data fields to it. If this is the final data point, the Point is
- * added to the transmission buffer or an alternate buffer if the transmission
- * buffer is not available.
- *
- * @param uS The microsecond part of the timestamp.
- * @param S The second part of the timestamp.
- * @param Module The module or component that generated the data.
- * @param Sensor The sensor or data source.
- * @param Value The value or data point to be logged.
- * @param final An optional boolean flag indicating whether this is the final
- *              data point.
- *
- * The function uses a mutex (`InfluxClientMutex`) to control access to the shared
- * resource (Influx client). If the mutex cannot be acquired within a specified
- * timeout (`HighRateMutexWaitTicks`), the data point is stored in an alternate
- * buffer (`fast_datapoints`) to be added to the Influx client later.
+ * @brief Logs a sample frame to an Influx database.
+ *
+ * This function appends one line to the line protocol batch being filled with
+ * the cached measurement and device tag prefix of the frame's sensor, one field
+ * per value of the frame and the frame's timestamp. No intermediate Point object
+ * or String is created.
+ *
+ * @param Frame The sample frame to be logged. Float values are written as Influx
+ *              float fields with `FloatFieldPrecision` decimal places and integer
+ *              values as Influx integer fields.
+ *
+ * If the batch has less than `InfluxBytesPerPoint` bytes left, it is handed to the
+ * transmit task first to make room.
  *
  * If `SerialDebugMode` and `HighRateDetailDebugging` are defined, debug messages
  * are printed to the serial monitor.
  *
- * @note If there is an error writing the Point to the transmission buffer,
- *       the `writeError` flag is set.
+ * @note If a frame does not fit in the batch (both batches full because the
+ *       server is slow), it is dropped and the `writeError` flag is set.
  *
  * @return void
  */
-void logDataInflux(unsigned long long uS, unsigned long long S, String Module, String Sensor, String Value, bool final = false) {
-  static Point* datapoint;
-  if (!datapoint)  // No point exists
-  {
-    datapoint = new Point(Module);
-    datapoint->addTag("device", DEVICE);
-    datapoint->setTime(S * 1000000LL + uS);
+void logDataInflux(const SampleFrame& Frame) {
+  if (influxHandoff.filling()->available() < InfluxBytesPerPoint)
+    transmitInfluxBuffer();
+
+  LineProtocolBatch* batch = influxHandoff.filling();
+  const SampleSensorInfo& sensor = SampleSensorTable[Frame.Sensor];
+  batch->beginPoint(InfluxPointPrefix[Frame.Sensor]);
+  for (uint8_t i = 0; i < Frame.FieldCount; i++) {
+    // Native numeric fields, so InfluxDB can aggregate them without casting
+    const char* key = InfluxFieldKey[sensor.FirstField + i];
+    if (Frame.Values[i].Type == SampleValue::Float)
+      batch->addField(key, Frame.Values[i].F, FloatFieldPrecision);
+    else if (Frame.Values[i].Type == SampleValue::Raw)
+      batch->addField(key, scaleRawValue(sensor.FirstField + i, Frame.Values[i].I), FloatFieldPrecision);
+    else
+      batch->addField(key, Frame.Values[i].I);
   }
 
-  datapoint->addField(Sensor, Value);
-
-  if (final)  // All data added to datapoint
-  {
-    // Store Influx Data
-    // Try to take the mutex but don't wait for long
-    if (xSemaphoreTake(InfluxClientMutex, (TickType_t)HighRateMutexWaitTicks) == pdTRUE) {  // Send Point to Transmission Buffer
-    #if defined(SerialDebugMode) && defined(HighRateDetailDebugging)
-      Serial.println("Highrate Take Mutex");
-    #endif
-
-      writeError = writeError || client.writePoint(*datapoint);
-
-      fastPointCount++;
-
-      xSemaphoreGive(InfluxClientMutex);  // After accessing the shared resource give the mutex and allow other processes to access it
-
-      delete datapoint;  // Deallocate memory
-    } else {             // We could not obtain the semaphore and can therefore not access the shared resource safely.
-      // Send Point to alternate buffer
-      #if defined(SerialDebugMode) && defined(HighRateDetailDebugging)
-      Serial.println("Highrate during early alt store");
-      #endif
-
-      if(fastPointCountAlt < BATCH_SIZE)
-      {
-        fast_datapoints[fastPointCountAlt] = datapoint;  // Transfer allocated memory
-
-        fastPointCountAlt++;
-      }
-      else
-      {
-        #ifdef SerialDebugMode
-        Serial.println("Alternate Fast Point Buffer Full");
-        #endif
-
-        delete datapoint; // Deallocate memory and lose data
-        writeError = true;
-      }
-
-      #if defined(SerialDebugMode) && defined(HighRateDetailDebugging)
-      Serial.println("Highrate during alt store");
-      #endif
-    }  // end mutex take
-
+  if (!batch->endPoint(Frame.Timestamp)) {
+    pipelineStats.PointsDropped.fetch_add(1, std::memory_order_relaxed);
+#ifdef SerialDebugMode
+    Serial.println("Influx Batch Full, Point Dropped");
+#endif
+    writeError = true;
+  }
 
 #if defined(SerialDebugMode) && defined(HighRateDetailDebugging)
-  Serial.println("Highrate Return Mutex");
+  Serial.println("Frame Encoded");
 #endif
-
-    datapoint = nullptr;  // Reset pointer for next measurement
-  }
 }
 #endif  // InfluxLogging
 
 
 #ifdef SDLogging
 /**
- * @brief Logs data to an SD card file.
- *
- * This function logs a data point to a file on the SD card. The file is opened
- * or created if it doesn't exist, and the data is appended to the file.
- *
- * @param uS The microsecond part of the timestamp.
- * @param S The second part of the timestamp.
- * @param Module The module or component that generated the data.
- * @param Sensor The sensor or data source.
- * @param Value The value or data point to be logged.
- * @param final An optional boolean flag indicating whether this is the final
- *              data point. If true, the file is flushed and closed after writing
- *              the data point.
- *
- * The data is logged in the following format:
- * "DEVICE - Time: S.uS - Module: Sensor - Value"
- *
- * @note If the file cannot be opened or created, an error message is printed to
- *       the serial monitor if `SerialDebugMode` is defined.
+ * @brief Logs a sample frame to an SD card file.
+ *
+ * This function logs all values of a sample frame to a file on the SD card. The
+ * first frame starts a new numbered file, which is kept until it reaches
+ * `SDRotateBytes` or has been open for `SDRotateSeconds` and logging moves on to
+ * the next file. The frame is copied into the current RAM block of `dataLog`;
+ * blocks are queued to the SD writer task (`sdWriterTask()`) when they are full or
+ * when loop() finds their oldest data waited `SDFlushIntervalMs`, and when logging
+ * stops (see `closeDataLogSD()`). Nothing here waits on the card.
+ *
+ * @param Frame The sample frame to be logged.
+ *
+ * If `SDBinaryLogging` is defined, the frame is logged as one binary record (see
+ * SdLogFormat.h), after a file header when the file was just opened and a
+ * definition of the sensor when it is new to the file; the SD_Log_Decoder tool
+ * turns the file into CSV or line protocol. Otherwise, the data is logged in the
+ * following format, one line per value:
+ * "DEVICE - Time: SS uSuS - Module: Sensor - Value"
+ *
+ * @note If no block is free (the card is slower than the data) or SD logging
+ *       could not be started, the frame is counted in
+ *       `pipelineStats.SdWriteErrors`. If the writer task lost the file, a new one
+ *       is started for the next frame. An error message is printed to the serial
+ *       monitor if `SerialDebugMode` is defined.
  *
  * @return void
  */
-void logDataSD(unsigned long long uS, unsigned long long S, String Module, String Sensor, String Value, bool final = false)
+void logDataSD(const SampleFrame& Frame)
 {  
+  uint32_t nowMs = millis();
+
   // Open the file if it's not already open
-  if (!dataLog)
-    dataLog = SD.open(FILENAME, FILE_APPEND);
+  if (!dataLog.isOpen() && openDataLogSD()) {
+#ifdef SDBinaryLogging
+    // A new session, every sensor is defined again in it
+    uint8_t header[SDBinaryRecordSize];
+    size_t length = sdLogEncoder.beginFile(header, sizeof(header), DEVICE);
+    if (length == 0 || !dataLog.write((const char*)header, length, nowMs))
+      closeDataLogSD();  // The file could not be decoded without its header, the next frame starts it again
+#endif
+  }
 
-  if (dataLog) {
-    String data = String(DEVICE) + " - Time: " + String(S) + "S " + String(uS) + "uS - " + Module + ": " + Sensor + " - " + Value;
-    dataLog.println(data);
+  if (dataLog.isOpen()) {
+    const SampleSensorInfo& sensor = SampleSensorTable[Frame.Sensor];
+    bool written = true;
+#ifdef SDBinaryLogging
+    uint8_t record[SDBinaryRecordSize];
+    size_t length = sdLogEncoder.encodeFrame(record, sizeof(record), Frame, sensor.Module, [&sensor](uint8_t i) {
+      const SampleFieldInfo& field = SampleFieldTable[sensor.FirstField + i];
+      SdLogField info = { field.Name, field.Scale ? *field.Scale : 1.0f };
+      return info;
+    });
+    written = length > 0 && dataLog.write((const char*)record, length, nowMs);
+    if (written)
+      sdLogEncoder.commitFrame();  // A dropped entry leaves the definitions and timestamps as the file has them
+#else
+    for (uint8_t i = 0; i < Frame.FieldCount; i++) {
+      // Formatted on the stack so no intermediate String is built
+      char line[128];
+      int length = snprintf(line, sizeof(line), DEVICE " - Time: %lluS %lluuS - %s: %s - ",
+                            Frame.Timestamp / 1000000ULL, Frame.Timestamp % 1000000ULL,
+                            sensor.Module, SampleFieldTable[sensor.FirstField + i].Name);
+      if (length > 0 && (size_t)length < sizeof(line)) {
+        if (Frame.Values[i].Type == SampleValue::Float)
+          length += snprintf(line + length, sizeof(line) - length, "%.*f\r\n", FloatFieldPrecision, Frame.Values[i].F);
+        else if (Frame.Values[i].Type == SampleValue::Raw)
+          length += snprintf(line + length, sizeof(line) - length, "%.*f\r\n", FloatFieldPrecision, scaleRawValue(sensor.FirstField + i, Frame.Values[i].I));
+        else
+          length += snprintf(line + length, sizeof(line) - length, "%ld\r\n", Frame.Values[i].I);
+      }
+      if (length <= 0 || (size_t)length >= sizeof(line) || !dataLog.write(line, length, nowMs))
+        written = false;
+    }
+#endif
+    if (!written)
+      pipelineStats.SdWriteErrors.fetch_add(1, std::memory_order_relaxed);
 
 #ifdef SerialDebugMode
     Serial.println("Data written successfully");
 #endif
 
-    // If this is the final data point, flush and close the file
-    if (final) {
-      dataLog.flush();
-      dataLog.close();
-    }
+    if (dataLog.size() >= SDRotateBytes || millis() - dataLogOpenedMs >= SDRotateSeconds * 1000UL)
+      closeDataLogSD();  // The next frame starts the next file
   } else {
+    pipelineStats.SdWriteErrors.fetch_add(1, std::memory_order_relaxed);
 #ifdef SerialDebugMode
     Serial.println("Error opening file for logging data point.");
 #endif
   }
 }
-#endif  // SD Logging
 
 /**
- * @brief Log a string data point to the specified logging destinations.
+ * @brief Queues the buffered SD log data and a request to close the log file.
  *
- * @param uS Timestamp in microseconds.
- * @param S Timestamp in seconds.
- * @param Module The module name.
- * @param Sensor The sensor name.
- * @param Value The string data value to be logged.
- * @param final Indicates whether this is the final data point in a sequence.
+ * Called when the log file is rotated, before the device restarts (followed by
+ * `sdBlocks.drain()`, so the writer task finishes the file) and when every sensor
+ * is stopped, so the card can be removed without losing the last frames. The
+ * next logged frame starts a new file.
  *
  * @return void
  */
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, String Value, bool final = false) {
-#ifdef InfluxLogging
-  logDataInflux(uS, S, Module, Sensor, Value, final);
-#endif
+void closeDataLogSD() {
+  if (!dataLog.close())
+    pipelineStats.SdWriteErrors.fetch_add(1, std::memory_order_relaxed);
+}
 
-#ifdef SDLogging
-#ifdef SDRedundantLoggingOnly
-if (writeError)
-{
-#endif
-  logDataSD(uS, S, Module, Sensor, Value, final);
-#ifdef SDRedundantLoggingOnly
-writeError = false;
+// Writes the path of a numbered log file, e.g. "/log/0000000012.bin"
+void dataLogPathSD(char* Path, size_t Size, uint32_t Sequence) {
+  snprintf(Path, Size, SDLogDirectory "/%010lu." SDLogExtension, (unsigned long)Sequence);
 }
-#endif
-#endif
+
+// Starts a new log file in loop(); the writer task opens it with the first block
+bool openDataLogSD() {
+  if (!dataLog.begin())
+    return false;
+  dataLogOpenedMs = millis();
+  return true;
+}
+
+// Opens the next numbered log file in the writer task, the current one first if it was used
+bool openNextDataLogSD() {
+  if (dataLogFile)
+    dataLogFile.close();
+  if (dataLogFileUsed)
+    setDataLogSequenceSD(dataLogSequence + 1);
+  char path[48];
+  dataLogPathSD(path, sizeof(path), dataLogSequence);
+  dataLogFile = SD.open(path, FILE_APPEND);
+  dataLogFileUsed = (bool)dataLogFile;
+  return dataLogFileUsed;
 }
 
 /**
- * @brief Log a float data point to the specified logging destinations.
+ * @brief Writes the SD log blocks queued by loop() to the card.
+ *
+ * Runs as its own task on `SDWriterCore`, below every sensor task, and does all
+ * the file I/O of the SD log: it takes each block `dataLog` queued in `sdBlocks`
+ * and
+ *
+ * 1. opens the next numbered log file if the block starts a new one,
+ * 2. writes the block's data,
+ * 3. syncs or closes the file if the block asks for it,
+ * 4. returns the block to the pool, with the time all of this took.
+ *
+ * Because only this task waits on the card, a slow write (a card erasing a block
+ * can take hundreds of milliseconds) uses up free blocks, but never delays loop()
+ * or the sensors.
+ *
+ * If a block can not be written (e.g. the card was removed), the file is closed
+ * and loop() is told to start a new file (see `SdBlockQueue::takeFailure()`).
+ * Blocks still queued for the lost file are dropped.
  *
- * @param uS Timestamp in microseconds.
- * @param S Timestamp in seconds.
- * @param Module The module name.
- * @param Sensor The sensor name.
- * @param Value The float data value to be logged.
- * @param final Indicates whether this is the final data point in a sequence.
+ * If `SerialDebugMode` is defined, failed writes are printed to the serial monitor.
+ *
+ * @param Parameters Unused.
  *
  * @return void
  */
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, float Value, bool final = false) {
-  char buffer[20];                // Adjust buffer size as needed
-  dtostrf(Value, 12, 6, buffer);  // Adjust precision as needed (currently 6 decimal places)
-  logDataPoint(uS, S, Module, Sensor, String(buffer), final);
+void sdWriterTask(void* Parameters) {
+  SdBlock block;
+  while (1) {
+    if (!sdBlocks.receive(block, portMAX_DELAY))
+      continue;
+    int64_t startUs = esp_timer_get_time();
+
+    bool stale = !dataLogFile && !(block.Flags & SdBlockNewFile);  // Queued for a file that was lost
+    bool written = !stale;
+    if (block.Flags & SdBlockNewFile)
+      written = openNextDataLogSD();
+    if (written && block.Length > 0)
+      written = dataLogFile.write(block.Data, block.Length) == block.Length;
+    if (written && (block.Flags & SdBlockSync))
+      dataLogFile.flush();
+    if (!written && !stale) {
+      sdBlocks.reportFailure();
+#ifdef SerialDebugMode
+      Serial.println("SD log write failed, starting a new file");
+#endif
+    }
+    if ((!written || (block.Flags & SdBlockClose)) && dataLogFile)
+      dataLogFile.close();
+
+    sdBlocks.release(block, (uint32_t)(esp_timer_get_time() - startUs), written);
+  }
+}
+
+// Moves logging on to a numbered log file and records it in `SDLogIndexFile`
+void setDataLogSequenceSD(uint32_t Sequence) {
+  dataLogSequence = Sequence;
+  fs::File index = SD.open(SDLogIndexFile, FILE_WRITE);
+  if (index) {
+    index.print(Sequence);
+    index.close();
+  }
 }
 
 /**
- * @brief Log a double data point to the specified logging destinations.
+ * @brief Finds the newest SD log file and repairs a torn write at its end.
+ *
+ * Called once during setup after the card is mounted. The number of the newest
+ * log file is read from `SDLogIndexFile`; the directory is only listed if the index
+ * is missing or holds no file number (a power cut while it was rewritten leaves
+ * it empty). Logging continues in a new file after it, so every boot starts
+ * a new file. Then the block pool (`sdBlocks`) is allocated and the SD writer task
+ * (`sdWriterTask()`) is started; without them, nothing is logged to the card.
+ *
+ * If `SDBinaryLogging` is defined, the last `SDRecoveryWindow` bytes of the newest
+ * file are checked for intact entries (see `sdLogValidEnd()`), and the file is
+ * truncated after the last one, so a write cut short by a power loss does not
+ * leave a corrupt tail. Only the end of one file is read, so this takes the same
+ * time however much data is on the card.
  *
- * @param uS Timestamp in microseconds.
- * @param S Timestamp in seconds.
- * @param Module The module name.
- * @param Sensor The sensor name.
- * @param Value The double data value to be logged.
- * @param final Indicates whether this is the final data point in a sequence.
+ * If `SerialDebugMode` is defined, the result is printed to the serial monitor.
  *
  * @return void
  */
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, double Value, bool final = false) {
-  char buffer[20];                // Adjust buffer size as needed
-  dtostrf(Value, 12, 6, buffer);  // Adjust precision as needed (currently 6 decimal places)
-  logDataPoint(uS, S, Module, Sensor, String(buffer), final);
+void beginDataLogSD() {
+  if (!SD.exists(SDLogDirectory) && !SD.mkdir(SDLogDirectory)) {
+#ifdef SerialDebugMode
+    Serial.println("Could not create the SD log directory");
+#endif
+    return;
+  }
+
+  uint32_t newest = 0;
+  fs::File index = SD.open(SDLogIndexFile, FILE_READ);
+  if (index) {
+    char text[12] = {};
+    index.read((uint8_t*)text, sizeof(text) - 1);
+    index.close();
+    newest = strtoul(text, nullptr, 10);
+  }
+  if (newest == 0) {
+    fs::File dir = SD.open(SDLogDirectory);
+    for (fs::File file = dir ? dir.openNextFile() : fs::File(); file; file = dir.openNextFile()) {
+      const char* name = strrchr(file.name(), '/');  // Older cores return the full path
+      name = name ? name + 1 : file.name();
+      char* extension;
+      uint32_t sequence = strtoul(name, &extension, 10);
+      if (extension != name && strcmp(extension, "." SDLogExtension) == 0 && sequence > newest)
+        newest = sequence;
+      file.close();
+    }
+    if (dir)
+      dir.close();
+  }
+
+#ifdef SDBinaryLogging
+  if (newest > 0)
+    recoverDataLogSD(newest);
+#endif
+  setDataLogSequenceSD(newest + 1);
+
+  if (!sdBlocks.begin() || xTaskCreatePinnedToCore(sdWriterTask, "SDWriter", SDWriterStackSize, NULL, SDWriterPriority, &Task2, SDWriterCore) != pdPASS) {
+#ifdef SerialDebugMode
+    Serial.println("Failed to start the SD writer task");
+#endif
+    return;
+  }
+  dataLog.setQueue(&sdBlocks);
 }
 
+#ifdef SDBinaryLogging
 /**
- * @brief Log a int data point to the specified logging destinations.
+ * @brief Truncates a binary log file after its last intact entry.
  *
- * @param uS Timestamp in microseconds.
- * @param S Timestamp in seconds.
- * @param Module The module name.
- * @param Sensor The sensor name.
- * @param Value The int data value to be logged.
- * @param final Indicates whether this is the final data point in a sequence.
+ * @param Sequence The number of the log file.
  *
  * @return void
  */
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, int Value, bool final = false) {
-  logDataPoint(uS, S, Module, Sensor, String(Value), final);
+void recoverDataLogSD(uint32_t Sequence) {
+#ifdef SerialDebugMode
+  int64_t startUs = esp_timer_get_time();
+#endif
+  char path[48];
+  dataLogPathSD(path, sizeof(path), Sequence);
+  fs::File file = SD.open(path, FILE_READ);
+  if (!file)
+    return;
+
+  size_t size = file.size();
+  size_t start = size > SDRecoveryWindow ? size - SDRecoveryWindow : 0;
+  uint8_t* tail = (uint8_t*)malloc(size - start + 1);
+  bool read = tail != nullptr && file.seek(start) && file.read(tail, size - start) == size - start;
+  file.close();
+  size_t end = 0;
+  bool found = read && sdLogValidEnd(tail, size - start, end);
+  free(tail);
+
+  if (read && (found || start == 0) && start + end < size) {  // A file without any intact entry is emptied
+    char fullPath[56];
+    snprintf(fullPath, sizeof(fullPath), SDMountPoint "%s", path);
+    if (truncate(fullPath, start + end) == 0)
+      dataLogRecoveredBytes = size - start - end;
+  }
+
+#ifdef SerialDebugMode
+  Serial.print("SD log recovery: ");
+  Serial.print(path);
+  Serial.print(read ? (found || start == 0 ? ", cut " : ", no intact entry at the end, left as is, ") : ", could not be read, ");
+  Serial.print(dataLogRecoveredBytes);
+  Serial.print(" bytes in ");
+  Serial.print((long)(esp_timer_get_time() - startUs));
+  Serial.println(" us");
+#endif
 }
+#endif
+#endif  // SD Logging
 
 /**
- * @brief Log a long data point to the specified logging destinations.
+ * @brief Log a sample frame to the specified logging destinations.
  *
- * @param uS Timestamp in microseconds.
- * @param S Timestamp in seconds.
- * @param Module The module name.
- * @param Sensor The sensor name.
- * @param Value The long data value to be logged.
- * @param final Indicates whether this is the final data point in a sequence.
+ * A frame holds one timestamp and all values of one sensor reading, and is passed
+ * to each destination as one unit. Frames with more values than the sensor has
+ * fields in `SampleSensorTable` are truncated to the configured fields.
+ *
+ * @param Frame The sample frame to be logged.
  *
  * @return void
  */
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, long Value, bool final = false) {
-  logDataPoint(uS, S, Module, Sensor, String(Value), final);
+void logFrame(const SampleFrame& Frame) {
+  if (Frame.Sensor >= SampleSensorCount)
+    return;
+
+  SampleFrame frame = Frame;
+  if (frame.FieldCount > SampleSensorTable[frame.Sensor].FieldCount)
+    frame.FieldCount = SampleSensorTable[frame.Sensor].FieldCount;
+  pipelineStats.SamplesLogged.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef InfluxLogging
+  logDataInflux(frame);
+#endif
+
+#ifdef SDLogging
+#ifdef SDRedundantLoggingOnly
+if (writeError)
+{
+#endif
+  logDataSD(frame);
+#ifdef SDRedundantLoggingOnly
+writeError = false;
+}
+#endif
+#endif
 }
 
 /**
@@ -849,6 +1370,11 @@ void logDataPoint(unsigned long long uS, unsigned long long S, String Module, St
  * for the presence of the sensor and prints debug information to the serial
  * monitor if the `SerialDebugMode` macro is defined.
  *
+ * It then sets the scale factors for the configured ranges (`setIsm330Scales()`)
+ * and, if `ISM330DHCX_FifoMode` is defined, sets up the sensor FIFO
+ * (`setIsm330FifoConfig()`), or if `ISM330DHCX_DrdyMode` is defined, the
+ * data-ready interrupt (`setIsm330DrdyConfig()`).
+ *
  * If the sensor is not found, the function enters an infinite loop.
  *
  * @note This function is based on the Arduino example code for the ISM330DHCX sensor.
@@ -912,7 +1438,7 @@ void setIsm330Config() {  // From Arduino Example
   }
 #endif
 
-  ism330dhcx.setAccelDataRate(LSM6DS_RATE_833_HZ);
+  ism330dhcx.setAccelDataRate(ISM330DHCX_DataRate);
 #ifdef SerialDebugMode
   Serial.print("Accelerometer data rate set to: ");
   switch (ism330dhcx.getAccelDataRate()) {
@@ -952,7 +1478,7 @@ void setIsm330Config() {  // From Arduino Example
   }
 #endif
 
-  ism330dhcx.setGyroDataRate(LSM6DS_RATE_833_HZ);
+  ism330dhcx.setGyroDataRate(ISM330DHCX_DataRate);
 #ifdef SerialDebugMode
   Serial.print("Gyro data rate set to: ");
   switch (ism330dhcx.getGyroDataRate()) {
@@ -994,6 +1520,343 @@ void setIsm330Config() {  // From Arduino Example
 
   ism330dhcx.configInt1(false, false, true);  // accelerometer DRDY on INT1
   ism330dhcx.configInt2(false, true, false);  // gyro DRDY on INT2
+
+  setIsm330Scales();
+#ifdef ISM330DHCX_FifoMode
+  setIsm330FifoConfig();
+#endif
+#ifdef ISM330DHCX_DrdyMode
+  setIsm330DrdyConfig();
+#endif
+}
+
+// Reads consecutive ISM330DHCX registers in one I2C transaction
+bool ism330ReadRegisters(uint8_t Register, uint8_t* Buffer, size_t Length) {
+  Wire.beginTransmission(LSM6DS_I2CADDR_DEFAULT);
+  Wire.write(Register);
+  if (Wire.endTransmission(false) != 0)
+    return false;
+  if (Wire.requestFrom((uint8_t)LSM6DS_I2CADDR_DEFAULT, Length, true) != Length)
+    return false;
+  return Wire.readBytes(Buffer, Length) == Length;
+}
+
+bool ism330WriteRegister(uint8_t Register, uint8_t Value) {
+  Wire.beginTransmission(LSM6DS_I2CADDR_DEFAULT);
+  Wire.write(Register);
+  Wire.write(Value);
+  return Wire.endTransmission() == 0;
+}
+
+/**
+ * @brief Reads the ISM330DHCX gyro and accelerometer outputs as raw values.
+ *
+ * Reads the 12 output bytes in a single I2C burst from OUTX_L_G, without the
+ * temperature and without converting to floats, so the read stays cheap at high
+ * data rates. The values are scaled with `ISM330DHCX_GyroScale` and
+ * `ISM330DHCX_AccelScale` only when they are logged.
+ *
+ * @param Sample Filled with the raw readings.
+ *
+ * @return `true` if the sensor could be read.
+ */
+bool readIsm330Raw(Ism330RawSample& Sample) {
+  uint8_t data[12];
+  if (!ism330ReadRegisters(ISM330_OUTX_L_G, data, sizeof(data)))
+    return false;
+  decodeIsm330Axes(data, Sample.Gyro, 3);
+  decodeIsm330Axes(data + 6, Sample.Accel, 3);
+  return true;
+}
+
+// Converts a raw reading of a field (SampleFrame::addRaw) to its unit, with the scale from SampleFieldTable
+float scaleRawValue(uint8_t Field, long Raw) {
+  const float* scale = SampleFieldTable[Field].Scale;
+  return scale ? Raw * *scale : (float)Raw;
+}
+
+// Sets the scale factors of raw ISM330DHCX readings for the configured ranges, in the units of the Adafruit library
+void setIsm330Scales() {
+  switch (ism330dhcx.getAccelRange()) {  // mg per LSB
+    case LSM6DS_ACCEL_RANGE_2_G:
+      ISM330DHCX_AccelScale = 0.061f;
+      break;
+    case LSM6DS_ACCEL_RANGE_4_G:
+      ISM330DHCX_AccelScale = 0.122f;
+      break;
+    case LSM6DS_ACCEL_RANGE_8_G:
+      ISM330DHCX_AccelScale = 0.244f;
+      break;
+    default:  // LSM6DS_ACCEL_RANGE_16_G
+      ISM330DHCX_AccelScale = 0.488f;
+      break;
+  }
+  ISM330DHCX_AccelScale *= 9.80665f / 1000;
+  switch (ism330dhcx.getGyroRange()) {  // mdps per LSB
+    case LSM6DS_GYRO_RANGE_125_DPS:
+      ISM330DHCX_GyroScale = 4.375f;
+      break;
+    case LSM6DS_GYRO_RANGE_250_DPS:
+      ISM330DHCX_GyroScale = 8.75f;
+      break;
+    case LSM6DS_GYRO_RANGE_500_DPS:
+      ISM330DHCX_GyroScale = 17.5f;
+      break;
+    case LSM6DS_GYRO_RANGE_1000_DPS:
+      ISM330DHCX_GyroScale = 35.0f;
+      break;
+    case LSM6DS_GYRO_RANGE_2000_DPS:
+      ISM330DHCX_GyroScale = 70.0f;
+      break;
+    default:  // ISM330DHCX_GYRO_RANGE_4000_DPS
+      ISM330DHCX_GyroScale = 140.0f;
+      break;
+  }
+  ISM330DHCX_GyroScale *= 0.017453293f / 1000;
+}
+
+/**
+ * @brief Configures the ISM330DHCX FIFO for burst acquisition.
+ *
+ * This function sets up the sensor to batch every accelerometer and gyro reading
+ * at their output data rate into its FIFO, together with its timestamp counter
+ * (every 8th data rate period), in continuous mode with a watermark of
+ * `ISM330DHCX_FifoWatermark` words. `ISM330DHCX_Callback` then drains the FIFO in
+ * bursts (`drainIsm330Fifo()`).
+ *
+ * It also reads the timestamp counter trim, so FIFO samples can be timestamped.
+ *
+ * If the sensor does not accept the configuration, the function enters an infinite
+ * loop.
+ *
+ * @return void
+ */
+void setIsm330FifoConfig() {
+  // Both sensors are batched at the accelerometer data rate (the register codes match)
+  uint8_t rate = ism330dhcx.getAccelDataRate();
+  ism330Fifo.begin(rate);
+
+  uint8_t freqFine = 0;
+  uint8_t control = 0;
+  bool configured = ism330ReadRegisters(ISM330_INTERNAL_FREQ_FINE, &freqFine, 1) &&
+                    ism330ReadRegisters(ISM330_CTRL10_C, &control, 1) &&
+                    ism330WriteRegister(ISM330_FIFO_CTRL4, 0) &&  // Bypass mode empties the FIFO
+                    ism330WriteRegister(ISM330_CTRL10_C, control | Ism330TimestampEnable) &&
+                    ism330WriteRegister(ISM330_FIFO_CTRL1, ISM330DHCX_FifoWatermark & 0xFF) &&
+                    ism330WriteRegister(ISM330_FIFO_CTRL2, (ISM330DHCX_FifoWatermark >> 8) & 0x01) &&
+                    ism330WriteRegister(ISM330_FIFO_CTRL3, rate << 4 | rate) &&
+                    ism330WriteRegister(ISM330_FIFO_CTRL4, Ism330TimestampEvery8 | Ism330FifoContinuous);
+  if (!configured) {
+#ifdef SerialDebugMode
+    Serial.println("Failed to configure the ISM330DHCX FIFO");
+#endif
+    while (1) {
+      delay(10);
+    }
+  }
+  ism330Ticks.begin((int8_t)freqFine);
+
+#ifdef SerialDebugMode
+  Serial.print("ISM330DHCX FIFO enabled, watermark ");
+  Serial.print(ISM330DHCX_FifoWatermark);
+  Serial.print(" words, timestamp trim ");
+  Serial.println((int8_t)freqFine);
+#endif
+}
+
+/**
+ * @brief Configures the ISM330DHCX data-ready interrupt for DRDY acquisition.
+ *
+ * The accelerometer data-ready signal is already routed to INT1; this function
+ * switches it from latched to pulsed, so every sample produces an edge even if the
+ * previous one was not read, and resets the tracker (`ism330Drdy`) with the sample
+ * period of the configured data rate. `startHighRateSensors()` starts the sampling
+ * task and attaches the interrupt.
+ *
+ * If the sensor does not accept the configuration, the function enters an infinite
+ * loop.
+ *
+ * @return void
+ */
+void setIsm330DrdyConfig() {
+  // The rates are 6667 Hz / 2^(10 - code)
+  uint8_t rate = ism330dhcx.getAccelDataRate();
+  ism330Drdy.begin(150000UL << (10 - rate));
+
+  uint8_t counter = 0;
+  if (!ism330ReadRegisters(ISM330_COUNTER_BDR_REG1, &counter, 1) ||
+      !ism330WriteRegister(ISM330_COUNTER_BDR_REG1, counter | Ism330DrdyPulsed)) {
+#ifdef SerialDebugMode
+    Serial.println("Failed to configure the ISM330DHCX data-ready interrupt");
+#endif
+    while (1) {
+      delay(10);
+    }
+  }
+}
+
+/**
+ * @brief Changes the ISM330DHCX data rate for a logged rate (MQTT rate command).
+ *
+ * The logged rate is multiplied by the decimation ratio (if `ISM330DHCX_Decimate`
+ * is defined) and rounded down to a supported output data rate, at most
+ * `ISM330DHCX_DataRate`. Both sensors are set to that rate, and the FIFO
+ * (`setIsm330FifoConfig()`) or data-ready tracking (`setIsm330DrdyConfig()`) and the
+ * decimation filter are reset for it. The filter cutoff follows the data rate, as
+ * the decimation ratio stays the same.
+ *
+ * Only called while the sensor is stopped (see `startHighRateSensor()`).
+ *
+ * @param RateHz The requested logged rate, in frames per second.
+ *
+ * @return The rate the sensor logs at from now on, in frames per second.
+ */
+float setIsm330Rate(float RateHz) {
+#ifdef ISM330DHCX_Decimate
+  const uint8_t ratio = ISM330DHCX_DecimationRatio;
+#else
+  const uint8_t ratio = 1;
+#endif
+  uint8_t rate = LSM6DS_RATE_12_5_HZ;
+  while (rate < ISM330DHCX_DataRate && ism330RateHz(rate + 1) <= RateHz * ratio * 1.001f)
+    rate++;
+  ism330dhcx.setAccelDataRate((lsm6ds_data_rate_t)rate);
+  ism330dhcx.setGyroDataRate((lsm6ds_data_rate_t)rate);
+#ifdef ISM330DHCX_FifoMode
+  setIsm330FifoConfig();
+#endif
+#ifdef ISM330DHCX_DrdyMode
+  setIsm330DrdyConfig();
+#endif
+#ifdef ISM330DHCX_Decimate
+  ism330Decimator.reset();
+#endif
+
+#ifdef SerialDebugMode
+  Serial.print("ISM330DHCX data rate set to ");
+  Serial.print(ism330RateHz(rate));
+  Serial.println(" Hz");
+#endif
+  return ism330RateHz(rate) / ratio;
+}
+
+/**
+ * @brief Applies a start, stop or rate command to one sensor.
+ *
+ * `SensorControls` decides what has to change, and the sensor is started, stopped
+ * or re-rated accordingly: high-rate sensors through their timer (or data-ready
+ * interrupt) and data rate registers, low-rate sensors through the scheduler. A
+ * high-rate sensor is stopped and started again to change its rate, so the samples
+ * it queued at the old rate are logged first.
+ *
+ * @param Sensor The `SampleSensor` identifier.
+ * @param Type The command.
+ * @param RateHz The new rate for `SensorCommandRate`, in frames per second.
+ *
+ * @return The action taken.
+ */
+SensorAction applySensorCommand(uint8_t Sensor, SensorCommandType Type, float RateHz) {
+  SensorAction action = SensorControls[Sensor].apply(Type, RateHz);
+  bool highRate = SampleSensorTable[Sensor].Kind == HighRateSensor;
+  switch (action) {
+    case SensorActionStart:
+      if (highRate)
+        startHighRateSensor(Sensor);
+      else
+        startLowRateSensor(Sensor);
+      break;
+    case SensorActionStop:
+      if (highRate)
+        stopHighRateSensor(Sensor);
+      else
+        stopLowRateSensor(Sensor);
+      break;
+    case SensorActionSetRate:
+      if (highRate) {
+        stopHighRateSensor(Sensor);
+        startHighRateSensor(Sensor);
+      } else
+        setLowRateSensorRate(Sensor);
+      break;
+    default:
+      break;
+  }
+  return action;
+}
+
+/**
+ * @brief Handles a command received from Node-RED.
+ *
+ * Parses the payload (see SensorCommand.h) and applies it:
+ *
+ * - `NODE_RED_RESET`: Resets the device by calling `ESP.restart()`, after closing
+ *   the SD log file (if `SDLogging` is defined).
+ * - `NODE_RED_START` / `NODE_RED_STOP` `[sensor]`: Starts or stops one sensor, or
+ *   every sensor of `SampleSensorTable` if none is named. Stopped high-rate sensors
+ *   stop their timers, and the samples they already queued are logged; if
+ *   `InfluxLogging` is defined, the Influx buffer is then handed to the transmit
+ *   task. Once no sensor is running, the SD log file is closed (if `SDLogging` is
+ *   defined).
+ * - `NODE_RED_RATE <sensor> <frames per second>`: Changes the rate the sensor logs
+ *   at, between `SensorMinRateHz` and its configured rate.
+ *
+ * The state of every sensor the command applied to is published on
+ * `MQTT_TOPIC_SUBCRIBE`, e.g. `RSSI: running at 0.5 Hz`.
+ *
+ * @param Payload The MQTT message.
+ *
+ * @return void
+ */
+void handleSensorCommand(const char* Payload) {
+  static const char* const verbs[SensorCommandTypes] = { "", NODE_RED_RESET, NODE_RED_START, NODE_RED_STOP, NODE_RED_RATE };
+  SensorCommand command = parseSensorCommand(Payload, verbs, SampleSensorCount, [](uint8_t sensor) {
+    return SampleSensorTable[sensor].Module;
+  });
+
+  if (command.Type == SensorCommandUnknown) {
+#ifdef SerialDebugMode
+    Serial.println("Unknown command");
+#endif
+    return;
+  }
+  if (command.Type == SensorCommandReset) {
+    Serial.println("Resetting device");
+#ifdef SDLogging
+    closeDataLogSD();
+    sdBlocks.drain(pdMS_TO_TICKS(SDCloseTimeoutMs));
+#endif
+    ESP.restart();
+  }
+
+  bool stopped = false;
+  for (uint8_t sensor = 0; sensor < SampleSensorCount; sensor++) {
+    if (command.Sensor != SensorCommandAll && command.Sensor != sensor)
+      continue;
+    SensorAction action = applySensorCommand(sensor, command.Type, command.RateHz);
+    stopped |= action == SensorActionStop;
+
+    char reply[96];
+    if (action == SensorActionRejected)
+      snprintf(reply, sizeof(reply), "%s: rate must be %g to %g Hz", SampleSensorTable[sensor].Module, SensorMinRateHz, SampleSensorTable[sensor].PointsPerSecond);
+    else
+      snprintf(reply, sizeof(reply), "%s: %s at %g Hz", SampleSensorTable[sensor].Module, SensorControls[sensor].running() ? "running" : "stopped", SensorControls[sensor].rateHz());
+    mqttClient.publish(MQTT_TOPIC_SUBCRIBE, reply);
+#ifdef SerialDebugMode
+    Serial.println(reply);
+#endif
+  }
+
+#ifdef InfluxLogging
+  if (stopped)
+    transmitInfluxBuffer();
+#endif
+#ifdef SDLogging
+  bool running = false;
+  for (uint8_t sensor = 0; sensor < SampleSensorCount; sensor++)
+    running |= SensorControls[sensor].running();
+  if (stopped && !running)
+    closeDataLogSD();
+#endif
 }
 
 /**
@@ -1009,13 +1872,8 @@ void setIsm330Config() {  // From Arduino Example
  *    incoming messages.
  * 5. Prints a "Connected to MQTT broker" message if `SerialDebugMode` is defined.
  *
- * The callback function handles the following incoming messages:
- *
- * - `NODE_RED_RESET`: Resets the device by calling `ESP.restart()`.
- * - `NODE_RED_STOP`: Stops the recording by setting `ISM330DHCX_Run` and `RSSI_Run`
- *   to `false`. If `InfluxLogging` is defined, it also transmits the Influx buffer.
- * - `NODE_RED_START`: Starts the recording by setting `ISM330DHCX_Run` and `RSSI_Run`
- *   to `true`.
+ * The callback function passes every incoming message to `handleSensorCommand()`,
+ * which resets the device, or starts, stops or re-rates the sensors.
  *
  * If `SerialDebugMode` is defined, it prints debug messages for received messages.
  *
@@ -1036,32 +1894,196 @@ void onConnectionEstablished() {  // Contributed by Andrew Bryan
       Serial.println(payload);
 #endif
 
-      if (payload == NODE_RED_RESET) {
-        Serial.println("Resetting device");
-        ESP.restart();
-      } else if (payload == NODE_RED_STOP) {
-        ISM330DHCX_Run = false;
-        RSSI_Run = false;
+      handleSensorCommand(payload.c_str());
+    },
+    0);
+#ifdef SerialDebugMode
+  Serial.println("Connected to MQTT broker.");
+#endif
+}
+
+/**
+ * @brief Publishes the pipeline health counters over MQTT.
+ *
+ * Every `StatsPublishSeconds`, while the MQTT client is connected, this function
+ * publishes one JSON object on `MQTT_TOPIC_STATS` with:
+ *
+ * - Samples produced by the sensors, enqueued in and dropped by `HighRateRing`,
+ *   lost to sensor FIFO overflows, and logged.
+ * - ISM330DHCX samples missed and duplicate reads, and the measured sample period
+ *   (if `ISM330DHCX_DrdyMode` is defined).
+ * - Free heap now and the lowest free heap since boot.
+ * - GPS PPS clock servo lock state, last measured clock error, oscillator drift
+ *   estimate and the number of clock steps.
+ * - Runs, overruns (skipped runs) and the largest delay of every low-rate sensor
+ *   task (`lowRateScheduler`), as `[runs, overruns, max delay ms]` by task name.
+ * - Influx points dropped because both batches were full, writes and failed writes,
+ *   the write latency minimum/average/maximum since the last publish, the current
+ *   batch threshold and recent write error rate (if `InfluxLogging` is defined).
+ * - Flash spill queue depth, stored, replayed and dropped batches and the replay
+ *   rate since the last publish (if `InfluxSpillToFlash` is defined).
+ * - SD card write errors (frames that found no free block), the blocks queued to
+ *   the SD writer task, the blocks in use now and at most (of `SDBlockCount`),
+ *   the longest block write and the `sd_write_us` histogram of block write times
+ *   since boot (entries as in `publishSensorTimings()`), blocks that could not be
+ *   written and log files lost, the number of the log file and the bytes cut off
+ *   the previous one at boot (if `SDLogging` is defined).
+ *
+ * The counters are only read and formatted here, in loop(), so counting them costs
+ * the sensors and the transmit task nothing but an atomic increment.
+ *
+ * @return void
+ */
+void publishPipelineStats() {
+  static unsigned long lastPublish = 0;
+  if (millis() - lastPublish < StatsPublishSeconds * 1000UL || !mqttClient.isConnected())
+    return;
+#ifdef InfluxSpillToFlash
+  unsigned long elapsed = millis() - lastPublish;  // For the replay rate
+#endif
+  lastPublish = millis();
+
+  char(&json)[StatsMessageSize] = StatsMessage;
+  size_t length = snprintf(json, sizeof(json),
+                           "{\"device\":\"" DEVICE "\",\"uptime_s\":%lu,\"samples_produced\":%lu,\"samples_enqueued\":%lu,\"ring_dropped\":%lu,\"sensor_overruns\":%lu,\"samples_logged\":%lu,\"heap_free\":%lu,\"heap_min_free\":%lu",
+                           millis() / 1000,
+                           (unsigned long)pipelineStats.SamplesProduced.load(std::memory_order_relaxed),
+                           (unsigned long)pipelineStats.SamplesEnqueued.load(std::memory_order_relaxed),
+                           (unsigned long)HighRateRing.dropped(),
+                           (unsigned long)pipelineStats.SensorOverruns.load(std::memory_order_relaxed),
+                           (unsigned long)pipelineStats.SamplesLogged.load(std::memory_order_relaxed),
+                           (unsigned long)esp_get_free_heap_size(),
+                           (unsigned long)esp_get_minimum_free_heap_size());
+
+#ifdef ISM330DHCX_DrdyMode
+  if (length < sizeof(json))
+    length += snprintf(json + length, sizeof(json) - length,
+                       ",\"sensor_missed\":%lu,\"sensor_duplicates\":%lu,\"sensor_period_ns\":%lu",
+                       (unsigned long)ism330Drdy.missed(), (unsigned long)ism330Drdy.duplicates(),
+                       (unsigned long)ism330Drdy.periodNs());
+#endif
+
+  if (length < sizeof(json))
+    length += snprintf(json + length, sizeof(json) - length,
+                       ",\"pps_locked\":%u,\"pps_offset_us\":%ld,\"pps_drift_ppb\":%ld,\"pps_steps\":%lu",
+                       ppsServo.tracking(esp_timer_get_time()) ? 1 : 0,
+                       (long)ppsServo.offsetUs(), (long)ppsServo.driftPpb(),
+                       (unsigned long)ppsServo.steps());
+
+  // Low-rate tasks: runs, overruns (skipped runs) and the largest delay in milliseconds
+  if (length < sizeof(json))
+    length += snprintf(json + length, sizeof(json) - length, ",\"low_rate_tasks\":{");
+  for (uint8_t i = 0; i < lowRateScheduler.count() && length < sizeof(json); i++)
+    length += snprintf(json + length, sizeof(json) - length, "%s\"%s\":[%lu,%lu,%lu]", i > 0 ? "," : "",
+                       lowRateScheduler.task(i).Name, (unsigned long)lowRateScheduler.task(i).Runs,
+                       (unsigned long)lowRateScheduler.task(i).Overruns, (unsigned long)lowRateScheduler.task(i).MaxLateMs);
+  if (length < sizeof(json))
+    length += snprintf(json + length, sizeof(json) - length, "}");
+
 #ifdef InfluxLogging
-        transmitInfluxBuffer();
+  uint32_t flushMin, flushAvg, flushMax;
+  pipelineStats.takeFlushWindow(flushMin, flushAvg, flushMax);
+  if (length < sizeof(json))
+    length += snprintf(json + length, sizeof(json) - length,
+                       ",\"points_dropped\":%lu,\"flushes\":%lu,\"flush_failures\":%lu,\"flush_ms_min\":%lu,\"flush_ms_avg\":%lu,\"flush_ms_max\":%lu,\"batch_threshold\":%u,\"flush_error_permille\":%u",
+                       (unsigned long)pipelineStats.PointsDropped.load(std::memory_order_relaxed),
+                       (unsigned long)pipelineStats.Flushes.load(std::memory_order_relaxed),
+                       (unsigned long)pipelineStats.FlushFailures.load(std::memory_order_relaxed),
+                       (unsigned long)flushMin, (unsigned long)flushAvg, (unsigned long)flushMax,
+                       influxBatchControl.threshold(), influxBatchControl.errorRate());
+#endif
+
+#ifdef InfluxSpillToFlash
+  static uint32_t lastReplayedBytes = 0;
+  uint32_t replayedBytes = influxSpill.replayedBytes();
+  if (length < sizeof(json))
+    length += snprintf(json + length, sizeof(json) - length,
+                       ",\"spill_depth\":%lu,\"spill_bytes\":%lu,\"spill_stored\":%lu,\"spill_replayed\":%lu,\"spill_dropped\":%lu,\"spill_replay_bytes_per_s\":%lu",
+                       (unsigned long)influxSpill.depth(), (unsigned long)influxSpill.bytes(),
+                       (unsigned long)influxSpill.spilled(), (unsigned long)influxSpill.replayed(),
+                       (unsigned long)influxSpill.dropped(),
+                       (unsigned long)((uint64_t)(replayedBytes - lastReplayedBytes) * 1000 / elapsed));
+  lastReplayedBytes = replayedBytes;
+#endif
+
+#ifdef SDLogging
+  if (length < sizeof(json))
+    length += snprintf(json + length, sizeof(json) - length,
+                       ",\"sd_write_errors\":%lu,\"sd_block_writes\":%lu,\"sd_blocks_in_use\":%lu,\"sd_blocks_max\":%lu,\"sd_blocks\":%u,\"sd_write_us_max\":%lu,\"sd_failed_blocks\":%lu,\"sd_file_failures\":%lu,\"sd_file\":%lu,\"sd_recovered_bytes\":%lu,\"sd_write_us\":[",
+                       (unsigned long)pipelineStats.SdWriteErrors.load(std::memory_order_relaxed),
+                       (unsigned long)dataLog.writes(), (unsigned long)sdBlocks.inUse(), (unsigned long)sdBlocks.maxInUse(), SDBlockCount,
+                       (unsigned long)sdBlocks.maxWriteUs(), (unsigned long)sdBlocks.failedBlocks(), (unsigned long)sdBlocks.failures(),
+                       (unsigned long)dataLogSequence, (unsigned long)dataLogRecoveredBytes);
+  for (uint8_t bucket = 0; bucket < sdBlocks.WriteUs.used() && length < sizeof(json); bucket++)
+    length += snprintf(json + length, sizeof(json) - length, bucket > 0 ? ",%lu" : "%lu", (unsigned long)sdBlocks.WriteUs.count(bucket));
+  if (length < sizeof(json))
+    length += snprintf(json + length, sizeof(json) - length, "]");
 #endif
 
+  if (length + 1 >= sizeof(json)) {  // Truncated, StatsMessageSize too small
 #ifdef SerialDebugMode
-        Serial.println("Recording stopped");
+    Serial.println("Pipeline stats message truncated");
 #endif
-      } else if (payload == NODE_RED_START) {
-        ISM330DHCX_Run = true;
-        RSSI_Run = true;
+    return;
+  }
+  json[length++] = '}';
+  json[length] = '\0';
+  mqttClient.publish(MQTT_TOPIC_STATS, json);
 
+#ifdef SensorTimingHistograms
+  publishSensorTimings();
+#endif
+}
+
+#ifdef SensorTimingHistograms
+/**
+ * @brief Reports the poll timing histograms of the high-rate sensors.
+ *
+ * Called with the pipeline stats when `SensorTimingHistograms` is defined. For
+ * every high-rate sensor, one JSON object is published on `MQTT_TOPIC_TIMING`
+ * (and printed on the serial monitor if `SerialDebugMode` is defined) with the
+ * expected period, the number of polls and skipped ticks, and the `jitter_us`,
+ * `execution_us` and `latency_us` histograms since boot. Entry `b` of a histogram
+ * counts values from `2^(b-1)` to `2^b - 1` microseconds (entry 0: 0 us, the last
+ * entry: everything above); trailing empty entries are left out.
+ *
+ * The messages are built in `StatsMessage`, shared with `publishPipelineStats()`,
+ * one after the other.
+ *
+ * @return void
+ */
+void publishSensorTimings() {
+  for (uint8_t sensor = 0; sensor < SampleSensorCount; sensor++) {
+    if (SampleSensorTable[sensor].Kind != HighRateSensor)
+      continue;
+    const SensorTiming& timing = SensorTimings[sensor];
+    char(&json)[StatsMessageSize] = StatsMessage;
+    size_t length = snprintf(json, sizeof(json), "{\"device\":\"" DEVICE "\",\"sensor\":\"%s\",\"period_us\":%lu,\"polls\":%lu,\"skipped\":%lu",
+                             SampleSensorTable[sensor].Module, (unsigned long)timing.periodUs(),
+                             (unsigned long)timing.polls(), (unsigned long)timing.skipped());
+    const char* names[] = { "jitter_us", "execution_us", "latency_us" };
+    const Log2Histogram<SensorTiming::Buckets>* histograms[] = { &timing.Jitter, &timing.Execution, &timing.Latency };
+    for (uint8_t i = 0; i < 3 && length < sizeof(json); i++) {
+      length += snprintf(json + length, sizeof(json) - length, ",\"%s\":[", names[i]);
+      for (uint8_t bucket = 0; bucket < histograms[i]->used() && length < sizeof(json); bucket++)
+        length += snprintf(json + length, sizeof(json) - length, bucket > 0 ? ",%lu" : "%lu", (unsigned long)histograms[i]->count(bucket));
+      if (length < sizeof(json))
+        length += snprintf(json + length, sizeof(json) - length, "]");
+    }
+    if (length + 1 >= sizeof(json)) {  // Truncated, StatsMessageSize too small
 #ifdef SerialDebugMode
-        Serial.println("Recording started");
+      Serial.println("Sensor timing message truncated");
 #endif
-      }
-    },
-    0);
+      continue;
+    }
+    json[length++] = '}';
+    json[length] = '\0';
+    mqttClient.publish(MQTT_TOPIC_TIMING, json);
 #ifdef SerialDebugMode
-  Serial.println("Connected to MQTT broker.");
+    Serial.println(json);
 #endif
+  }
 }
+#endif
 
 #endif  // FunctionsCode
@@ -0,0 +1,283 @@
+/**
+ * @file Gzip.h
+ * @brief Small-footprint gzip (deflate) compressor for Influx write bodies.
+ *
+ * This file contains the compressor used to send line protocol batches to InfluxDB
+ * with `Content-Encoding: gzip`. Line protocol repeats the same measurement, tag
+ * and field names on every line, so even a simple LZ77 pass removes most of it.
+ *
+ * The output is one deflate block with the fixed Huffman codes (RFC 1951) in a
+ * gzip wrapper (RFC 1952), written bit by bit straight into the output buffer as
+ * the input is scanned. Memory use is bounded by the match window, set with
+ * `windowBits` in `begin()`: two tables of 2^windowBits 16-bit entries (hash heads
+ * and match chains), allocated once. No copy of the input or of the window is
+ * kept, since the whole batch is already in RAM.
+ *
+ * The compression level (1 to 9) sets how many earlier matches are compared per
+ * position and whether every position of a match is indexed; higher levels give
+ * smaller output for more CPU time.
+ */
+
+#ifndef GzipCode
+#define GzipCode
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Crc32.h"
+
+class GzipEncoder {
+public:
+  /**
+   * @brief Allocates the match tables. Called once during setup.
+   *
+   * @param windowBits Log2 of the match window in bytes (8 to 15).
+   * @param level Compression level, 1 (fastest) to 9 (smallest).
+   *
+   * @return `true` if the tables were allocated.
+   */
+  bool begin(uint8_t windowBits, uint8_t level) {
+    static const uint16_t ChainLimits[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256 };
+    if (windowBits < 8)
+      windowBits = 8;
+    if (windowBits > 15)
+      windowBits = 15;
+    if (level < 1)
+      level = 1;
+    if (level > 9)
+      level = 9;
+    WindowBits = windowBits;
+    MaxChain = ChainLimits[level - 1];
+    NiceLength = level <= 3 ? 16 : (level <= 6 ? 64 : MaxMatch);
+    IndexWholeMatch = level >= 4;
+
+    free(Head);
+    free(Prev);
+    Head = (uint16_t*)malloc(sizeof(uint16_t) << WindowBits);
+    Prev = (uint16_t*)malloc(sizeof(uint16_t) << WindowBits);
+    if (!Head || !Prev) {
+      free(Head);
+      free(Prev);
+      Head = Prev = nullptr;
+      return false;
+    }
+
+    // Fixed Huffman literal/length codes, stored bit-reversed since deflate writes codes MSB first
+    for (uint16_t symbol = 0; symbol < 288; symbol++) {
+      uint16_t code;
+      uint8_t length;
+      fixedCode(symbol, code, length);
+      FixedCodes[symbol] = reverseBits(code, length);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Compresses a buffer into a complete gzip member.
+   *
+   * @param in The data to compress.
+   * @param length Number of bytes to compress.
+   * @param out Destination buffer.
+   * @param capacity Size of the destination buffer.
+   *
+   * @return The size of the gzip data in bytes, or 0 if it did not fit in `out` (or
+   *         `begin()` was not successful); the caller then sends the data uncompressed.
+   */
+  size_t compress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+    if (!Head)
+      return 0;
+    Out = out;
+    Capacity = capacity;
+    Length = 0;
+    BitBuffer = 0;
+    BitCount = 0;
+    Overflow = false;
+    memset(Head, 0, sizeof(uint16_t) << WindowBits);
+
+    static const uint8_t Header[] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };  // Deflate, no name, no time, unknown OS
+    for (uint8_t i = 0; i < sizeof(Header); i++)
+      writeByte(Header[i]);
+
+    writeBits(1, 1);  // Final block
+    writeBits(1, 2);  // Fixed Huffman codes
+
+    size_t pos = 0;
+    while (pos < length && !Overflow) {
+      uint16_t matchLength = 0;
+      uint16_t matchDistance = 0;
+      if (length - pos >= MinMatch)
+        findMatch(in, length, pos, matchLength, matchDistance);
+
+      if (matchLength >= MinMatch) {
+        writeMatch(matchLength, matchDistance);
+        if (IndexWholeMatch) {
+          for (size_t i = pos + 1; i < pos + matchLength && length - i >= MinMatch; i++)
+            insert(in, i);
+        }
+        pos += matchLength;
+      } else {
+        writeSymbol(in[pos]);
+        pos++;
+      }
+    }
+    writeSymbol(256);  // End of block
+    if (BitCount)
+      writeByte(BitBuffer);  // Pad the last byte
+    BitBuffer = 0;
+    BitCount = 0;
+
+    uint32_t crc = crc32Update(0, in, length);
+    for (uint8_t i = 0; i < 4; i++)
+      writeByte(crc >> (8 * i));
+    for (uint8_t i = 0; i < 4; i++)
+      writeByte((uint32_t)length >> (8 * i));
+
+    return Overflow ? 0 : Length;
+  }
+
+  ~GzipEncoder() {
+    free(Head);
+    free(Prev);
+  }
+
+private:
+  enum : uint16_t {
+    MinMatch = 3,
+    MaxMatch = 258,
+    TooFar = 4096  // A 3 byte match further back than this costs more bits than 3 literals
+  };
+
+  uint32_t hash(const uint8_t* p) const {
+    uint32_t v = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (uint32_t)(v * 2654435761UL) >> (32 - WindowBits);
+  }
+
+  // Adds a position to the hash chains and returns the previous position with the same hash
+  uint16_t insert(const uint8_t* in, size_t pos) {
+    uint32_t h = hash(in + pos);
+    uint16_t previous = Head[h];
+    Head[h] = (uint16_t)pos;
+    Prev[pos & ((1UL << WindowBits) - 1)] = previous;
+    return previous;
+  }
+
+  /**
+   * Walks the hash chain of a position for the longest earlier match. Positions
+   * are stored modulo 2^16 and every candidate is compared byte for byte, so a
+   * stale or colliding entry can only make a match shorter, never wrong.
+   */
+  void findMatch(const uint8_t* in, size_t length, size_t pos, uint16_t& bestLength, uint16_t& bestDistance) {
+    uint16_t candidate = insert(in, pos);
+    size_t maxLength = length - pos < MaxMatch ? length - pos : (size_t)MaxMatch;
+    uint32_t window = 1UL << WindowBits;
+    uint32_t lastDistance = 0;
+    const uint8_t* current = in + pos;
+
+    for (uint16_t chain = MaxChain; chain > 0; chain--) {
+      uint32_t distance = (uint16_t)(pos - candidate);
+      if (distance == 0 || distance >= window || distance > pos || distance <= lastDistance)
+        break;  // Outside the window or the chain wrapped around
+      lastDistance = distance;
+
+      const uint8_t* match = current - distance;
+      if (match[bestLength] == current[bestLength] || bestLength == 0) {
+        size_t matched = 0;
+        while (matched < maxLength && match[matched] == current[matched])
+          matched++;
+        if (matched > bestLength && (matched > MinMatch || distance <= TooFar)) {
+          bestLength = matched;
+          bestDistance = distance;
+          if (matched >= NiceLength || matched == maxLength)
+            break;
+        }
+      }
+      candidate = Prev[candidate & (window - 1)];
+    }
+    if (bestLength < MinMatch)
+      bestLength = 0;
+  }
+
+  void writeMatch(uint16_t length, uint16_t distance) {
+    static const uint16_t LengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t LengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t DistanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t DistanceExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    uint8_t code = 28;
+    while (LengthBase[code] > length)
+      code--;
+    writeSymbol(257 + code);
+    writeBits(length - LengthBase[code], LengthExtra[code]);
+
+    code = 29;
+    while (DistanceBase[code] > distance)
+      code--;
+    writeBits(reverseBits(code, 5), 5);  // Fixed distance codes are 5 bits
+    writeBits(distance - DistanceBase[code], DistanceExtra[code]);
+  }
+
+  void writeSymbol(uint16_t symbol) {
+    uint8_t length = symbol < 144 ? 8 : (symbol < 256 ? 9 : (symbol < 280 ? 7 : 8));
+    writeBits(FixedCodes[symbol], length);
+  }
+
+  void writeBits(uint32_t value, uint8_t count) {
+    BitBuffer |= value << BitCount;
+    BitCount += count;
+    while (BitCount >= 8) {
+      writeByte(BitBuffer);
+      BitBuffer >>= 8;
+      BitCount -= 8;
+    }
+  }
+
+  void writeByte(uint8_t value) {
+    if (Length < Capacity)
+      Out[Length++] = value;
+    else
+      Overflow = true;
+  }
+
+  static void fixedCode(uint16_t symbol, uint16_t& code, uint8_t& length) {
+    if (symbol < 144) {
+      code = 0x30 + symbol;
+      length = 8;
+    } else if (symbol < 256) {
+      code = 0x190 + (symbol - 144);
+      length = 9;
+    } else if (symbol < 280) {
+      code = symbol - 256;
+      length = 7;
+    } else {
+      code = 0xC0 + (symbol - 280);
+      length = 8;
+    }
+  }
+
+  static uint16_t reverseBits(uint16_t value, uint8_t count) {
+    uint16_t reversed = 0;
+    while (count--) {
+      reversed = (reversed << 1) | (value & 1);
+      value >>= 1;
+    }
+    return reversed;
+  }
+
+  uint16_t* Head = nullptr;  // Most recent position per hash
+  uint16_t* Prev = nullptr;  // Previous position with the same hash, per window slot
+  uint16_t FixedCodes[288];
+  uint8_t WindowBits = 12;
+  uint16_t MaxChain = 8;
+  uint16_t NiceLength = 64;
+  bool IndexWholeMatch = true;
+
+  uint8_t* Out = nullptr;
+  size_t Capacity = 0;
+  size_t Length = 0;
+  uint32_t BitBuffer = 0;
+  uint8_t BitCount = 0;
+  bool Overflow = false;
+};
+
+#endif  // GzipCode
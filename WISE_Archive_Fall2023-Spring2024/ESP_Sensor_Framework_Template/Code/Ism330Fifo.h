@@ -0,0 +1,229 @@
+/**
+ * @file Ism330Fifo.h
+ * @brief Decoder for the ISM330DHCX FIFO and its sample timestamps.
+ *
+ * This file contains the register map and the decoder used to read the ISM330DHCX
+ * at its full output data rate (the register map is shared with the data-ready
+ * acquisition mode). The sensor batches every accelerometer and gyro
+ * reading into its FIFO, together with its own timestamp counter, and the FIFO is
+ * read in bursts of many samples per I2C transaction.
+ *
+ * Every FIFO word is 7 bytes: a tag byte (sensor in bits 7..3, a 2 bit time slot
+ * counter in bits 2..1) and 6 data bytes (three little-endian int16 values, or the
+ * 32 bit timestamp counter for timestamp words). All words of one output data rate
+ * period share the same time slot counter; `Ism330FifoDecoder` collects the gyro
+ * and accelerometer words of a slot into one sample. The timestamp is only batched
+ * every few slots, so the slots in between are timestamped from the last timestamp
+ * word and the batch data rate.
+ *
+ * Samples stay raw int16 readings (`Ism330RawSample`), as read from the output
+ * registers or the FIFO; they are scaled only when they are logged (see
+ * `SampleFrame::addRaw()`).
+ *
+ * The timestamp counter runs from the sensor's own oscillator (nominally 25 us per
+ * tick, trimmed by INTERNAL_FREQ_FINE). `Ism330TickClock` converts it to the ESP32
+ * monotonic timer from an anchor point (the counter read next to
+ * `esp_timer_get_time()` at every burst), so samples can be passed to the sample
+ * timestamp clock.
+ */
+
+#ifndef Ism330FifoCode
+#define Ism330FifoCode
+
+#include <stdint.h>
+
+// ISM330DHCX registers used for FIFO and data-ready acquisition
+enum Ism330Register : uint8_t {
+  ISM330_FIFO_CTRL1 = 0x07,         // Watermark bits 7..0
+  ISM330_FIFO_CTRL2 = 0x08,         // Watermark bit 8
+  ISM330_FIFO_CTRL3 = 0x09,         // Gyro (7..4) and accelerometer (3..0) batch data rate
+  ISM330_FIFO_CTRL4 = 0x0A,         // Timestamp batch decimation (7..6), FIFO mode (2..0)
+  ISM330_COUNTER_BDR_REG1 = 0x0B,   // dataready_pulsed (bit 7)
+  ISM330_CTRL10_C = 0x19,           // TIMESTAMP_EN (bit 5)
+  ISM330_STATUS_REG = 0x1E,         // XLDA (bit 0), GDA (bit 1)
+  ISM330_OUTX_L_G = 0x22,           // Gyro X, Y, Z then accelerometer X, Y, Z, little-endian int16
+  ISM330_FIFO_STATUS1 = 0x3A,
+  ISM330_FIFO_STATUS2 = 0x3B,
+  ISM330_TIMESTAMP0 = 0x40,
+  ISM330_INTERNAL_FREQ_FINE = 0x63,
+  ISM330_FIFO_DATA_OUT_TAG = 0x78,
+};
+
+enum Ism330FifoTag : uint8_t {
+  Ism330TagGyro = 0x01,
+  Ism330TagAccel = 0x02,
+  Ism330TagTemperature = 0x03,
+  Ism330TagTimestamp = 0x04,
+};
+
+static const uint8_t Ism330FifoWordSize = 7;
+static const uint8_t Ism330StatusWatermark = 0x80;  // FIFO_STATUS2 flags
+static const uint8_t Ism330StatusOverrun = 0x40;
+static const uint8_t Ism330TimestampEnable = 0x20;    // CTRL10_C
+static const uint8_t Ism330FifoContinuous = 0x06;     // FIFO_CTRL4 FIFO mode
+static const uint8_t Ism330TimestampEvery8 = 0x80;    // FIFO_CTRL4 timestamp batch decimation
+static const uint8_t Ism330DrdyPulsed = 0x80;         // COUNTER_BDR_REG1
+static const uint8_t Ism330StatusAccelReady = 0x01;   // STATUS_REG
+
+// Nominal output data rate of a data rate register code (LSM6DS_RATE_12_5_HZ = 1 to LSM6DS_RATE_6_66K_HZ = 10)
+inline float ism330RateHz(uint8_t rateCode) {
+  static const float Rates[] = { 0, 12.5f, 26, 52, 104, 208, 416, 833, 1666, 3332, 6667 };
+  return rateCode <= 10 ? Rates[rateCode] : 0;
+}
+
+// One reading of all six axes, in LSB of the configured ranges
+struct Ism330RawSample {
+  int16_t Gyro[3];
+  int16_t Accel[3];
+};
+
+// Reads little-endian int16 axes, e.g. the 12 bytes of the output registers from OUTX_L_G (gyro, then accelerometer)
+inline void decodeIsm330Axes(const uint8_t* data, int16_t* axes, uint8_t count) {
+  for (uint8_t axis = 0; axis < count; axis++)
+    axes[axis] = (int16_t)(data[2 * axis] | data[2 * axis + 1] << 8);
+}
+
+struct Ism330FifoSample : Ism330RawSample {
+  uint32_t Ticks;  // Sensor timestamp counter of the sample
+};
+
+class Ism330FifoDecoder {
+public:
+  /**
+   * @brief Resets the decoder for a batch data rate.
+   *
+   * @param rateCode Batch data rate register code of both sensors (7 = 833 Hz),
+   *                 the same code as the output data rate.
+   *
+   * @return void
+   */
+  void begin(uint8_t rateCode) {
+    // The rates are 6667 Hz / 2^(10 - code) and the counter runs at 40 kHz from the same oscillator
+    SlotTicks = rateCode >= 1 && rateCode <= 10 ? 6UL << (10 - rateCode) : 0;
+    reset();
+  }
+
+  // Forgets the current slot and timestamp, e.g. after the FIFO overran
+  void reset() {
+    InSlot = false;
+    HaveTimestamp = false;
+    Have = 0;
+    SlotsSinceTimestamp = 0;
+  }
+
+  /**
+   * @brief Decodes FIFO words read in a burst.
+   *
+   * A slot is complete once the first word of the next slot arrives, so the last
+   * slot of a burst is kept and completed by the next call.
+   *
+   * @param data The FIFO words, `Ism330FifoWordSize` bytes each.
+   * @param words Number of words in `data`.
+   * @param sink Called with every complete `Ism330FifoSample`, in time order.
+   *
+   * @return The number of samples passed to `sink`.
+   */
+  template<typename Sink>
+  uint16_t decode(const uint8_t* data, uint16_t words, Sink sink) {
+    uint16_t samples = 0;
+    for (uint16_t i = 0; i < words; i++, data += Ism330FifoWordSize) {
+      uint8_t tag = data[0] >> 3;
+      uint8_t slot = (data[0] >> 1) & 0x03;
+      if (!InSlot || slot != Slot) {
+        samples += finishSlot(sink);
+        InSlot = true;
+        Slot = slot;
+        Have = 0;
+        SlotsSinceTimestamp++;
+      }
+      switch (tag) {
+        case Ism330TagGyro:
+          decodeIsm330Axes(data + 1, Sample.Gyro, 3);
+          Have |= HaveGyro;
+          break;
+        case Ism330TagAccel:
+          decodeIsm330Axes(data + 1, Sample.Accel, 3);
+          Have |= HaveAccel;
+          break;
+        case Ism330TagTimestamp:
+          TimestampTicks = (uint32_t)data[1] | (uint32_t)data[2] << 8 | (uint32_t)data[3] << 16 | (uint32_t)data[4] << 24;
+          SlotsSinceTimestamp = 0;
+          HaveTimestamp = true;
+          break;
+        default:  // Temperature, configuration change, etc.
+          break;
+      }
+    }
+    return samples;
+  }
+
+  // Slots dropped because a sensor was missing or no timestamp was known yet
+  uint32_t skipped() const {
+    return Skipped;
+  }
+
+private:
+  enum : uint8_t { HaveGyro = 1, HaveAccel = 2 };
+
+  template<typename Sink>
+  uint16_t finishSlot(Sink& sink) {
+    if (!InSlot)
+      return 0;
+    if (Have != (HaveGyro | HaveAccel) || !HaveTimestamp) {
+      Skipped++;
+      return 0;
+    }
+    Sample.Ticks = TimestampTicks + SlotsSinceTimestamp * SlotTicks;
+    sink(Sample);
+    return 1;
+  }
+
+  Ism330FifoSample Sample;
+  uint32_t SlotTicks = 0;
+  uint32_t TimestampTicks = 0;
+  uint32_t SlotsSinceTimestamp = 0;
+  uint32_t Skipped = 0;
+  uint8_t Slot = 0;
+  uint8_t Have = 0;
+  bool InSlot = false;
+  bool HaveTimestamp = false;
+};
+
+class Ism330TickClock {
+public:
+  /**
+   * @brief Sets the period of the sensor timestamp counter.
+   *
+   * @param freqFine The INTERNAL_FREQ_FINE register (signed, 0.15% per LSB).
+   *
+   * @return void
+   */
+  void begin(int8_t freqFine) {
+    TickPs = (uint32_t)(25000000.0 / (1.0 + 0.0015 * freqFine) + 0.5);
+  }
+
+  /**
+   * @brief Ties the sensor timestamp counter to the monotonic timer.
+   *
+   * @param ticks The TIMESTAMP registers.
+   * @param monotonicUs Monotonic time the registers were read at, in microseconds.
+   *
+   * @return void
+   */
+  void anchor(uint32_t ticks, int64_t monotonicUs) {
+    AnchorTicks = ticks;
+    AnchorUs = monotonicUs;
+  }
+
+  // Monotonic time of a sensor timestamp near the anchor, in microseconds (the counter wraps after 29 hours)
+  int64_t monotonicAt(uint32_t ticks) const {
+    return AnchorUs + (int64_t)(int32_t)(ticks - AnchorTicks) * TickPs / 1000000;
+  }
+
+private:
+  uint32_t TickPs = 25000000;  // Picoseconds per tick
+  uint32_t AnchorTicks = 0;
+  int64_t AnchorUs = 0;
+};
+
+#endif  // Ism330FifoCode
@@ -0,0 +1,249 @@
+/**
+ * @file LineProtocol.h
+ * @brief Streaming InfluxDB line protocol encoder writing into a reusable buffer.
+ *
+ * This file contains the encoder used to build an InfluxDB write batch directly
+ * as line protocol text, without creating an intermediate object per data point.
+ * Each point is appended to one preallocated buffer as:
+ *
+ *   <measurement>,<tags> <field>=<value>,<field>=<value> <timestamp>\n
+ *
+ * The measurement and tag part of a line (the "prefix") and the field names are
+ * expected to be escaped once with `escapeMeasurement()`/`escapeKey()` and cached
+ * by the caller, so the per-point work is only copying bytes and formatting
+ * numbers.
+ *
+ * A point is written transactionally: if it does not fit in the remaining space
+ * the partial line is removed again when the point is ended, so the buffer always
+ * holds complete lines.
+ */
+
+#ifndef LineProtocolCode
+#define LineProtocolCode
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+class LineProtocolBatch {
+public:
+  /**
+   * @brief Allocates the batch buffer. Called once during setup.
+   *
+   * @param capacity Size of the buffer in bytes.
+   *
+   * @return `true` if the buffer was allocated.
+   */
+  bool begin(size_t capacity) {
+    Buffer = (char*)malloc(capacity + 1);  // +1 for the terminating null
+    Capacity = Buffer ? capacity : 0;
+    clear();
+    return Buffer != nullptr;
+  }
+
+  // Empties the batch, keeping the buffer for reuse
+  void clear() {
+    Length = 0;
+    PointStart = 0;
+    Points = 0;
+    InPoint = false;
+    if (Buffer)
+      Buffer[0] = '\0';
+  }
+
+  /**
+   * @brief Starts a new line with a cached, already escaped measurement and tag prefix.
+   *
+   * @param prefix The escaped "<measurement>,<tags>" text.
+   *
+   * @return void
+   */
+  void beginPoint(const char* prefix) {
+    PointStart = Length;
+    InPoint = true;
+    Overflow = false;
+    Fields = 0;
+    append(prefix, strlen(prefix));
+  }
+
+  // Adds a float field; NaN and infinite values can not be stored by InfluxDB and are skipped
+  void addField(const char* escapedName, float value, uint8_t precision) {
+    if (isnan(value) || isinf(value))
+      return;
+    beginField(escapedName);
+    appendFloat(value, precision);
+  }
+
+  // Adds an integer field
+  void addField(const char* escapedName, long value) {
+    beginField(escapedName);
+    appendInteger(value);
+    append('i');
+  }
+
+  /**
+   * @brief Finishes the current line with its timestamp.
+   *
+   * @param timestamp The timestamp of the point, in the batch write precision.
+   *
+   * @return `true` if the complete point is in the batch, `false` if it did not fit
+   *         (or had no valid fields) and was removed again.
+   */
+  bool endPoint(unsigned long long timestamp) {
+    if (!InPoint)
+      return false;
+    InPoint = false;
+    append(' ');
+    appendUnsigned(timestamp);
+    append('\n');
+    if (Overflow || Fields == 0) {  // Roll back the partial line
+      Length = PointStart;
+      Buffer[Length] = '\0';
+      return false;
+    }
+    Buffer[Length] = '\0';
+    Points++;
+    return true;
+  }
+
+  const char* data() const {
+    return Buffer;
+  }
+  size_t length() const {
+    return Length;
+  }
+  size_t capacity() const {
+    return Capacity;
+  }
+  size_t available() const {
+    return Capacity - Length;
+  }
+  uint16_t points() const {
+    return Points;
+  }
+
+  /**
+   * @brief Escapes a measurement name (commas and spaces).
+   *
+   * @param out Destination buffer.
+   * @param size Size of the destination buffer.
+   * @param name The unescaped name.
+   *
+   * @return The number of characters written (excluding the null), or 0 if it did not fit.
+   */
+  static size_t escapeMeasurement(char* out, size_t size, const char* name) {
+    return escape(out, size, name, ", ");
+  }
+
+  // Escapes a tag key, tag value or field key (commas, equals signs and spaces)
+  static size_t escapeKey(char* out, size_t size, const char* name) {
+    return escape(out, size, name, ",= ");
+  }
+
+private:
+  void beginField(const char* escapedName) {
+    append(Fields++ == 0 ? ' ' : ',');
+    append(escapedName, strlen(escapedName));
+    append('=');
+  }
+
+  void append(char c) {
+    if (Length < Capacity)
+      Buffer[Length++] = c;
+    else
+      Overflow = true;
+  }
+
+  void append(const char* text, size_t length) {
+    if (length > Capacity - Length) {
+      Overflow = true;
+      return;
+    }
+    memcpy(Buffer + Length, text, length);
+    Length += length;
+  }
+
+  void appendUnsigned(unsigned long long value) {
+    char digits[20];
+    size_t count = 0;
+    do {
+      digits[count++] = '0' + (value % 10);
+      value /= 10;
+    } while (value);
+    while (count)
+      append(digits[--count]);
+  }
+
+  void appendInteger(long value) {
+    if (value < 0) {
+      append('-');
+      appendUnsigned(0ULL - (unsigned long long)value);
+    } else
+      appendUnsigned(value);
+  }
+
+  /**
+   * Fixed-point float formatting: the value is scaled by 10^precision and rounded to
+   * an integer once, then printed as integer and fraction digits with trailing zeros
+   * removed (InfluxDB treats a number without an 'i' suffix as a float). Values too
+   * large for the fixed-point range fall back to scientific notation.
+   */
+  void appendFloat(float value, uint8_t precision) {
+    static const unsigned long long Pow10[] = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL };
+    if (precision > 9)
+      precision = 9;
+    double scaled = fabs((double)value) * Pow10[precision] + 0.5;
+    if (scaled >= 9.0e18) {
+      char text[24];
+      int length = snprintf(text, sizeof(text), "%.*e", precision, (double)value);
+      append(text, length > 0 ? length : 0);
+      return;
+    }
+    unsigned long long fixed = (unsigned long long)scaled;
+    if (value < 0 && fixed != 0)
+      append('-');
+    appendUnsigned(fixed / Pow10[precision]);
+    unsigned long long fraction = fixed % Pow10[precision];
+    if (fraction == 0)
+      return;
+    append('.');
+    uint8_t digits = precision;
+    while (fraction % 10 == 0) {  // Drop trailing zeros
+      fraction /= 10;
+      digits--;
+    }
+    char text[10];
+    for (uint8_t i = digits; i > 0; i--) {
+      text[i - 1] = '0' + (fraction % 10);
+      fraction /= 10;
+    }
+    append(text, digits);
+  }
+
+  static size_t escape(char* out, size_t size, const char* name, const char* special) {
+    size_t length = 0;
+    for (; *name; name++) {
+      bool needsEscape = strchr(special, *name) != nullptr;
+      if (length + (needsEscape ? 2 : 1) >= size)
+        return 0;
+      if (needsEscape)
+        out[length++] = '\\';
+      out[length++] = *name;
+    }
+    out[length] = '\0';
+    return length;
+  }
+
+  char* Buffer = nullptr;
+  size_t Capacity = 0;
+  size_t Length = 0;
+  size_t PointStart = 0;
+  uint16_t Points = 0;
+  uint8_t Fields = 0;
+  bool InPoint = false;
+  bool Overflow = false;
+};
+
+#endif  // LineProtocolCode
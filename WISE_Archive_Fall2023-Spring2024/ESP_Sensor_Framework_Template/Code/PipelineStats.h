@@ -0,0 +1,72 @@
+/**
+ * @file PipelineStats.h
+ * @brief Health counters of the data pipeline, from the sensors to the database.
+ *
+ * This file contains the counters that show where samples are lost or delayed
+ * without enabling any serial debugging. Every counter is a relaxed atomic that is
+ * only ever incremented or overwritten where the event happens, so updating them
+ * takes no lock and no formatting; they are read and formatted only when the
+ * statistics are published (see `publishPipelineStats()`).
+ *
+ * The flush latency minimum, average and maximum cover the writes since the last
+ * time the statistics were published (`takeFlushWindow()`), all other counters
+ * count since boot.
+ */
+
+#ifndef PipelineStatsCode
+#define PipelineStatsCode
+
+#include <atomic>
+#include <stdint.h>
+
+struct PipelineStats {
+  std::atomic<uint32_t> SamplesProduced{ 0 };  // Frames read by the sensors
+  std::atomic<uint32_t> SamplesEnqueued{ 0 };  // High-rate frames stored in HighRateRing
+  std::atomic<uint32_t> SensorOverruns{ 0 };   // Sensor FIFO overflows (samples lost in the sensor)
+  std::atomic<uint32_t> SamplesLogged{ 0 };    // Frames passed to the data logging destinations
+  std::atomic<uint32_t> PointsDropped{ 0 };    // Frames that did not fit in either Influx batch
+  std::atomic<uint32_t> Flushes{ 0 };          // Influx writes, including failed ones
+  std::atomic<uint32_t> FlushFailures{ 0 };
+  std::atomic<uint32_t> SdWriteErrors{ 0 };    // Frames that could not be written to the SD card
+
+  // Called by the transmit task after every write
+  void recordFlush(uint32_t latencyMs, bool success) {
+    Flushes.fetch_add(1, std::memory_order_relaxed);
+    if (!success)
+      FlushFailures.fetch_add(1, std::memory_order_relaxed);
+    WindowFlushes.fetch_add(1, std::memory_order_relaxed);
+    WindowTotalMs.fetch_add(latencyMs, std::memory_order_relaxed);
+    if (latencyMs < WindowMinMs.load(std::memory_order_relaxed))
+      WindowMinMs.store(latencyMs, std::memory_order_relaxed);
+    if (latencyMs > WindowMaxMs.load(std::memory_order_relaxed))
+      WindowMaxMs.store(latencyMs, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Reads and restarts the flush latency window.
+   *
+   * @param minMs Shortest write since the last call (0 if there was none).
+   * @param avgMs Average write since the last call (0 if there was none).
+   * @param maxMs Longest write since the last call.
+   *
+   * @return The number of writes since the last call.
+   */
+  uint32_t takeFlushWindow(uint32_t& minMs, uint32_t& avgMs, uint32_t& maxMs) {
+    uint32_t flushes = WindowFlushes.exchange(0, std::memory_order_relaxed);
+    uint32_t totalMs = WindowTotalMs.exchange(0, std::memory_order_relaxed);
+    minMs = WindowMinMs.exchange(UINT32_MAX, std::memory_order_relaxed);
+    maxMs = WindowMaxMs.exchange(0, std::memory_order_relaxed);
+    if (flushes == 0)
+      minMs = 0;
+    avgMs = flushes ? totalMs / flushes : 0;
+    return flushes;
+  }
+
+private:
+  std::atomic<uint32_t> WindowFlushes{ 0 };
+  std::atomic<uint32_t> WindowTotalMs{ 0 };
+  std::atomic<uint32_t> WindowMinMs{ UINT32_MAX };
+  std::atomic<uint32_t> WindowMaxMs{ 0 };
+};
+
+#endif  // PipelineStatsCode
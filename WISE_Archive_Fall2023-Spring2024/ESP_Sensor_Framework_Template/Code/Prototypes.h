@@ -12,6 +12,7 @@
  * found in other files, such as Functions.cpp or SensorsFast.cpp.
  */
 
+
 // ESP_Sensor_Framework_Template.ino
 void setup();
 void loop();
@@ -19,19 +20,38 @@ void loop();
 // SensorsFast.cpp
 void startHighRateSensors();
 void stopHighRateSensors();
-// static void FastSensorExample_Callback(void* args);
-static void ISM330DHCX_Callback(void* args);
+void resumeHighRateSensor(uint8_t Sensor);
+void startHighRateSensor(uint8_t Sensor);
+void stopHighRateSensor(uint8_t Sensor);
+void highRateTimerCallback(void* args);
+// void FastSensorExample_Callback();
+void ISM330DHCX_Callback();
+void drainIsm330Fifo();
+void ARDUINO_ISR_ATTR ISM330DHCX_DrdyISR();
+void ism330DrdyTask(void* Parameters);
+void readIsm330Drdy(int64_t EdgeUs);
+void queueIsm330Sample(uint64_t Timestamp, const Ism330RawSample& Sample);
+void queueHighRateFrame(const SampleFrame& Frame);
+void drainHighRateSensors();
 
 // SensorsSlow.cpp
 void startLowRateSensors();
 void stopLowRateSensors();
 void checkLowRateSensors();
+void startLowRateSensor(uint8_t Sensor);
+void stopLowRateSensor(uint8_t Sensor);
+void setLowRateSensorRate(uint8_t Sensor);
 // void SlowSensorExample_Poll();
 void RSSI_Poll();
 
 // Functions.cpp
 #ifdef InfluxLogging
 void setInfluxConfig();
+void cacheInfluxNames();
+int postInfluxWrite(HTTPClient& http, const uint8_t* Body, Stream* BodyFile, size_t Length, bool Gzip);
+bool influxWriteRetryable(int Status);
+bool replayInfluxSpill(HTTPClient& http);
+void influxTransmitTask(void* Parameters);
 #endif
 bool setWifiConfig(int Network = 1);
 void setWifiMultiConfig();
@@ -41,20 +61,42 @@ int32_t getGPSTime();
 int setUnixtime(int32_t unixtime);
 void ARDUINO_ISR_ATTR GPS_PPS_ISR();
 unsigned long long getTime();
+uint64_t getTimestampUs();
+uint64_t getTimestampUsAt(int64_t MonotonicUs);
+void setTimestampClock(int64_t MonotonicUs, int64_t EpochUs, int32_t RatePpb);
+void syncTimestampClock();
+void disciplineTimestampClock(int64_t PulseUs);
+void onNtpTimeSync(struct timeval* tv);
 unsigned long long getSeconds();
 
 unsigned long long getuSeconds();
 #ifdef InfluxLogging
-void transmitInfluxBuffer();
-void logDataInflux(unsigned long long uS, unsigned long long S, String Module, String Sensor, String Value, bool final);
+bool transmitInfluxBuffer();
+void logDataInflux(const SampleFrame& Frame);
 #endif
 #ifdef SDLogging
-void logDataSD(unsigned long long uS, unsigned long long S, String Module, String Sensor, String Value, bool final);
+void logDataSD(const SampleFrame& Frame);
 #endif
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, String Value, bool final);
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, float Value, bool final);
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, double Value, bool final);
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, int Value, bool final);
-void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, long Value, bool final);
+void closeDataLogSD();
+void dataLogPathSD(char* Path, size_t Size, uint32_t Sequence);
+bool openDataLogSD();
+bool openNextDataLogSD();
+void sdWriterTask(void* Parameters);
+void setDataLogSequenceSD(uint32_t Sequence);
+void beginDataLogSD();
+void recoverDataLogSD(uint32_t Sequence);
+void logFrame(const SampleFrame& Frame);
 void setIsm330Config();
-void onConnectionEstablished();
\ No newline at end of file
+bool ism330ReadRegisters(uint8_t Register, uint8_t* Buffer, size_t Length);
+bool ism330WriteRegister(uint8_t Register, uint8_t Value);
+bool readIsm330Raw(Ism330RawSample& Sample);
+float scaleRawValue(uint8_t Field, long Raw);
+void setIsm330Scales();
+void setIsm330FifoConfig();
+void setIsm330DrdyConfig();
+float setIsm330Rate(float RateHz);
+SensorAction applySensorCommand(uint8_t Sensor, SensorCommandType Type, float RateHz);
+void handleSensorCommand(const char* Payload);
+void onConnectionEstablished();
+void publishPipelineStats();
+void publishSensorTimings();
\ No newline at end of file
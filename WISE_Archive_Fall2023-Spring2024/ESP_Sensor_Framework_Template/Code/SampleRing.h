@@ -0,0 +1,84 @@
+/**
+ * @file SampleRing.h
+ * @brief Lock-free single-producer/single-consumer ring buffer for sensor samples.
+ *
+ * This file contains a fixed-capacity ring buffer used to hand raw sample records
+ * from a high-rate timer callback (the producer) to the main loop (the consumer)
+ * without taking any locks. The producer only ever writes the head index and the
+ * consumer only ever writes the tail index, so a push or pop is a copy of the
+ * record plus a single atomic store.
+ *
+ * Each ring must have exactly one producing context and one consuming context.
+ * When the ring is full, new records are dropped (never blocking the producer)
+ * and counted so the loss is visible to the consumer.
+ */
+
+#ifndef SampleRingCode
+#define SampleRingCode
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t Capacity>
+class SampleRing {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SampleRing capacity must be a power of two");
+
+public:
+  /**
+   * @brief Adds a record to the ring (producer side only).
+   *
+   * @param record The record to copy into the ring.
+   *
+   * @return `true` if the record was stored, `false` if the ring was full and the
+   *         record was dropped.
+   */
+  bool push(const T& record) {
+    const uint32_t head = Head.load(std::memory_order_relaxed);
+    if (head - Tail.load(std::memory_order_acquire) >= Capacity) {
+      Dropped.store(Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);  // Only the producer writes this
+      return false;
+    }
+    Records[head & (Capacity - 1)] = record;
+    Head.store(head + 1, std::memory_order_release);  // Publish the record to the consumer
+    return true;
+  }
+
+  /**
+   * @brief Removes the oldest record from the ring (consumer side only).
+   *
+   * @param record Destination for the removed record.
+   *
+   * @return `true` if a record was removed, `false` if the ring was empty.
+   */
+  bool pop(T& record) {
+    const uint32_t tail = Tail.load(std::memory_order_relaxed);
+    if (tail == Head.load(std::memory_order_acquire))
+      return false;
+    record = Records[tail & (Capacity - 1)];
+    Tail.store(tail + 1, std::memory_order_release);  // Hand the slot back to the producer
+    return true;
+  }
+
+  // Number of records currently waiting to be consumed
+  size_t size() const {
+    return Head.load(std::memory_order_acquire) - Tail.load(std::memory_order_acquire);
+  }
+
+  // Total number of records dropped because the ring was full
+  uint32_t dropped() const {
+    return Dropped.load(std::memory_order_relaxed);
+  }
+
+  static constexpr size_t capacity() {
+    return Capacity;
+  }
+
+private:
+  T Records[Capacity];
+  std::atomic<uint32_t> Head{ 0 };  // Next slot to write, owned by the producer
+  std::atomic<uint32_t> Tail{ 0 };  // Next slot to read, owned by the consumer
+  std::atomic<uint32_t> Dropped{ 0 };
+};
+
+#endif  // SampleRingCode
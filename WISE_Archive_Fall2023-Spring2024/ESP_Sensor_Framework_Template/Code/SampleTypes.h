@@ -0,0 +1,89 @@
+/**
+ * @file SampleTypes.h
+ * @brief Data types shared by the sensors and the data logging destinations.
+ *
+ * This file contains the typed value passed from the sensors to the data logging
+ * destinations, so a reading keeps its native numeric type until it is written
+ * to InfluxDB or the SD card instead of being converted to a String first.
+ *
+ * A sensor reports all values of one reading together as a `SampleFrame`: one
+ * timestamp plus the values of the sensor's fields, in the order they are listed
+ * for that sensor in SensorConfig.h. A frame is logged with `logFrame()` and is
+ * written by each data logging destination as one unit.
+ */
+
+#ifndef SampleTypesCode
+#define SampleTypesCode
+
+#include <stdint.h>
+
+struct SampleValue {
+  enum : uint8_t {
+    Float,    // Stored in F, written as an Influx float field
+    Integer,  // Stored in I, written as an Influx integer field
+    Raw       // Raw sensor reading stored in I, written as a float field after scaling (see SampleFieldTable)
+  } Type;
+  union {
+    float F;
+    long I;
+  };
+
+  static SampleValue fromFloat(float value) {
+    SampleValue v;
+    v.Type = Float;
+    v.F = value;
+    return v;
+  }
+
+  static SampleValue fromInteger(long value) {
+    SampleValue v;
+    v.Type = Integer;
+    v.I = value;
+    return v;
+  }
+
+  static SampleValue fromRaw(int16_t value) {
+    SampleValue v;
+    v.Type = Raw;
+    v.I = value;
+    return v;
+  }
+};
+
+#define SampleFrameMaxFields 6  // Largest number of fields reported by one sensor
+
+struct SampleFrame {
+  uint64_t Timestamp;  // Microseconds since the epoch (see getTimestampUs())
+  uint8_t Sensor;      // SampleSensor identifier (see SensorConfig.h)
+  uint8_t FieldCount;
+  SampleValue Values[SampleFrameMaxFields];
+
+  // Starts a new reading; values are then added in the sensor's field order
+  void begin(uint8_t sensor, uint64_t timestamp) {
+    Sensor = sensor;
+    Timestamp = timestamp;
+    FieldCount = 0;
+  }
+
+  void add(float value) {
+    if (FieldCount < SampleFrameMaxFields)
+      Values[FieldCount++] = SampleValue::fromFloat(value);
+  }
+
+  void add(long value) {
+    if (FieldCount < SampleFrameMaxFields)
+      Values[FieldCount++] = SampleValue::fromInteger(value);
+  }
+
+  void add(int value) {
+    add((long)value);
+  }
+
+  // Adds a raw register reading; it is only multiplied by the field's scale when the frame is logged
+  void addRaw(int16_t value) {
+    if (FieldCount < SampleFrameMaxFields)
+      Values[FieldCount++] = SampleValue::fromRaw(value);
+  }
+};
+
+#endif  // SampleTypesCode
@@ -0,0 +1,168 @@
+/**
+ * @file SdBlockQueue.h
+ * @brief Pool of SD log blocks shared by loop() and the SD writer task.
+ *
+ * This file contains the block pool between `SdBlockWriter` (loop()) and the SD
+ * writer task (`sdWriterTask()`). Two FreeRTOS queues pass block pointers around:
+ * free blocks from the writer task to loop(), and filled blocks with their
+ * requests from loop() to the writer task. Either side only waits on the queue,
+ * never on the other side's work.
+ *
+ * The blocks are allocated once, from DMA-capable internal RAM and aligned to a
+ * cache line, so the SD driver can send a block to the card without copying each
+ * sector through a bounce buffer; with the file-offset alignment of
+ * `SdBlockWriter`, a full block is written as whole sectors straight from RAM.
+ *
+ * To size the pool for a card, the queue keeps:
+ *
+ * - The number of blocks in use (being filled, queued or being written) and the
+ *   most ever in use. The pool is large enough while that maximum stays below the
+ *   block count.
+ * - The time the writer task took per block, as a histogram (`Log2Histogram`, in
+ *   microseconds) and its maximum. The pool covers a card stall of about
+ *   `(Blocks - 1) * BlockSize` bytes of logged data; if the slowest writes come
+ *   close to that at the logged data rate, add blocks.
+ * - Blocks the writer task could not write, and the number of times it lost the
+ *   file (reported to loop() through `takeFailure()`).
+ */
+
+#ifndef SdBlockQueueCode
+#define SdBlockQueueCode
+
+#include <atomic>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "SdBlockWriter.h"
+#include "SensorTiming.h"
+
+template<size_t BlockSize, uint8_t Blocks>
+class SdBlockQueue {
+public:
+  static const uint8_t Buckets = 24;  // The last bucket holds 2^22 us (4.2 s) and up
+  static const size_t Alignment = 32;
+
+  /**
+   * @brief Allocates the blocks and creates the queues.
+   *
+   * @return `false` if the memory could not be allocated.
+   */
+  bool begin() {
+    Free = xQueueCreate(Blocks, sizeof(uint8_t*));
+    Pending = xQueueCreate(Blocks, sizeof(SdBlock));  // Every queued request holds a block, so the pool always fits
+    if (Free == NULL || Pending == NULL)
+      return false;
+    for (uint8_t i = 0; i < Blocks; i++) {
+      uint8_t* block = (uint8_t*)heap_caps_aligned_alloc(Alignment, BlockSize, MALLOC_CAP_DMA);
+      if (block == nullptr)
+        return false;
+      xQueueSend(Free, &block, 0);
+    }
+    return true;
+  }
+
+  // loop(): a free block, or nullptr if all are in use
+  uint8_t* acquire() {
+    uint8_t* block;
+    if (Free == NULL || xQueueReceive(Free, &block, 0) != pdTRUE)
+      return nullptr;
+    uint32_t used = InUse.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (used > MaxInUse.load(std::memory_order_relaxed))
+      MaxInUse.store(used, std::memory_order_relaxed);
+    return block;
+  }
+
+  // loop(): hands a block to the writer task
+  bool submit(const SdBlock& block) {
+    Waiting.fetch_add(1, std::memory_order_relaxed);
+    if (xQueueSend(Pending, &block, 0) == pdTRUE)
+      return true;
+    Waiting.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // loop(): `true` once after the writer task lost the file
+  bool takeFailure() {
+    return Failed.exchange(false, std::memory_order_acquire);
+  }
+
+  // Writer task: waits for the next block
+  bool receive(SdBlock& block, TickType_t wait) {
+    return xQueueReceive(Pending, &block, wait) == pdTRUE;
+  }
+
+  /**
+   * @brief Returns a block to the pool once the writer task is done with it.
+   *
+   * @param block The block.
+   * @param writeUs Time the writer task spent on the block, in microseconds.
+   * @param written `false` if its data did not reach the file.
+   *
+   * @return void
+   */
+  void release(const SdBlock& block, uint32_t writeUs, bool written) {
+    WriteUs.add(writeUs);
+    if (writeUs > MaxWriteUs.load(std::memory_order_relaxed))
+      MaxWriteUs.store(writeUs, std::memory_order_relaxed);
+    if (!written && block.Length > 0)
+      FailedBlocks.fetch_add(1, std::memory_order_relaxed);
+    xQueueSend(Free, &block.Data, 0);
+    InUse.fetch_sub(1, std::memory_order_relaxed);
+    Waiting.fetch_sub(1, std::memory_order_release);
+  }
+
+  // Writer task: the file was lost, loop() starts a new one
+  void reportFailure() {
+    Failures.fetch_add(1, std::memory_order_relaxed);
+    Failed.store(true, std::memory_order_release);
+  }
+
+  /**
+   * @brief Waits until the writer task has handled every queued block.
+   *
+   * @param timeout Longest wait, in ticks.
+   *
+   * @return `false` if blocks were still queued after `timeout`.
+   */
+  bool drain(TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    while (Waiting.load(std::memory_order_acquire) > 0) {
+      if (xTaskGetTickCount() - start >= timeout)
+        return false;
+      vTaskDelay(1);
+    }
+    return true;
+  }
+
+  uint32_t inUse() const {
+    return InUse.load(std::memory_order_relaxed);
+  }
+  uint32_t maxInUse() const {
+    return MaxInUse.load(std::memory_order_relaxed);
+  }
+  uint32_t maxWriteUs() const {
+    return MaxWriteUs.load(std::memory_order_relaxed);
+  }
+  uint32_t failedBlocks() const {
+    return FailedBlocks.load(std::memory_order_relaxed);
+  }
+  uint32_t failures() const {
+    return Failures.load(std::memory_order_relaxed);
+  }
+
+  Log2Histogram<Buckets> WriteUs;  // Time the writer task spent per block
+
+private:
+  QueueHandle_t Free = NULL;
+  QueueHandle_t Pending = NULL;
+  std::atomic<uint32_t> InUse{ 0 };
+  std::atomic<uint32_t> MaxInUse{ 0 };
+  std::atomic<uint32_t> Waiting{ 0 };  // Blocks queued or being written
+  std::atomic<uint32_t> MaxWriteUs{ 0 };
+  std::atomic<uint32_t> FailedBlocks{ 0 };
+  std::atomic<uint32_t> Failures{ 0 };
+  std::atomic<bool> Failed{ false };
+};
+
+#endif  // SdBlockQueueCode
@@ -0,0 +1,220 @@
+/**
+ * @file SdBlockWriter.h
+ * @brief Block buffering of the SD card log, in front of the SD writer task.
+ *
+ * This file contains the writer that collects the logged data in RAM blocks and
+ * queues the filled blocks to the SD writer task, which does all file I/O (see
+ * `sdWriterTask()`). Logging a frame is a copy into the current block; the card
+ * sees a few large writes instead of an open, a small write and a close for every
+ * sample, and a slow write only holds up the writer task, never loop().
+ *
+ * Blocks are queued in two ways:
+ *
+ * - Size: as soon as a block is full. Blocks are aligned to the file offset, so
+ *   with a block size that is a multiple of the card's 512 byte sectors, every
+ *   full block covers whole sectors.
+ * - Time: `poll()` queues a partly filled block with a sync request (updating the
+ *   file size in the directory) once the oldest buffered byte has waited for the
+ *   flush interval, so at most that much data is lost on a power cut. The next
+ *   block is shortened to get back onto the block alignment.
+ *
+ * `begin()` starts a new file: the first block after it asks the writer task to
+ * move on to the next numbered file, which starts at offset 0. `close()` queues
+ * what is buffered with a request to close the file, e.g. before a restart or
+ * when logging stops.
+ *
+ * Blocks come from a fixed pool, and every request travels with a block, so the
+ * queue to the writer task can hold the whole pool and never overflows. If no
+ * block is free (the card stalled for longer than the pool covers), the data is
+ * dropped; `write()` takes every block it needs before copying, so data is never
+ * split around a dropped block. If the writer task fails to write a block, it
+ * closes the file and `isOpen()` turns false; the caller starts a new file for the
+ * next data.
+ *
+ * `Queue` is the pool, with `uint8_t* acquire()` (a free block of `BlockSize`
+ * bytes, or nullptr), `bool submit(const SdBlock&)` and `bool takeFailure()`, like
+ * `SdBlockQueue`. The writer is used from loop() only.
+ */
+
+#ifndef SdBlockWriterCode
+#define SdBlockWriterCode
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static const uint8_t SdBlockNewFile = 0x01;  // Close the current file and open the next numbered one before writing
+static const uint8_t SdBlockSync = 0x02;     // Sync the file after writing
+static const uint8_t SdBlockClose = 0x04;    // Close the file after writing
+
+// A block queued to the writer task, with its requests; `Length` may be 0 for a request alone
+struct SdBlock {
+  uint8_t* Data;
+  uint16_t Length;
+  uint8_t Flags;
+};
+
+template<size_t BlockSize, typename Queue>
+class SdBlockWriter {
+  static_assert(BlockSize >= 512 && BlockSize % 512 == 0, "The block should be a whole number of SD card sectors");
+  static_assert(BlockSize <= UINT16_MAX, "The block length must fit in SdBlock::Length");
+
+public:
+  // Sets the block pool, once before the first file
+  void setQueue(Queue* queue) {
+    Blocks = queue;
+  }
+
+  /**
+   * @brief Starts a new file; the next queued block opens it.
+   *
+   * Buffered data of a file that failed is dropped.
+   *
+   * @return `false` if there is no block pool.
+   */
+  bool begin() {
+    Open = Blocks != nullptr;
+    NewFile = true;
+    Offset = 0;
+    Used = 0;
+    return Open;
+  }
+
+  // `false` once the file was closed, or the writer task failed to write it
+  bool isOpen() {
+    if (Open && Blocks->takeFailure())
+      Open = false;
+    return Open;
+  }
+
+  /**
+   * @brief Adds data to the file, queuing every block that fills up.
+   *
+   * @param data The data.
+   * @param length Number of bytes, at most `BlockSize`.
+   * @param nowMs The current time, in milliseconds (starts the flush interval of an empty block).
+   *
+   * @return `false` if the file is not open or no block was free; nothing was added then.
+   */
+  bool write(const char* data, size_t length, uint32_t nowMs) {
+    if (!Open || length > BlockSize)
+      return false;
+    if (Current == nullptr && (Current = take()) == nullptr) {
+      Dropped++;
+      return false;
+    }
+    size_t room = blockEnd() - Used;
+    if (length > room && Spare == nullptr && (Spare = Blocks->acquire()) == nullptr) {
+      Dropped++;
+      return false;
+    }
+
+    if (Used == 0)
+      FirstMs = nowMs;
+    size_t part = length < room ? length : room;
+    memcpy(Current + Used, data, part);
+    Used += part;
+    if (Used < blockEnd())
+      return true;
+    bool queued = submit(0);
+    if (Current == nullptr)
+      Current = take();
+    if (length > part && queued) {
+      memcpy(Current + Used, data + part, length - part);
+      Used += length - part;
+      FirstMs = nowMs;
+    }
+    return queued;
+  }
+
+  /**
+   * @brief Queues the buffered data with a sync request if it waited long enough.
+   *
+   * @param nowMs The current time, in milliseconds.
+   * @param intervalMs Longest time data may wait in RAM.
+   *
+   * @return `false` if the data could not be queued.
+   */
+  bool poll(uint32_t nowMs, uint32_t intervalMs) {
+    if (!Open || Used == 0 || nowMs - FirstMs < intervalMs)
+      return true;
+    return flush();
+  }
+
+  // Queues the buffered data with a sync request (in an empty block if nothing is buffered)
+  bool flush() {
+    if (!Open)
+      return false;
+    return submit(SdBlockSync);
+  }
+
+  // Queues the buffered data with a request to close the file
+  bool close() {
+    if (!Open)
+      return true;
+    Open = false;
+    if (NewFile && Used == 0)  // The file was never opened
+      return true;
+    return submit(SdBlockClose);
+  }
+
+  // Blocks (full, partial or empty) queued to the writer task
+  uint32_t writes() const {
+    return Writes;
+  }
+  // Writes dropped because no block was free, or the queue was full
+  uint32_t dropped() const {
+    return Dropped;
+  }
+  size_t buffered() const {
+    return Used;
+  }
+  // File size, including the buffered bytes
+  uint64_t size() const {
+    return Offset + Used;
+  }
+
+private:
+  // Size of the current block, so it ends on a multiple of BlockSize in the file
+  size_t blockEnd() const {
+    return BlockSize - (size_t)(Offset % BlockSize);
+  }
+
+  // A free block, the spare one first
+  uint8_t* take() {
+    uint8_t* block = Spare != nullptr ? Spare : Blocks->acquire();
+    Spare = nullptr;
+    return block;
+  }
+
+  // Queues the current block with requests; if that fails, its data is dropped and the block kept
+  bool submit(uint8_t flags) {
+    if (Current == nullptr && (Current = take()) == nullptr)
+      return false;
+    SdBlock block = { Current, (uint16_t)Used, (uint8_t)(flags | (NewFile ? SdBlockNewFile : 0)) };
+    if (!Blocks->submit(block)) {
+      Dropped++;
+      Used = 0;
+      return false;
+    }
+    Current = nullptr;
+    NewFile = false;
+    Offset += Used;
+    Used = 0;
+    Writes++;
+    return true;
+  }
+
+  Queue* Blocks = nullptr;
+  uint8_t* Current = nullptr;  // Block being filled, from the pool
+  uint8_t* Spare = nullptr;    // Block taken for data that continues past Current
+  size_t Used = 0;             // Bytes in Current
+  uint64_t Offset = 0;         // File size, without the buffered bytes
+  uint32_t FirstMs = 0;        // Time the oldest buffered byte was added
+  uint32_t Writes = 0;
+  uint32_t Dropped = 0;
+  bool NewFile = false;  // The next queued block opens a new file
+  bool Open = false;
+};
+
+#endif  // SdBlockWriterCode
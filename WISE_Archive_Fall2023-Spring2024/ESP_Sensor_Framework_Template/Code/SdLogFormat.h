@@ -0,0 +1,290 @@
+/**
+ * @file SdLogFormat.h
+ * @brief Compact binary record format of the SD card log.
+ *
+ * This file contains the encoder of the binary SD card log. A text line per value
+ * ("DEVICE - Time: SS uSuS - Module: Sensor - Value") takes about 75 bytes, or
+ * 450 bytes per ISM330DHCX frame; the same frame takes 21 bytes as a binary entry.
+ * The log is decoded on a computer with the SD_Log_Decoder tool, which writes CSV
+ * or the same line protocol the sketch sends to InfluxDB.
+ *
+ * The log is a sequence of entries. Every entry is framed with its length and a
+ * CRC, so a write torn by a power loss or a corrupt sector is detected instead of
+ * being decoded as data:
+ *
+ *   payload length (uint16), payload, CRC-32 of the length and payload (uint32)
+ *
+ * Each call of the encoder produces one entry, holding one or more records; all
+ * numbers are little-endian:
+ *
+ * - File header, written every time a file is opened (the first entry of every
+ *   file, and of every session if a file is opened again):
+ *     0xFF, "WSDL", version (uint8), device name length (uint8), device name
+ * - Sensor definition, written before the first frame of a sensor in a session,
+ *   and again whenever the types or scales of its values change:
+ *     0xFE, sensor (uint8), module name length (uint8), module name,
+ *     field count (uint8), then per field:
+ *       value type (uint8 `SdLogValueType`), scale (float32),
+ *       field name length (uint8), field name
+ * - Frame, one per `SampleFrame`, with a size fixed by the sensor definition:
+ *     sensor (uint8), timestamp delta from the previous frame of the sensor in
+ *     microseconds (uint16), then the values, or
+ *     sensor | 0x80, timestamp in microseconds since the epoch (uint64), then the
+ *     values, for the first frame after a definition and whenever the delta is
+ *     negative or does not fit in 16 bits.
+ *   The values are int16 for raw readings (multiplied by the field's scale when
+ *   decoded), float32 for float values and int32 for integer values.
+ *
+ * Version 1 logs had the same records without the entry framing.
+ *
+ * The encoder remembers which sensors it defined and the last timestamp of each,
+ * so it must only count entries that reached the file: `encodeFrame()` keeps the
+ * new state of the sensor pending, and `commitFrame()` applies it once the entry
+ * was written. An entry that was dropped instead leaves the state as it was, so
+ * the next frame repeats the definition or measures its delta from the last
+ * written frame.
+ *
+ * `sdLogValidEnd()` finds the end of the last intact entry in the last bytes of a
+ * file, so after a power loss the file can be truncated there by reading only its
+ * tail.
+ */
+
+#ifndef SdLogFormatCode
+#define SdLogFormatCode
+
+#include <stdint.h>
+#include <string.h>
+#include "Crc32.h"
+#include "SampleTypes.h"
+
+static const uint8_t SdLogFileTag = 0xFF;
+static const uint8_t SdLogSensorTag = 0xFE;
+static const uint8_t SdLogAbsoluteFlag = 0x80;  // Frame tag flag: a full timestamp instead of a delta
+static const uint8_t SdLogMaxSensors = 0x7E;    // Frame tags must stay below the definition and header tags
+static const char SdLogMagic[4] = { 'W', 'S', 'D', 'L' };
+static const uint8_t SdLogVersion = 2;
+static const uint8_t SdLogEntryOverhead = 6;  // Length before and CRC after the payload of an entry
+static const uint16_t SdLogMaxEntry = 2048;   // Largest payload, bounds the recovery scan
+
+enum SdLogValueType : uint8_t {
+  SdLogFloat,    // float32
+  SdLogInteger,  // int32
+  SdLogRaw,      // int16, times the field's scale
+};
+
+// Name and scale of one field of a sensor, as passed to `SdLogEncoder::encodeFrame()`
+struct SdLogField {
+  const char* Name;
+  float Scale;  // Multiplies raw readings, 1 for other fields
+};
+
+// Bytes of one value of a type in a frame record
+inline uint8_t sdLogValueSize(uint8_t type) {
+  return type == SdLogRaw ? 2 : 4;
+}
+
+// Length of the intact entry at the start of `data` (overhead included), 0 if it is incomplete or corrupt
+inline size_t sdLogEntryLength(const uint8_t* data, size_t length) {
+  if (length < SdLogEntryOverhead)
+    return 0;
+  size_t payload = data[0] | (size_t)data[1] << 8;
+  if (payload == 0 || payload > SdLogMaxEntry || payload + SdLogEntryOverhead > length)
+    return 0;
+  const uint8_t* crc = data + 2 + payload;
+  uint32_t stored = (uint32_t)crc[0] | (uint32_t)crc[1] << 8 | (uint32_t)crc[2] << 16 | (uint32_t)crc[3] << 24;
+  return crc32Update(0, data, 2 + payload) == stored ? payload + SdLogEntryOverhead : 0;
+}
+
+/**
+ * @brief Finds the end of the last intact entry in the last bytes of a log file.
+ *
+ * The first intact entry is searched byte by byte (`tail` may start in the middle
+ * of an entry), then entries are followed to the end; corrupt bytes between intact
+ * entries are skipped the same way.
+ *
+ * @param tail The last bytes of the file (or the whole file).
+ * @param length Number of bytes in `tail`.
+ * @param end Set to the offset in `tail` after the last intact entry.
+ *
+ * @return `false` if `tail` holds no intact entry.
+ */
+inline bool sdLogValidEnd(const uint8_t* tail, size_t length, size_t& end) {
+  bool found = false;
+  size_t position = 0;
+  while (position < length) {
+    size_t entry = sdLogEntryLength(tail + position, length - position);
+    if (entry == 0) {
+      position++;
+      continue;
+    }
+    position += entry;
+    end = position;
+    found = true;
+  }
+  return found;
+}
+
+template<uint8_t Sensors>
+class SdLogEncoder {
+  static_assert(Sensors <= SdLogMaxSensors, "Too many sensors for the frame tags of the binary SD log");
+
+public:
+  /**
+   * @brief Starts a new session, after the log file was opened.
+   *
+   * Every sensor is defined again before its next frame.
+   *
+   * @param out Destination of the file header entry.
+   * @param capacity Size of `out`.
+   * @param device Name of the device.
+   *
+   * @return The length of the entry, or 0 if it did not fit in `out`.
+   */
+  size_t beginFile(uint8_t* out, size_t capacity, const char* device) {
+    for (uint8_t sensor = 0; sensor < Sensors; sensor++)
+      State[sensor].Defined = false;
+    HavePending = false;
+    Record record = { out, capacity, 0 };
+    record.byte(SdLogFileTag);
+    record.bytes(SdLogMagic, sizeof(SdLogMagic));
+    record.byte(SdLogVersion);
+    record.name(device);
+    return record.seal();
+  }
+
+  /**
+   * @brief Encodes one frame, preceded by the definition of its sensor if needed.
+   *
+   * The sensor state is only updated by `commitFrame()`, once the entry was written.
+   *
+   * @param out Destination of the entry.
+   * @param capacity Size of `out`.
+   * @param frame The frame.
+   * @param module Module name of the frame's sensor.
+   * @param fieldOf Returns the `SdLogField` of a value of the frame, `SdLogField fieldOf(uint8_t)`.
+   *
+   * @return The length of the entry, or 0 if the frame's sensor is out of range or
+   *         the entry did not fit in `out`.
+   */
+  template<typename FieldOf>
+  size_t encodeFrame(uint8_t* out, size_t capacity, const SampleFrame& frame, const char* module, FieldOf fieldOf) {
+    if (frame.Sensor >= Sensors)
+      return 0;
+    SensorState state = State[frame.Sensor];
+    Record record = { out, capacity, 0 };
+
+    bool changed = !state.Defined || state.FieldCount != frame.FieldCount;
+    for (uint8_t i = 0; !changed && i < frame.FieldCount; i++)
+      changed = state.Types[i] != frame.Values[i].Type || (frame.Values[i].Type == SampleValue::Raw && state.Scales[i] != fieldOf(i).Scale);
+    if (changed) {
+      record.byte(SdLogSensorTag);
+      record.byte(frame.Sensor);
+      record.name(module);
+      record.byte(frame.FieldCount);
+      for (uint8_t i = 0; i < frame.FieldCount; i++) {
+        SdLogField field = fieldOf(i);
+        state.Types[i] = frame.Values[i].Type;
+        state.Scales[i] = frame.Values[i].Type == SampleValue::Raw ? field.Scale : 1.0f;
+        record.byte(typeOf(state.Types[i]));
+        record.number(state.Scales[i]);
+        record.name(field.Name);
+      }
+      state.FieldCount = frame.FieldCount;
+      state.Defined = true;
+      state.HaveTimestamp = false;
+    }
+
+    uint64_t delta = frame.Timestamp - state.LastUs;
+    if (state.HaveTimestamp && frame.Timestamp >= state.LastUs && delta <= UINT16_MAX) {
+      record.byte(frame.Sensor);
+      record.number((uint16_t)delta);
+    } else {
+      record.byte(frame.Sensor | SdLogAbsoluteFlag);
+      record.number(frame.Timestamp);
+    }
+    for (uint8_t i = 0; i < frame.FieldCount; i++) {
+      if (frame.Values[i].Type == SampleValue::Raw)
+        record.number((int16_t)frame.Values[i].I);
+      else if (frame.Values[i].Type == SampleValue::Float)
+        record.number(frame.Values[i].F);
+      else
+        record.number((int32_t)frame.Values[i].I);
+    }
+
+    size_t length = record.seal();
+    HavePending = length > 0;
+    if (length == 0)
+      return 0;
+    state.LastUs = frame.Timestamp;
+    state.HaveTimestamp = true;
+    Pending = state;
+    PendingSensor = frame.Sensor;
+    return length;
+  }
+
+  // Applies the sensor state of the last encoded frame, after its entry was written
+  void commitFrame() {
+    if (HavePending)
+      State[PendingSensor] = Pending;
+    HavePending = false;
+  }
+
+private:
+  struct SensorState {
+    uint64_t LastUs;
+    float Scales[SampleFrameMaxFields];
+    uint8_t Types[SampleFrameMaxFields];  // SampleValue types
+    uint8_t FieldCount;
+    bool Defined;
+    bool HaveTimestamp;
+  };
+
+  // Appends the records of one entry to a buffer; `seal()` returns 0 if anything did not fit
+  struct Record {
+    uint8_t* Out;  // The entry, the payload starts after the length
+    size_t Capacity;
+    size_t Length;  // Payload bytes
+
+    void bytes(const void* data, size_t length) {
+      if (2 + Length + length <= Capacity)
+        memcpy(Out + 2 + Length, data, length);
+      Length += length;
+    }
+    void byte(uint8_t value) {
+      bytes(&value, 1);
+    }
+    // Little-endian, like the ESP32 and the usual host machines
+    template<typename T>
+    void number(T value) {
+      bytes(&value, sizeof(value));
+    }
+    // Length-prefixed, at most 255 characters
+    void name(const char* text) {
+      size_t length = strlen(text);
+      byte(length < 255 ? (uint8_t)length : 255);
+      bytes(text, length < 255 ? length : 255);
+    }
+    // Adds the length and CRC, returns the length of the entry
+    size_t seal() {
+      if (Length == 0 || Length > SdLogMaxEntry || Length + SdLogEntryOverhead > Capacity)
+        return 0;
+      Out[0] = (uint8_t)Length;
+      Out[1] = (uint8_t)(Length >> 8);
+      uint32_t crc = crc32Update(0, Out, 2 + Length);
+      for (uint8_t i = 0; i < 4; i++)
+        Out[2 + Length + i] = (uint8_t)(crc >> (8 * i));
+      return Length + SdLogEntryOverhead;
+    }
+  };
+
+  static uint8_t typeOf(uint8_t sampleType) {
+    return sampleType == SampleValue::Raw ? SdLogRaw : sampleType == SampleValue::Float ? SdLogFloat : SdLogInteger;
+  }
+
+  SensorState State[Sensors] = {};
+  SensorState Pending = {};  // State of the last encoded frame's sensor, until it is committed
+  uint8_t PendingSensor = 0;
+  bool HavePending = false;
+};
+
+#endif  // SdLogFormatCode
@@ -0,0 +1,213 @@
+/**
+ * @file SensorCommand.h
+ * @brief Parser and state machine for the remote sensor control commands.
+ *
+ * This file contains the logic behind the commands Node-RED sends over MQTT to
+ * stop, restart and re-rate the sensors while the device keeps running:
+ *
+ * - `<verb>` applies to every sensor (e.g. `stop`).
+ * - `<verb> <sensor>` applies to one sensor (e.g. `stop RSSI`).
+ * - `<rate verb> <sensor> <frames per second>` changes the rate a sensor logs at
+ *   (e.g. `rate RSSI 0.2`).
+ *
+ * The verbs are passed in by the caller (the `NODE_RED_*` commands). The sensor is
+ * named by its module name, compared without regard to case, so names may contain
+ * spaces; the rate is the last word of a rate command.
+ *
+ * `SensorControlState` tracks whether one sensor runs and at which rate, and turns
+ * every command into the single action the sketch has to take, so a command that
+ * does not change anything (stopping a stopped sensor, setting the current rate)
+ * does not touch the timers or the sensor. A rate set while the sensor is stopped
+ * is kept and applied when it is started again.
+ */
+
+#ifndef SensorCommandCode
+#define SensorCommandCode
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum SensorCommandType : uint8_t {
+  SensorCommandUnknown,  // Not a command, or a malformed one
+  SensorCommandReset,
+  SensorCommandStart,
+  SensorCommandStop,
+  SensorCommandRate,
+  SensorCommandTypes
+};
+
+static const uint8_t SensorCommandAll = 0xFF;  // SensorCommand::Sensor of commands without a sensor
+
+struct SensorCommand {
+  SensorCommandType Type;
+  uint8_t Sensor;  // SampleSensor identifier, or SensorCommandAll
+  float RateHz;    // Rate commands only
+};
+
+// Compares `length` characters of `text` with the whole of `name`, without regard to ASCII case
+inline bool sensorCommandNameEquals(const char* text, size_t length, const char* name) {
+  for (size_t i = 0; i < length; i++, name++) {
+    char a = text[i], b = *name;
+    if (b == '\0')
+      return false;
+    if (a >= 'A' && a <= 'Z')
+      a += 'a' - 'A';
+    if (b >= 'A' && b <= 'Z')
+      b += 'a' - 'A';
+    if (a != b)
+      return false;
+  }
+  return *name == '\0';
+}
+
+/**
+ * @brief Parses one command payload.
+ *
+ * @param payload The command, as received (leading and trailing spaces are ignored).
+ * @param verbs The verb of every command type, indexed by `SensorCommandType`
+ *              (entry `SensorCommandUnknown` is not used).
+ * @param sensors Number of sensors.
+ * @param nameOf Returns the module name of a sensor, `const char* nameOf(uint8_t)`.
+ *
+ * @return The command; `SensorCommandUnknown` if the verb, sensor or rate is not
+ *         recognized, or a reset or rate command has the wrong arguments.
+ */
+template<typename NameOf>
+SensorCommand parseSensorCommand(const char* payload, const char* const* verbs, uint8_t sensors, NameOf nameOf) {
+  SensorCommand command = { SensorCommandUnknown, SensorCommandAll, 0 };
+  while (*payload == ' ')
+    payload++;
+  size_t length = strlen(payload);
+  while (length > 0 && payload[length - 1] == ' ')
+    length--;
+
+  size_t verbLength = 0;
+  while (verbLength < length && payload[verbLength] != ' ')
+    verbLength++;
+  uint8_t type = SensorCommandUnknown + 1;
+  while (type < SensorCommandTypes && !sensorCommandNameEquals(payload, verbLength, verbs[type]))
+    type++;
+  if (type == SensorCommandTypes)
+    return command;
+
+  const char* name = payload + verbLength;
+  size_t nameLength = length - verbLength;
+  while (nameLength > 0 && *name == ' ') {
+    name++;
+    nameLength--;
+  }
+
+  if (type == SensorCommandRate) {  // The rate is the last word
+    size_t rateStart = nameLength;
+    while (rateStart > 0 && name[rateStart - 1] != ' ')
+      rateStart--;
+    if (rateStart == 0 || rateStart == nameLength)
+      return command;
+    char rate[16];
+    size_t rateLength = nameLength - rateStart;
+    if (rateLength >= sizeof(rate))
+      return command;
+    memcpy(rate, name + rateStart, rateLength);
+    rate[rateLength] = '\0';
+    char* end;
+    command.RateHz = strtof(rate, &end);
+    if (*end != '\0' || !(command.RateHz > 0))
+      return command;
+    nameLength = rateStart;
+    while (nameLength > 0 && name[nameLength - 1] == ' ')
+      nameLength--;
+  }
+
+  if (nameLength > 0) {
+    uint8_t sensor = 0;
+    while (sensor < sensors && !sensorCommandNameEquals(name, nameLength, nameOf(sensor)))
+      sensor++;
+    if (sensor == sensors || type == SensorCommandReset)
+      return command;
+    command.Sensor = sensor;
+  }
+  command.Type = (SensorCommandType)type;
+  return command;
+}
+
+// What the sketch has to do to apply a command to one sensor
+enum SensorAction : uint8_t {
+  SensorActionNone,      // Nothing changed
+  SensorActionStart,     // Start the sensor, at `rateHz()`
+  SensorActionStop,      // Stop the sensor and log what it already queued
+  SensorActionSetRate,   // Change the rate of the running sensor to `rateHz()`
+  SensorActionRejected,  // The rate is outside the sensor's range
+};
+
+class SensorControlState {
+public:
+  /**
+   * @brief Sets the rate range of the sensor; it starts out running.
+   *
+   * @param rateHz Current rate, in frames per second.
+   * @param minHz Lowest rate a command may set.
+   * @param maxHz Highest rate a command may set (the rate the budgets were checked for).
+   *
+   * @return void
+   */
+  void begin(float rateHz, float minHz, float maxHz) {
+    Rate = rateHz;
+    MinHz = minHz;
+    MaxHz = maxHz;
+    Running = true;
+  }
+
+  /**
+   * @brief Applies a start, stop or rate command to the sensor.
+   *
+   * @param type The command.
+   * @param rateHz The new rate, for `SensorCommandRate`.
+   *
+   * @return The action that brings the sensor to its new state.
+   */
+  SensorAction apply(SensorCommandType type, float rateHz) {
+    switch (type) {
+      case SensorCommandStart:
+        if (Running)
+          return SensorActionNone;
+        Running = true;
+        return SensorActionStart;
+      case SensorCommandStop:
+        if (!Running)
+          return SensorActionNone;
+        Running = false;
+        return SensorActionStop;
+      case SensorCommandRate:
+        if (!(rateHz >= MinHz && rateHz <= MaxHz))
+          return SensorActionRejected;
+        if (rateHz == Rate)
+          return SensorActionNone;
+        Rate = rateHz;
+        return Running ? SensorActionSetRate : SensorActionNone;
+      default:
+        return SensorActionNone;
+    }
+  }
+
+  // Records the rate the sensor actually runs at, e.g. after rounding to a supported data rate
+  void applied(float rateHz) {
+    Rate = rateHz;
+  }
+
+  bool running() const {
+    return Running;
+  }
+  // Rate in frames per second (while stopped: the rate it will start at)
+  float rateHz() const {
+    return Rate;
+  }
+
+private:
+  float Rate = 0;
+  float MinHz = 0;
+  float MaxHz = 0;
+  bool Running = false;
+};
+
+#endif  // SensorCommandCode
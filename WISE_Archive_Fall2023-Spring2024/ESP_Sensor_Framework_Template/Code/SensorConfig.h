@@ -12,9 +12,16 @@
  * The function prototypes for these implementations should be added to the
  * Prototypes.h file.
  *
- * Timers are started on Core0 (low-rate) and Core1 (high-rate) to initiate
- * continuous polling of the sensors. The associated core also handles the data
- * processing for the respective sensors.
+ * Every sensor is described by one entry of `SampleSensorTable` (at the end of
+ * this file): its fields, polling function, period and logged rate. Starting,
+ * enabling and logging the sensors is driven from that table, and the timer,
+ * batch and bandwidth budgets are checked against it when the program compiles.
+ *
+ * High-rate sensors are polled by esp_timers, whose callbacks run in the
+ * esp_timer task on core 0, or sample from their own task on core 0 (the
+ * ISM330DHCX data-ready task); their readings are queued in `HighRateRing` and
+ * logged by loop() on core 1. Low-rate sensors are polled by `lowRateScheduler`
+ * from loop() and logged directly.
  *
  * @note This file should be updated with the appropriate sensor configurations
  *       and settings for the specific project.
@@ -22,8 +29,8 @@
 
 
 // Sensor Timer Configurations
-// Sum of all sensor runs per second must be less than 20,000
 // https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/system/esp_timer.html#_CPPv423esp_timer_create_args_t
+#define SensorTimerMaxRunsPerSecond 20000  // Sum of all high-rate sensor runs per second must be less than this (checked below)
 
 #define SkipUnhandledInterruptsFast true
 #define SkipUnhandledInterruptsSlow true
@@ -32,34 +39,195 @@
 // High-rate Sensors
 /*****************************************************************************/
 // FastSensorExample
-// bool FastSensorExample_Run = true;
-// esp_timer_handle_t FastSensorExample_Timer;
+// std::atomic<bool> FastSensorExample_Run(true);
 // #define FastSensorExample_RunsPerSecond 100
 // #define FastSensorExample_Pin 4
 // #define FastSensorExample_Name "Fast Sensor Example"
-// const esp_timer_create_args_t FastSensorExample_Config = {.callback = &FastSensorExample_Callback, .name = FastSensorExample_Name, .skip_unhandled_events = SkipUnhandledInterruptsFast};
 
 // ISM330DHCX Accelerometer
 Adafruit_ISM330DHCX ism330dhcx;
-bool ISM330DHCX_Run = true;
-esp_timer_handle_t ISM330DHCX_Timer;
+std::atomic<bool> ISM330DHCX_Run(true);
 #define ISM330DHCX_RunsPerSecond 100
 #define ISM330DHCX_Name "Onboard Gyro/Accelerometer"
-const esp_timer_create_args_t ISM330DHCX_Config = { .callback = &ISM330DHCX_Callback, .name = ISM330DHCX_Name, .skip_unhandled_events = SkipUnhandledInterruptsFast };
+#define ISM330DHCX_DataRate LSM6DS_RATE_833_HZ  // Output data rate of both sensors
+#define ISM330DHCX_DataRateHz 833
+#define ISM330DHCX_FifoMode           // Log every sample at the full data rate, read in bursts from the sensor FIFO (polled ISM330DHCX_RunsPerSecond times a second)
+#define ISM330DHCX_FifoWatermark 64   // FIFO words (7 bytes, about 30 samples at 833 Hz) collected before a burst is read
+#define ISM330DHCX_FifoBurstWords 18  // FIFO words per I2C transaction (must fit in the 128 byte Wire buffer)
+// #define ISM330DHCX_DrdyMode         // Alternative to ISM330DHCX_FifoMode: read every sample from a task woken by the data-ready interrupt
+#define ISM330DHCX_Int1Pin 33         // Accelerometer data-ready (INT1) // Update This! <--------------------------------------------
+#define ISM330DHCX_DrdyTaskPriority 20  // Above every other task, so the sample is read before the next one overwrites it
+#define ISM330DHCX_DrdyTaskCore 0
+#define ISM330DHCX_DrdyTaskStackSize 4096
+#if defined(ISM330DHCX_FifoMode) && defined(ISM330DHCX_DrdyMode)
+#error "Enable only one of ISM330DHCX_FifoMode and ISM330DHCX_DrdyMode"
+#endif
+// Logged rate in ISM330DHCX_FifoMode and ISM330DHCX_DrdyMode: the samples are low-pass filtered below half this rate, then
+// one of every ISM330DHCX_DecimationRatio is logged (the rate is rounded to ISM330DHCX_DataRateHz / ISM330DHCX_DecimationRatio)
+#define ISM330DHCX_LoggedRateHz 104
+#define ISM330DHCX_DecimationRatio ((ISM330DHCX_DataRateHz + ISM330DHCX_LoggedRateHz / 2) / ISM330DHCX_LoggedRateHz)
+#define ISM330DHCX_DecimationTaps (12 * ISM330DHCX_DecimationRatio + 1)  // Filter length, sets the transition band width
+#if (defined(ISM330DHCX_FifoMode) || defined(ISM330DHCX_DrdyMode)) && ISM330DHCX_DecimationRatio > 1
+#define ISM330DHCX_Decimate
+FirDecimator<6, ISM330DHCX_DecimationRatio, ISM330DHCX_DecimationTaps> ism330Decimator;  // Gyro X, Y, Z, accelerometer X, Y, Z
+#define ISM330DHCX_PointsPerSecond ((float)ISM330DHCX_DataRateHz / ISM330DHCX_DecimationRatio)
+#elif defined(ISM330DHCX_FifoMode) || defined(ISM330DHCX_DrdyMode)
+#define ISM330DHCX_PointsPerSecond ((float)ISM330DHCX_DataRateHz)
+#else
+#define ISM330DHCX_PointsPerSecond ((float)ISM330DHCX_RunsPerSecond)
+#endif
+Ism330FifoDecoder ism330Fifo;
+Ism330TickClock ism330Ticks;
+float ISM330DHCX_AccelScale;  // m/s^2 per LSB
+float ISM330DHCX_GyroScale;   // rad/s per LSB
+DrdyTracker ism330Drdy;
+TaskHandle_t Ism330DrdyTaskHandle;
+volatile int64_t Ism330DrdyEdgeUs;  // esp_timer_get_time() at the last data-ready edge
+portMUX_TYPE Ism330DrdyMux = portMUX_INITIALIZER_UNLOCKED;
 
 
 // Low-rate Sensors
 /*****************************************************************************/
+// Polling functions are registered with the scheduler by startLowRateSensors()
+#define LowRateMaxTasks 16  // At least the number of low-rate sensors (checked below)
+TaskScheduler<LowRateMaxTasks> lowRateScheduler;
+
 // SlowSensorExample
-// bool SlowSensorExample_Run = true;
-// unsigned long long SlowSensorExample_Time = 0;
-// #define SlowSensorExample_SecondsPerRun 5
+// std::atomic<bool> SlowSensorExample_Run(true);
+// #define SlowSensorExample_PeriodMs 5000
 // #define SlowSensorExample_Pin 3
 // #define SlowSensorExample_Name "Slow Sensor Example"
 
 // WiFi Strength (RSSI)
-bool RSSI_Run = true;
-unsigned long long RSSI_Time = 0;
-#define RSSI_SecondsPerRun 2
+std::atomic<bool> RSSI_Run(true);
+#define RSSI_PeriodMs 2000
 #define RSSI_Pin 3
-#define RSSI_Name "RSSI"
\ No newline at end of file
+#define RSSI_Name "RSSI"
+
+
+// Logged Sensors and Fields
+/*****************************************************************************/
+// Every sensor has an identifier in SampleSensor and a matching entry (in the same
+// order) in SampleSensorTable. Every value reported by a sensor has an identifier
+// in SampleField and a matching entry in SampleFieldTable; the fields of one sensor
+// must be listed together, in the order the sensor adds them to its SampleFrame.
+// High-rate sensors queue a reading with queueHighRateFrame(frame), low-rate
+// sensors log it with logFrame(frame).
+//
+// Adding a sensor only needs its configuration above, its polling function (and
+// prototype), and its entries here: startHighRateSensors() and
+// startLowRateSensors() start every sensor of the table, and the MQTT start/stop
+// commands set every Run flag.
+enum SampleSensor : uint8_t {
+  // FastSensorExample_Sensor,
+  ISM330DHCX_Sensor,
+  // SlowSensorExample_Sensor,
+  RSSI_Sensor,
+  SampleSensorCount
+};
+
+enum SampleField : uint8_t {
+  // FastSensorExample_Value,
+  ISM330_GYRO_X,
+  ISM330_GYRO_Y,
+  ISM330_GYRO_Z,
+  ISM330_ACCEL_X,
+  ISM330_ACCEL_Y,
+  ISM330_ACCEL_Z,
+  // SlowSensorExample_Value,
+  RSSI_STRENGTH,
+  SampleFieldCount
+};
+
+enum SampleSensorKind : uint8_t {
+  HighRateSensor,  // Polled by an esp_timer (esp_timer task), readings queued in HighRateRing
+  LowRateSensor,   // Polled by lowRateScheduler from loop(), readings logged directly
+};
+
+typedef void (*SensorPollFunction)();
+typedef float (*SensorRateFunction)(float RateHz);
+
+struct SampleSensorInfo {
+  const char* Module;       // Influx measurement / SD module name
+  uint8_t FirstField;       // SampleField of the first value in the sensor's frames
+  uint8_t FieldCount;       // Number of values in the sensor's frames
+  SampleSensorKind Kind;
+  std::atomic<bool>* Run;   // Remote enable flag, checked before every poll (from the polling task, set from loop())
+  SensorPollFunction Poll;  // Called every PeriodUs, nullptr if the sensor starts its own acquisition (see startHighRateSensors())
+  SensorRateFunction SetRate;  // Sets the sensor's own data rate for a logged rate and returns the rate it logs at; nullptr to change PeriodUs instead
+  uint32_t PeriodUs;        // Polling period in microseconds (milliseconds resolution for low-rate sensors)
+  float PointsPerSecond;    // Frames logged per second, for the budget checks below, and the highest rate a rate command may set
+};
+
+struct SampleFieldInfo {
+  const char* Name;    // Influx field / SD sensor name
+  const float* Scale;  // Multiplies raw readings (SampleFrame::addRaw) when they are logged, nullptr if the field is never raw
+};
+
+constexpr SampleSensorInfo SampleSensorTable[] = {
+  // { FastSensorExample_Name, FastSensorExample_Value, 1, HighRateSensor, &FastSensorExample_Run, &FastSensorExample_Callback, nullptr, 1000000 / FastSensorExample_RunsPerSecond, FastSensorExample_RunsPerSecond },
+#if defined(ISM330DHCX_DrdyMode)
+  { ISM330DHCX_Name, ISM330_GYRO_X, 6, HighRateSensor, &ISM330DHCX_Run, nullptr, &setIsm330Rate, 0, ISM330DHCX_PointsPerSecond },  // Sampled by ism330DrdyTask()
+#elif defined(ISM330DHCX_FifoMode)
+  { ISM330DHCX_Name, ISM330_GYRO_X, 6, HighRateSensor, &ISM330DHCX_Run, &ISM330DHCX_Callback, &setIsm330Rate, 1000000 / ISM330DHCX_RunsPerSecond, ISM330DHCX_PointsPerSecond },
+#else
+  { ISM330DHCX_Name, ISM330_GYRO_X, 6, HighRateSensor, &ISM330DHCX_Run, &ISM330DHCX_Callback, nullptr, 1000000 / ISM330DHCX_RunsPerSecond, ISM330DHCX_PointsPerSecond },
+#endif
+  // { SlowSensorExample_Name, SlowSensorExample_Value, 1, LowRateSensor, &SlowSensorExample_Run, &SlowSensorExample_Poll, nullptr, SlowSensorExample_PeriodMs * 1000UL, 1000.0f / SlowSensorExample_PeriodMs },
+  { RSSI_Name, RSSI_STRENGTH, 1, LowRateSensor, &RSSI_Run, &RSSI_Poll, nullptr, RSSI_PeriodMs * 1000UL, 1000.0f / RSSI_PeriodMs },
+};
+
+constexpr SampleFieldInfo SampleFieldTable[] = {
+  // { "Example Fast Value", nullptr },
+  { "Gyro X", &ISM330DHCX_GyroScale },
+  { "Gyro Y", &ISM330DHCX_GyroScale },
+  { "Gyro Z", &ISM330DHCX_GyroScale },
+  { "Accel X", &ISM330DHCX_AccelScale },
+  { "Accel Y", &ISM330DHCX_AccelScale },
+  { "Accel Z", &ISM330DHCX_AccelScale },
+  // { "Example Slow Value", nullptr },
+  { "RSSI", nullptr },
+};
+
+constexpr bool sensorFieldsValid(int sensor = 0) {
+  return sensor >= SampleSensorCount || (SampleSensorTable[sensor].FieldCount <= SampleFrameMaxFields && SampleSensorTable[sensor].FirstField + SampleSensorTable[sensor].FieldCount <= SampleFieldCount && sensorFieldsValid(sensor + 1));
+}
+static_assert(sizeof(SampleSensorTable) / sizeof(SampleSensorTable[0]) == SampleSensorCount, "SampleSensorTable must have one entry per SampleSensor");
+static_assert(sizeof(SampleFieldTable) / sizeof(SampleFieldTable[0]) == SampleFieldCount, "SampleFieldTable must have one entry per SampleField");
+static_assert(sensorFieldsValid(), "Every sensor's fields must exist and fit in a SampleFrame (SampleFrameMaxFields)");
+
+// esp_timer callbacks per second of all timer-polled high-rate sensors
+constexpr uint32_t sensorTimerRunsPerSecond(int sensor = 0) {
+  return sensor >= SampleSensorCount ? 0 : (SampleSensorTable[sensor].Kind == HighRateSensor && SampleSensorTable[sensor].Poll != nullptr ? 1000000 / SampleSensorTable[sensor].PeriodUs : 0) + sensorTimerRunsPerSecond(sensor + 1);
+}
+constexpr bool sensorPollsValid(int sensor = 0) {
+  return sensor >= SampleSensorCount || (SampleSensorTable[sensor].Run != nullptr && (SampleSensorTable[sensor].Poll == nullptr ? SampleSensorTable[sensor].Kind == HighRateSensor && SampleSensorTable[sensor].SetRate != nullptr : SampleSensorTable[sensor].PeriodUs >= (SampleSensorTable[sensor].Kind == LowRateSensor ? 1000 : 50)) && SampleSensorTable[sensor].PointsPerSecond >= SensorMinRateHz && sensorPollsValid(sensor + 1));
+}
+constexpr uint8_t lowRateSensorCount(int sensor = 0) {
+  return sensor >= SampleSensorCount ? 0 : (SampleSensorTable[sensor].Kind == LowRateSensor ? 1 : 0) + lowRateSensorCount(sensor + 1);
+}
+// High-rate sensors polled by an esp_timer (`polled`) or sampling from their own task; each task and the esp_timer task push into HighRateRing
+constexpr uint8_t highRateSensorCount(bool polled, int sensor = 0) {
+  return sensor >= SampleSensorCount ? 0 : (SampleSensorTable[sensor].Kind == HighRateSensor && (SampleSensorTable[sensor].Poll != nullptr) == polled ? 1 : 0) + highRateSensorCount(polled, sensor + 1);
+}
+constexpr float sensorPointsPerSecond(int sensor = 0) {
+  return sensor >= SampleSensorCount ? 0 : SampleSensorTable[sensor].PointsPerSecond + sensorPointsPerSecond(sensor + 1);
+}
+static_assert(sensorPollsValid(), "Every sensor needs a Run flag, a period (at least 50 us high-rate, 1 ms low-rate) and a rate of at least SensorMinRateHz; only high-rate sensors with a SetRate function may have no poll function");
+static_assert(sensorTimerRunsPerSecond() < SensorTimerMaxRunsPerSecond, "The high-rate sensor timers run too often for the esp_timer task (SensorTimerMaxRunsPerSecond)");
+static_assert((highRateSensorCount(true) > 0 ? 1 : 0) + highRateSensorCount(false) <= 1, "HighRateRing has a single producer: with a data-ready sensor task (e.g. ISM330DHCX_DrdyMode) no other high-rate sensor may be polled");
+static_assert(lowRateSensorCount() <= LowRateMaxTasks, "The low-rate scheduler has too few tasks (LowRateMaxTasks)");
+#ifdef InfluxLogging
+static_assert(sensorPointsPerSecond() * InfluxTargetFlushMs / 1000 <= BATCH_SIZE, "The sensors log more points during one Influx write (InfluxTargetFlushMs) than a batch holds (BATCH_SIZE)");
+static_assert(sensorPointsPerSecond() * InfluxBytesPerPoint <= InfluxMaxBytesPerSecond, "The sensors log more line protocol per second than the uplink budget (InfluxMaxBytesPerSecond)");
+#endif
+
+esp_timer_handle_t SensorTimers[SampleSensorCount];  // esp_timer of every timer-polled high-rate sensor
+SensorControlState SensorControls[SampleSensorCount];  // Running state and rate set by the MQTT commands
+std::atomic<bool> SensorPolling[SampleSensorCount];    // Whether each high-rate sensor is being polled (esp_timer task or its own task)
+#ifdef SensorTimingHistograms
+SensorTiming SensorTimings[SampleSensorCount];  // Poll timing of every high-rate sensor, reported by publishSensorTimings()
+#endif
+#if defined(SDLogging) && defined(SDBinaryLogging)
+SdLogEncoder<SampleSensorCount> sdLogEncoder;  // Sensor definitions and last timestamps of the binary SD log
+#endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+/**
+ * @file SensorTiming.h
+ * @brief Log-scale histograms of high-rate sensor poll timing.
+ *
+ * This file contains the instrumentation that shows whether a high-rate sensor is
+ * actually polled at its configured rate. For every poll, `SensorTiming` records:
+ *
+ * - Jitter: how far the time since the previous poll was from the period, in
+ *   microseconds (a poll that comes late and the next one that comes early both
+ *   count).
+ * - Execution time of the poll function, in microseconds.
+ * - Latency from the event that triggered the poll to its start, in microseconds,
+ *   for sensors that know the event time (the ISM330DHCX data-ready edge).
+ * - Skipped ticks: whole periods without a poll, e.g. timer events dropped by
+ *   `skip_unhandled_events` because the previous poll ran too long.
+ *
+ * The histograms have fixed power-of-two buckets (`Log2Histogram`): bucket 0 counts
+ * 0 us, bucket `b` counts `2^(b-1)` to `2^b - 1` us, and the last bucket everything
+ * above. Adding a value is a count-leading-zeros and an increment, so recording a
+ * poll costs two timer reads and a few instructions.
+ *
+ * Only the polling context writes a `SensorTiming`; loop() reads the counters to
+ * report them, which may be a poll behind.
+ */
+
+#ifndef SensorTimingCode
+#define SensorTimingCode
+
+#include <stdint.h>
+
+template<uint8_t Buckets>
+class Log2Histogram {
+public:
+  void add(uint32_t value) {
+    uint8_t bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+    Counts[bucket < Buckets ? bucket : Buckets - 1]++;
+  }
+
+  void reset() {
+    for (uint8_t bucket = 0; bucket < Buckets; bucket++)
+      Counts[bucket] = 0;
+  }
+
+  uint32_t count(uint8_t bucket) const {
+    return Counts[bucket];
+  }
+
+  // Number of buckets up to the last non-empty one, for compact reports
+  uint8_t used() const {
+    uint8_t used = Buckets;
+    while (used > 0 && Counts[used - 1] == 0)
+      used--;
+    return used;
+  }
+
+  // Smallest value counted in a bucket
+  static uint32_t lowerBound(uint8_t bucket) {
+    return bucket == 0 ? 0 : 1UL << (bucket - 1);
+  }
+
+private:
+  volatile uint32_t Counts[Buckets] = {};
+};
+
+class SensorTiming {
+public:
+  static const uint8_t Buckets = 20;  // The last bucket holds 2^18 us (262 ms) and up
+
+  /**
+   * @brief Sets the expected poll period; the next poll starts a new interval.
+   *
+   * The histograms and counters are kept, so they cover every period the sensor
+   * ran at.
+   *
+   * @param periodUs The poll period, in microseconds.
+   *
+   * @return void
+   */
+  void begin(uint32_t periodUs) {
+    PeriodUs = periodUs > 0 ? periodUs : 1;
+    HavePoll = false;
+  }
+
+  /**
+   * @brief Records the start of a poll.
+   *
+   * @param startUs Monotonic time the poll started, in microseconds.
+   *
+   * @return void
+   */
+  void onStart(int64_t startUs) {
+    if (HavePoll) {
+      int64_t interval = startUs - LastStartUs;
+      int64_t deviation = interval > (int64_t)PeriodUs ? interval - PeriodUs : PeriodUs - interval;
+      Jitter.add(deviation > UINT32_MAX ? UINT32_MAX : (uint32_t)deviation);
+      int64_t periods = (interval + PeriodUs / 2) / PeriodUs;
+      if (periods > 1)
+        Skipped += (uint32_t)(periods - 1);
+    }
+    LastStartUs = startUs;
+    HavePoll = true;
+    Polls++;
+  }
+
+  // Records the end of the poll started last, `endUs` on the same clock as `onStart()`
+  void onEnd(int64_t endUs) {
+    Execution.add((uint32_t)(endUs - LastStartUs));
+  }
+
+  // Records the delay from the triggering event to the start of the poll, in microseconds
+  void onLatency(int64_t latencyUs) {
+    Latency.add(latencyUs < 0 ? 0 : latencyUs > UINT32_MAX ? UINT32_MAX : (uint32_t)latencyUs);
+  }
+
+  uint32_t polls() const {
+    return Polls;
+  }
+  uint32_t skipped() const {
+    return Skipped;
+  }
+  uint32_t periodUs() const {
+    return PeriodUs;
+  }
+
+  Log2Histogram<Buckets> Jitter;
+  Log2Histogram<Buckets> Execution;
+  Log2Histogram<Buckets> Latency;
+
+private:
+  uint32_t PeriodUs = 1;
+  int64_t LastStartUs = 0;
+  bool HavePoll = false;
+  volatile uint32_t Polls = 0;
+  volatile uint32_t Skipped = 0;
+};
+
+#endif  // SensorTimingCode
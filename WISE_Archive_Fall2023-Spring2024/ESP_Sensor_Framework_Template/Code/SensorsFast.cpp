@@ -16,22 +16,174 @@
 #ifndef SensorsFastCode
 #define SensorsFastCode
 
-// Sensor Timer Start
+/**
+ * @brief Starts polling every high-rate sensor of `SampleSensorTable`.
+ *
+ * Every high-rate sensor with a poll function gets an esp_timer
+ * (`SensorTimers`) that calls `highRateTimerCallback()` every `PeriodUs`
+ * microseconds. Sensors without a poll function start their own acquisition
+ * here (the ISM330DHCX data-ready task and interrupt in `ISM330DHCX_DrdyMode`).
+ *
+ * The sensors start at their configured rate (`PointsPerSecond`), which is also
+ * the highest rate the MQTT rate command may set (`SensorControls`).
+ *
+ * @return void
+ */
 void startHighRateSensors() {
   // ESP Timer Configurations
   // https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/system/esp_timer.html
-
-  // FastSensorExample
-  // esp_timer_create(&FastSensorExample_Config, &FastSensorExample_Timer);
-  // esp_timer_start_periodic(FastSensorExample_Timer, (1000000 / FastSensorExample_RunsPerSecond));
+  for (uint8_t sensor = 0; sensor < SampleSensorCount; sensor++) {
+    const SampleSensorInfo& info = SampleSensorTable[sensor];
+    if (info.Kind != HighRateSensor)
+      continue;
+    SensorControls[sensor].begin(info.PointsPerSecond, SensorMinRateHz, info.PointsPerSecond);
+    if (info.Poll == nullptr)
+      continue;
+    esp_timer_create_args_t config = { .callback = &highRateTimerCallback, .arg = (void*)(uintptr_t)sensor, .name = info.Module, .skip_unhandled_events = SkipUnhandledInterruptsFast };
+    esp_timer_create(&config, &SensorTimers[sensor]);
+  }
 
   // ISM330DHCX
-  esp_timer_create(&ISM330DHCX_Config, &ISM330DHCX_Timer);
-  esp_timer_start_periodic(ISM330DHCX_Timer, (1000000 / ISM330DHCX_RunsPerSecond));
+#ifdef ISM330DHCX_DrdyMode
+  if (xTaskCreatePinnedToCore(ism330DrdyTask, "ISM330DHCX DRDY", ISM330DHCX_DrdyTaskStackSize, nullptr, ISM330DHCX_DrdyTaskPriority, &Ism330DrdyTaskHandle, ISM330DHCX_DrdyTaskCore) != pdPASS) {
+#ifdef SerialDebugMode
+    Serial.println("Failed to start the ISM330DHCX sampling task");
+#endif
+    while (1) {
+      delay(10);
+    }
+  }
+  pinMode(ISM330DHCX_Int1Pin, INPUT);
+#endif
+
+  for (uint8_t sensor = 0; sensor < SampleSensorCount; sensor++)
+    if (SampleSensorTable[sensor].Kind == HighRateSensor)
+      resumeHighRateSensor(sensor);
 }
 
+// Stops every high-rate sensor (see stopHighRateSensor())
 void stopHighRateSensors() {
-  // Todo
+  for (uint8_t sensor = 0; sensor < SampleSensorCount; sensor++)
+    if (SampleSensorTable[sensor].Kind == HighRateSensor)
+      applySensorCommand(sensor, SensorCommandStop, 0);
+}
+
+// Restarts the acquisition of a high-rate sensor that is already configured for its rate
+void resumeHighRateSensor(uint8_t Sensor) {
+  const SampleSensorInfo& info = SampleSensorTable[Sensor];
+  info.Run->store(true);
+  uint32_t periodUs = info.SetRate != nullptr ? info.PeriodUs : (uint32_t)(1000000 / SensorControls[Sensor].rateHz());
+  if (info.Poll != nullptr)
+    esp_timer_start_periodic(SensorTimers[Sensor], periodUs);
+#ifdef ISM330DHCX_DrdyMode
+  if (Sensor == ISM330DHCX_Sensor) {
+    periodUs = ism330Drdy.periodNs() / 1000;
+    attachInterrupt(digitalPinToInterrupt(ISM330DHCX_Int1Pin), ISM330DHCX_DrdyISR, RISING);
+  }
+#endif
+#ifdef SensorTimingHistograms
+  SensorTimings[Sensor].begin(periodUs);
+#endif
+}
+
+/**
+ * @brief Starts a stopped high-rate sensor at the rate in `SensorControls`.
+ *
+ * Sensors with a `SetRate` function are configured for the rate first (for the
+ * ISM330DHCX: its data rate registers, which also empties its FIFO and resets the
+ * decoder, data-ready tracker and decimation filter), and the rate they actually
+ * run at is recorded. Other sensors are polled at the rate by their timer.
+ *
+ * Only called from loop() (the MQTT handlers), while the sensor is stopped.
+ *
+ * @param Sensor The `SampleSensor` identifier.
+ *
+ * @return void
+ */
+void startHighRateSensor(uint8_t Sensor) {
+  const SampleSensorInfo& info = SampleSensorTable[Sensor];
+  if (info.SetRate != nullptr)
+    SensorControls[Sensor].applied(info.SetRate(SensorControls[Sensor].rateHz()));
+  resumeHighRateSensor(Sensor);
+}
+
+/**
+ * @brief Stops a high-rate sensor and logs the samples it already queued.
+ *
+ * The timer is stopped (or the data-ready interrupt detached), and the function
+ * waits until a poll that was already running has finished, so the sensor can be
+ * reconfigured from loop() afterwards. Then the frames left in `HighRateRing` are
+ * logged (`drainHighRateSensors()`). Readings still in the sensor FIFO are
+ * discarded when the sensor is started again.
+ *
+ * Only called from loop() (the MQTT handlers).
+ *
+ * @param Sensor The `SampleSensor` identifier.
+ *
+ * @return void
+ */
+void stopHighRateSensor(uint8_t Sensor) {
+  const SampleSensorInfo& info = SampleSensorTable[Sensor];
+  info.Run->store(false);  // Sequentially consistent with the SensorPolling load below
+  if (info.Poll != nullptr)
+    esp_timer_stop(SensorTimers[Sensor]);
+#ifdef ISM330DHCX_DrdyMode
+  if (Sensor == ISM330DHCX_Sensor)
+    detachInterrupt(digitalPinToInterrupt(ISM330DHCX_Int1Pin));
+#endif
+  while (SensorPolling[Sensor].load())
+    delay(1);
+  drainHighRateSensors();
+}
+
+/**
+ * @brief Queues a high-rate sensor reading for logging.
+ *
+ * This function is called by the high-rate sensor callbacks with a complete
+ * `SampleFrame`. It pushes the frame into `HighRateRing`, from where loop() logs
+ * it, and counts the reading in `pipelineStats` (produced, and enqueued unless the
+ * ring was full).
+ *
+ * @param Frame The sample frame to be queued.
+ *
+ * @return void
+ */
+void queueHighRateFrame(const SampleFrame& Frame) {
+  pipelineStats.SamplesProduced.fetch_add(1, std::memory_order_relaxed);
+  if (HighRateRing.push(Frame))
+    pipelineStats.SamplesEnqueued.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief esp_timer callback shared by all timer-polled high-rate sensors.
+ *
+ * Calls the poll function of the sensor, unless its Run flag was cleared
+ * remotely. The sensor's `SensorPolling` flag is set first, so
+ * `stopHighRateSensor()` either sees the poll running and waits for it, or the
+ * poll sees the cleared Run flag (both flags are atomic and accessed sequentially
+ * consistent, so neither side's store can be ordered after its load). Each sensor has its own flag, so a poll of
+ * another sensor (or the data-ready task) can not clear it in between.
+ *
+ * If `SensorTimingHistograms` is defined, the start and end of every poll are
+ * recorded in the sensor's `SensorTimings` entry.
+ *
+ * @param args The sensor's `SampleSensor` identifier.
+ *
+ * @return void
+ */
+void highRateTimerCallback(void* args) {
+  const SampleSensorInfo& sensor = SampleSensorTable[(uintptr_t)args];
+  SensorPolling[(uintptr_t)args].store(true);
+#ifdef SensorTimingHistograms
+  SensorTiming& timing = SensorTimings[(uintptr_t)args];
+  timing.onStart(esp_timer_get_time());
+#endif
+  if (sensor.Run->load())  // Remote disable last-ditch check
+    sensor.Poll();
+#ifdef SensorTimingHistograms
+  timing.onEnd(esp_timer_get_time());
+#endif
+  SensorPolling[(uintptr_t)args].store(false);
 }
 
 /**
@@ -42,21 +194,18 @@ void stopHighRateSensors() {
  * how to read data from a fast sensor (e.g., a digital input pin) and log it
  * to the appropriate data storage.
  *
- * The function performs the following tasks:
+ * The function is called by `highRateTimerCallback()` while the
+ * `FastSensorExample_Run` flag is set, and performs the following tasks:
  *
- * 1. Checks if the `FastSensorExample_Run` flag is set. If not, it returns
- *    without performing any further actions.
- * 2. Retrieves the current timestamp in microseconds and seconds using the
- *    `getuSeconds()` and `getSeconds()` functions, respectively.
- * 3. Reads the sensor data by calling `digitalRead(FastSensorExample_Pin)`,
+ * 1. Starts a `SampleFrame` for `FastSensorExample_Sensor` with the current
+ *    timestamp from the `getTimestampUs()` function.
+ * 2. Reads the sensor data by calling `digitalRead(FastSensorExample_Pin)`,
  *    which reads the state of the digital input pin specified by
- *    `FastSensorExample_Pin`.
- * 4. Logs the sensor data to the appropriate data storage using the
- *    `logDataPoint()` function, passing the timestamp, sensor name
- *    (`FastSensorExample_Name`), data value, and a flag indicating that this
- *    is the final data point for this measurement.
+ *    `FastSensorExample_Pin`, and adds it to the frame.
+ * 3. Queues the frame with `queueHighRateFrame()`, from where loop() logs it to
+ *    the appropriate data storage using the `logFrame()` function.
  *
- * The `logDataPoint()` function is assumed to handle the data storage and
+ * The `logFrame()` function is assumed to handle the data storage and
  * formatting according to the desired output (e.g., SD card file or Influx
  * database).
  *
@@ -64,56 +213,250 @@ void stopHighRateSensors() {
  * similar callback functions for other fast sensors or data sources.
  *
  * @note This function is only a generic template and is commented out.
- *
- * @param args A pointer to additional arguments that may be passed to the
- *             callback function. In this case, it is not used.
  */
-// FastSensorExample_Timer 'ISR' Callback Function
-// static void FastSensorExample_Callback(void* args)
+// FastSensorExample Timer 'ISR' Callback Function
+// void FastSensorExample_Callback()
 // {
-//   if(!FastSensorExample_Run) // Remote disable last-ditch check
-//     return;
-
-// unsigned long long timestampuS = getuSeconds();
-// unsigned long long timestampS = getSeconds();
-
+//   SampleFrame frame;
+//   frame.begin(FastSensorExample_Sensor, getTimestampUs());
 
 //   // Poll & Process Sensor Data
-//   int data = digitalRead(FastSensorExample_Pin)
+//   frame.add(digitalRead(FastSensorExample_Pin));
 
-// logDataPoint(timestampuS, timestampS, FastSensorExample_Name, "Example Fast Value", data, true);
+//   queueHighRateFrame(frame);
 // } // End FastSensorExample_Callback
 
 
 /**
- * @brief Callback function for ISM330DHCX_Timer ISR.
+ * @brief Callback function for the ISM330DHCX timer ISR.
  * 
- * This function polls sensor data from ISM330DHCX sensor, retrieves timestamps, and logs the data points.
+ * If `ISM330DHCX_FifoMode` is defined, this function drains the sensor FIFO
+ * (`drainIsm330Fifo()`), which queues every sample at the full output data rate.
+ * 
+ * Otherwise it reads the raw gyro and accelerometer registers of the ISM330DHCX in
+ * one burst (`readIsm330Raw()`), and queues one `SampleFrame` with the timestamp
+ * and all six raw values in `HighRateRing`; they are scaled when logged. All esp_timer
+ * callbacks run in the same esp_timer task, so every high-rate sensor can share
+ * the ring as a single producer. It never touches the Influx client
+ * or the SD card, so it can not be blocked by the network or a slow card; the
+ * samples are logged later by `drainHighRateSensors()` from loop().
+ * 
+ * If the ring is full the frame is dropped and counted by the ring.
  * 
- * @param args Pointer to arguments passed to the callback function.
  * @return void
  */
-static void ISM330DHCX_Callback(void* args) {
-  if (!ISM330DHCX_Run)  // Remote disable last-ditch check
-    return;
-
-  unsigned long long timestampuS = getuSeconds();
-  unsigned long long timestampS = getSeconds();
+void ISM330DHCX_Callback() {
+#ifdef ISM330DHCX_FifoMode
+  drainIsm330Fifo();
+#else
+  uint64_t timestamp = getTimestampUs();
 
   // Poll Sensor Data
-  sensors_event_t accel;
-  sensors_event_t gyro;
-  sensors_event_t temp;
-
-  ism330dhcx.getEvent(&accel, &gyro, &temp);
-
-  logDataPoint(timestampuS, timestampS, ISM330DHCX_Name, "Gyro X", gyro.gyro.x);
-  logDataPoint(timestampuS, timestampS, ISM330DHCX_Name, "Gyro Y", gyro.gyro.y);
-  logDataPoint(timestampuS, timestampS, ISM330DHCX_Name, "Gyro Z", gyro.gyro.z);
-  logDataPoint(timestampuS, timestampS, ISM330DHCX_Name, "Accel X", accel.acceleration.x);
-  logDataPoint(timestampuS, timestampS, ISM330DHCX_Name, "Accel Y", accel.acceleration.y);
-  logDataPoint(timestampuS, timestampS, ISM330DHCX_Name, "Accel Z", accel.acceleration.z, true);
+  Ism330RawSample sample;
+  if (!readIsm330Raw(sample))
+    return;
+
+  queueIsm330Sample(timestamp, sample);
+#endif
 }  // End ISM330DHCX_Callback
 
 
+/**
+ * @brief Reads all samples from the ISM330DHCX FIFO in bursts.
+ *
+ * Called from `ISM330DHCX_Callback`. The FIFO status is read first; until the FIFO
+ * holds `ISM330DHCX_FifoWatermark` words nothing else is read, so most polls cost a
+ * single short transaction. Then the sensor timestamp counter is read together with
+ * `esp_timer_get_time()` to anchor the sensor clock, and the FIFO is read in
+ * bursts of `ISM330DHCX_FifoBurstWords` words. Every complete sample is passed to
+ * `queueIsm330Sample()` with its own timestamp, reconstructed from the sensor
+ * timestamp counter and the data rate.
+ *
+ * A FIFO overflow is counted in `pipelineStats.SensorOverruns` and the decoder (and
+ * the decimation filter) is reset, as the slot sequence is broken.
+ *
+ * @return void
+ */
+void drainIsm330Fifo() {
+  uint8_t status[2];
+  if (!ism330ReadRegisters(ISM330_FIFO_STATUS1, status, sizeof(status)))
+    return;
+  uint16_t words = status[0] | (status[1] & 0x03) << 8;
+  if (!(status[1] & (Ism330StatusWatermark | Ism330StatusOverrun)))
+    return;
+  if (status[1] & Ism330StatusOverrun) {
+    pipelineStats.SensorOverruns.fetch_add(1, std::memory_order_relaxed);
+    ism330Fifo.reset();
+#ifdef ISM330DHCX_Decimate
+    ism330Decimator.reset();
+#endif
+  }
+
+  // Anchor the sensor timestamp counter to the monotonic timer
+  uint8_t ticks[4];
+  int64_t before = esp_timer_get_time();
+  if (!ism330ReadRegisters(ISM330_TIMESTAMP0, ticks, sizeof(ticks)))
+    return;
+  int64_t after = esp_timer_get_time();
+  ism330Ticks.anchor((uint32_t)ticks[0] | (uint32_t)ticks[1] << 8 | (uint32_t)ticks[2] << 16 | (uint32_t)ticks[3] << 24,
+                     before + (after - before) / 2);
+
+  uint8_t burst[ISM330DHCX_FifoBurstWords * Ism330FifoWordSize];
+  while (words > 0) {
+    uint16_t count = words < ISM330DHCX_FifoBurstWords ? words : ISM330DHCX_FifoBurstWords;
+    if (!ism330ReadRegisters(ISM330_FIFO_DATA_OUT_TAG, burst, count * Ism330FifoWordSize))
+      return;
+    words -= count;
+
+    ism330Fifo.decode(burst, count, [](const Ism330FifoSample& sample) {
+      queueIsm330Sample(getTimestampUsAt(ism330Ticks.monotonicAt(sample.Ticks)), sample);
+    });
+  }
+}
+
+
+/**
+ * @brief Interrupt Service Routine (ISR) for the ISM330DHCX data-ready signal.
+ *
+ * Records the time of the edge, which is the time the sensor took the sample, and
+ * wakes the sampling task (`ism330DrdyTask()`). Edges that arrive before the task
+ * ran are counted by the task notification.
+ *
+ * @return void
+ */
+void ARDUINO_ISR_ATTR ISM330DHCX_DrdyISR() {
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL_ISR(&Ism330DrdyMux);
+  Ism330DrdyEdgeUs = now;
+  portEXIT_CRITICAL_ISR(&Ism330DrdyMux);
+
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(Ism330DrdyTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * @brief Data-ready driven sampling task for the ISM330DHCX.
+ *
+ * Used instead of the ISM330DHCX timer when `ISM330DHCX_DrdyMode` is defined, so
+ * sampling follows the sensor's own clock instead of drifting against it. The task
+ * runs at `ISM330DHCX_DrdyTaskPriority` on `ISM330DHCX_DrdyTaskCore` and sleeps
+ * until `ISM330DHCX_DrdyISR()` wakes it, then:
+ *
+ * 1. Reads the status register; if it shows no new accelerometer data the wake-up
+ *    is counted as a duplicate and nothing else is read.
+ * 2. Reads all six axes in one burst as raw values (`readIsm330Raw()`).
+ * 3. Lets the tracker (`ism330Drdy`) count the samples missed since the previous
+ *    one from the edge times.
+ * 4. Queues the sample timestamped at the data-ready edge (`queueIsm330Sample()`).
+ *
+ * In this mode the task is the producer of `HighRateRing`, so no other high-rate
+ * sensor may use the esp_timer callbacks at the same time (checked in
+ * SensorConfig.h).
+ *
+ * @param Parameters Unused.
+ *
+ * @return void
+ */
+void ism330DrdyTask(void* Parameters) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    SensorPolling[ISM330DHCX_Sensor].store(true);  // See highRateTimerCallback()
+    portENTER_CRITICAL(&Ism330DrdyMux);
+    int64_t edgeUs = Ism330DrdyEdgeUs;
+    portEXIT_CRITICAL(&Ism330DrdyMux);
+#ifdef SensorTimingHistograms
+    SensorTiming& timing = SensorTimings[ISM330DHCX_Sensor];
+    int64_t startUs = esp_timer_get_time();
+    timing.onStart(startUs);
+    timing.onLatency(startUs - edgeUs);  // Interrupt and task wake-up delay
+#endif
+    if (ISM330DHCX_Run.load())  // Remote disable last-ditch check
+      readIsm330Drdy(edgeUs);
+#ifdef SensorTimingHistograms
+    timing.onEnd(esp_timer_get_time());
+#endif
+    SensorPolling[ISM330DHCX_Sensor].store(false);
+  }
+}
+
+// Reads and queues the sample of one data-ready wake-up, timestamped at the edge `EdgeUs` (see ism330DrdyTask())
+void readIsm330Drdy(int64_t EdgeUs) {
+  uint8_t status = 0;
+  if (!ism330ReadRegisters(ISM330_STATUS_REG, &status, 1))
+    return;
+  bool fresh = status & Ism330StatusAccelReady;
+  Ism330RawSample sample;
+  if (fresh && !readIsm330Raw(sample))
+    return;
+  if (!ism330Drdy.onRead(EdgeUs, fresh))
+    return;
+
+  queueIsm330Sample(getTimestampUsAt(EdgeUs), sample);
+}
+
+
+/**
+ * @brief Queues one ISM330DHCX sample as a raw `SampleFrame` in `HighRateRing`.
+ *
+ * Called by every ISM330DHCX acquisition mode, in the producer context. If
+ * `ISM330DHCX_Decimate` is defined (FIFO or data-ready mode at a logged rate below
+ * the data rate), the sample first passes through the anti-alias filter
+ * (`ism330Decimator`), and a frame is only queued for every
+ * `ISM330DHCX_DecimationRatio`th sample, timestamped at the centre of the filter
+ * window. Filtering stays on the raw int16 values; they are scaled when logged.
+ *
+ * @param Timestamp Timestamp of the sample, in microseconds since the epoch.
+ * @param Sample The raw readings of all six axes.
+ *
+ * @return void
+ */
+void queueIsm330Sample(uint64_t Timestamp, const Ism330RawSample& Sample) {
+  int16_t axes[6];  // Gyro X, Y, Z, accelerometer X, Y, Z
+  for (uint8_t axis = 0; axis < 3; axis++) {
+    axes[axis] = Sample.Gyro[axis];
+    axes[axis + 3] = Sample.Accel[axis];
+  }
+#ifdef ISM330DHCX_Decimate
+  if (!ism330Decimator.push(Timestamp, axes, Timestamp, axes))  // Filtered in place
+    return;
+#endif
+
+  SampleFrame frame;
+  frame.begin(ISM330DHCX_Sensor, Timestamp);
+  for (uint8_t axis = 0; axis < 6; axis++)
+    frame.addRaw(axes[axis]);
+  queueHighRateFrame(frame);
+}
+
+
+/**
+ * @brief Logs all samples queued by the high-rate sensor callbacks.
+ *
+ * This function is the single consumer of `HighRateRing` and must only be called
+ * from loop() (or code running from loop(), such as the MQTT handlers). Every
+ * queued frame is passed to `logFrame()`, which forwards it to the enabled data
+ * logging destinations.
+ *
+ * If `SerialDebugMode` and `HighRateDetailDebugging` are defined, newly dropped
+ * frames (ring overflow) are reported on the serial monitor.
+ *
+ * @return void
+ */
+void drainHighRateSensors() {
+  SampleFrame frame;
+  while (HighRateRing.pop(frame))
+    logFrame(frame);
+
+#if defined(SerialDebugMode) && defined(HighRateDetailDebugging)
+  static uint32_t reportedDrops = 0;
+  if (HighRateRing.dropped() != reportedDrops) {
+    reportedDrops = HighRateRing.dropped();
+    Serial.print("High-rate frames dropped (ring full): ");
+    Serial.println(reportedDrops);
+  }
+#endif
+}
+
+
 #endif  // SensorsFastCode
\ No newline at end of file
@@ -9,8 +9,9 @@
  * changing data sources.
  *
  * The functions defined in this file are not using ESP timers to keep Core 1
- * free for high-rate tasks. Instead, they are called periodically by a
- * software timer.
+ * free for high-rate tasks. Instead, they are registered with a software
+ * scheduler (`lowRateScheduler`, see TaskScheduler.h) that calls them from
+ * loop() with millisecond periods.
  */
 
 #include "esp_timer.h"
@@ -18,24 +19,45 @@
 #ifndef SensorsSlowCode
 #define SensorsSlowCode
 
-// Start Virtual/Software Timers for Sensors
+// Start Virtual/Software Timers for Sensors: every low-rate sensor of SampleSensorTable
 void startLowRateSensors() {
-  // SlowSensorExample_Time = getSeconds() + SlowSensorExample_SecondsPerRun;
-  RSSI_Time = getSeconds() + RSSI_SecondsPerRun;
+  int64_t now = esp_timer_get_time() / 1000;
+  lowRateScheduler.clear();
+  for (uint8_t sensor = 0; sensor < SampleSensorCount; sensor++) {
+    const SampleSensorInfo& info = SampleSensorTable[sensor];
+    if (info.Kind != LowRateSensor)
+      continue;
+    SensorControls[sensor].begin(info.PointsPerSecond, SensorMinRateHz, info.PointsPerSecond);
+    lowRateScheduler.add(info.Module, info.Poll, info.PeriodUs / 1000, info.Run, now);
+  }
 }
 
+// Stops every low-rate sensor
 void stopLowRateSensors() {
-  // Todo
+  for (uint8_t sensor = 0; sensor < SampleSensorCount; sensor++)
+    if (SampleSensorTable[sensor].Kind == LowRateSensor)
+      applySensorCommand(sensor, SensorCommandStop, 0);
 }
 
-// Check Virtual/Software Timers for Sensors
-void checkLowRateSensors() {  // Low Rate Software Timer Checking
+// Restarts a low-rate sensor at its rate in SensorControls, one period from now
+void startLowRateSensor(uint8_t Sensor) {
+  setLowRateSensorRate(Sensor);
+  SampleSensorTable[Sensor].Run->store(true);
+}
 
-  // if (SlowSensorExample_Time >= getSeconds())
-  //   SlowSensorExample_Poll();
+// The scheduler keeps a stopped sensor's schedule but does not call it
+void stopLowRateSensor(uint8_t Sensor) {
+  SampleSensorTable[Sensor].Run->store(false);
+}
+
+// Moves a low-rate sensor to its rate in SensorControls
+void setLowRateSensorRate(uint8_t Sensor) {
+  lowRateScheduler.setPeriod(SampleSensorTable[Sensor].Module, (uint32_t)(1000 / SensorControls[Sensor].rateHz() + 0.5f), esp_timer_get_time() / 1000);
+}
 
-  if (RSSI_Time <= getSeconds() && RSSI_Run)
-    RSSI_Poll();
+// Check Virtual/Software Timers for Sensors
+void checkLowRateSensors() {  // Low Rate Software Timer Checking
+  lowRateScheduler.run(esp_timer_get_time() / 1000);
 }
 
 /**
@@ -47,22 +69,18 @@ void checkLowRateSensors() {  // Low Rate Software Timer Checking
  *
  * The function performs the following tasks:
  *
- * 1. Retrieves the current timestamp in microseconds and seconds using the
- *    `getuSeconds()` and `getSeconds()` functions, respectively.
+ * 1. Starts a `SampleFrame` for `SlowSensorExample_Sensor` with the current
+ *    timestamp from the `getTimestampUs()` function.
  * 2. Reads the sensor data by calling `digitalRead(SlowSensorExample_Pin)`,
  *    which reads the state of the digital input pin specified by
- *    `SlowSensorExample_Pin`.
- * 3. Logs the sensor data to the appropriate data storage using the
- *    `logDataPoint()` function, passing the timestamp, sensor name
- *    (`SlowSensorExample_Name`), data value, and a flag indicating that this
- *    is the final data point for this measurement.
- * 4. Increments the `slowPointCount` variable, which likely tracks the number
- *    of data points logged for the slow sensor.
- * 5. Updates the `SlowSensorExample_Time` variable with the next time the
- *    sensor should be polled, based on the `SlowSensorExample_SecondsPerRun`
- *    constant, which specifies the interval between sensor readings.
+ *    `SlowSensorExample_Pin`, and adds it to the frame.
+ * 3. Logs the frame to the appropriate data storage using the `logFrame()`
+ *    function.
+ *
+ * The function is called every `SlowSensorExample_PeriodMs` milliseconds by
+ * `lowRateScheduler` once its entry in `SampleSensorTable` is uncommented.
  *
- * The `logDataPoint()` function is assumed to handle the data storage and
+ * The `logFrame()` function is assumed to handle the data storage and
  * formatting according to the desired output (e.g., SD card file or Influx
  * database).
  *
@@ -73,30 +91,30 @@ void checkLowRateSensors() {  // Low Rate Software Timer Checking
  */
 // void SlowSensorExample_Poll()
 // {
-//   unsigned long long timestampS = getSeconds();
-//   unsigned long long timestampuS = getuSeconds();
+//   SampleFrame frame;
+//   frame.begin(SlowSensorExample_Sensor, getTimestampUs());
 
 //   // Poll and Process Sensor Data
-//   int data = digitalRead(SlowSensorExample_Pin)
+//   frame.add(digitalRead(SlowSensorExample_Pin));
 
-//   logDataPoint(timestampuS, timestampS, SlowSensorExample_Name, "Example Slow Value", data, true);
-
-//   slowPointCount++;
-//   SlowSensorExample_Time = getSeconds() + SlowSensorExample_SecondsPerRun;
+//   logFrame(frame);
 // }
 
 // Wifi Strength Polling Function
 void RSSI_Poll() {
-  unsigned long long timestampS = getSeconds();
-  unsigned long long timestampuS = getuSeconds();
+  SampleFrame frame;
+  frame.begin(RSSI_Sensor, getTimestampUs());
 
   // Report RSSI of currently connected network
-  int RSSI = WiFi.RSSI();
-
-  logDataPoint(timestampuS, timestampS, RSSI_Name, "RSSI", RSSI, true);
+  int rssi = WiFi.RSSI();
+  frame.add(rssi);
+#ifdef InfluxLogging
+  if (WiFi.status() == WL_CONNECTED)
+    influxBatchControl.onRssi(rssi);  // Weak signal caps the Influx batch size
+#endif
 
-  slowPointCount++;
-  RSSI_Time = getSeconds() + RSSI_SecondsPerRun;
+  pipelineStats.SamplesProduced.fetch_add(1, std::memory_order_relaxed);
+  logFrame(frame);
 
 #ifdef SerialDebugMode
   Serial.println("RSSI Poll");
@@ -0,0 +1,246 @@
+/**
+ * @file SpillQueue.h
+ * @brief Append-only queue of Influx write bodies on flash, for server outages.
+ *
+ * This file contains the queue that keeps batches the server did not accept, so
+ * they can be sent again once writes succeed. Every batch is stored as one segment
+ * file, exactly as it would have been sent:
+ *
+ *   <directory>/<sequence number>.gz   gzip compressed line protocol
+ *   <directory>/<sequence number>.lp   plain line protocol
+ *
+ * Sequence numbers increase with every stored batch, and batches are filled in
+ * time order, so replaying the oldest sequence number first replays the data in
+ * timestamp order. A segment is written under a temporary name and renamed once
+ * complete, so a power loss during a write never leaves a partial batch to replay.
+ * The queue is rebuilt from the directory on boot.
+ *
+ * When the queue would grow past its byte limit, the oldest segments are dropped
+ * to make room, so the most recent data is kept.
+ *
+ * The queue works on any `fs::FS` (LittleFS on the ESP32 flash partition, or the
+ * SD card) and is only used by the network transmit task; its counters may be
+ * read from other tasks.
+ */
+
+#ifndef SpillQueueCode
+#define SpillQueueCode
+
+#include <FS.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+class SpillQueue {
+public:
+  /**
+   * @brief Opens (or creates) the queue directory and counts the stored segments.
+   *
+   * @param fileSystem The mounted file system to store the segments on.
+   * @param directory Directory for the segment files, e.g. "/spill".
+   * @param maxBytes Largest total size of the stored segments.
+   *
+   * @return `true` if the queue can be used.
+   */
+  bool begin(fs::FS& fileSystem, const char* directory, size_t maxBytes) {
+    FileSystem = &fileSystem;
+    strncpy(Directory, directory, sizeof(Directory) - 1);
+    Directory[sizeof(Directory) - 1] = '\0';
+    MaxBytes = maxBytes;
+    Head = Tail = 0;
+    Count = 0;
+    Bytes = 0;
+    Ready = false;
+
+    if (!FileSystem->exists(Directory) && !FileSystem->mkdir(Directory))
+      return false;
+    fs::File dir = FileSystem->open(Directory);
+    if (!dir || !dir.isDirectory())
+      return false;
+
+    for (fs::File file = dir.openNextFile(); file; file = dir.openNextFile()) {
+      const char* name = strrchr(file.name(), '/');  // Older cores return the full path
+      name = name ? name + 1 : file.name();
+      char* extension;
+      uint32_t sequence = strtoul(name, &extension, 10);
+      bool segment = extension != name && (strcmp(extension, ".gz") == 0 || strcmp(extension, ".lp") == 0);
+      size_t size = file.size();
+      file.close();  // Invalidates the name
+      if (!segment)
+        continue;
+      if (Count == 0 || sequence < Head)
+        Head = sequence;
+      if (Count == 0 || sequence + 1 > Tail)
+        Tail = sequence + 1;
+      Count++;
+      Bytes += size;
+    }
+    dir.close();
+
+    // Only the segment being written when power was lost can be left under its temporary name
+    char path[SpillPathSize];
+    segmentPath(path, Tail, "tmp");
+    if (FileSystem->exists(path))
+      FileSystem->remove(path);
+
+    Ready = true;
+    return true;
+  }
+
+  /**
+   * @brief Appends a batch to the queue, dropping the oldest segments if it is full.
+   *
+   * @param data The write body.
+   * @param length Size of the write body in bytes.
+   * @param compressed Whether the body is gzip compressed.
+   *
+   * @return `true` if the batch was stored.
+   */
+  bool push(const uint8_t* data, size_t length, bool compressed) {
+    if (!Ready || length > MaxBytes) {
+      Dropped++;
+      return false;
+    }
+    while (Count > 0 && Bytes + length > MaxBytes)
+      dropOldest();
+
+    char temporary[SpillPathSize];
+    char path[SpillPathSize];
+    segmentPath(temporary, Tail, "tmp");
+    segmentPath(path, Tail, compressed ? "gz" : "lp");
+    fs::File file = FileSystem->open(temporary, FILE_WRITE);
+    size_t written = file ? file.write(data, length) : 0;
+    if (file)
+      file.close();
+    if (written != length || !FileSystem->rename(temporary, path)) {
+      FileSystem->remove(temporary);
+      Dropped++;
+      return false;
+    }
+    Tail++;
+    Count++;
+    Bytes += length;
+    Spilled++;
+    return true;
+  }
+
+  /**
+   * @brief Opens the oldest stored segment for reading.
+   *
+   * @param compressed Set to whether the segment is gzip compressed.
+   *
+   * @return The open segment file, or a closed file if the queue is empty.
+   */
+  fs::File openOldest(bool& compressed) {
+    char path[SpillPathSize];
+    while (Ready && Head < Tail) {
+      for (uint8_t i = 0; i < 2; i++) {
+        compressed = i == 0;
+        segmentPath(path, Head, compressed ? "gz" : "lp");
+        if (FileSystem->exists(path)) {
+          fs::File file = FileSystem->open(path, FILE_READ);
+          if (file)
+            return file;
+        }
+      }
+      Head++;  // Missing segment, skip it
+    }
+    Count = 0;
+    Bytes = 0;
+    return fs::File();
+  }
+
+  /**
+   * @brief Removes the oldest segment after it was sent.
+   *
+   * @param length Size of the segment in bytes, as read from `openOldest()`.
+   *
+   * @return void
+   */
+  void pop(size_t length) {
+    if (removeOldest(length)) {
+      Replayed++;
+      ReplayedBytes += length;
+    }
+  }
+
+  // Removes the oldest segment without sending it (e.g. rejected by the server)
+  void discard(size_t length) {
+    if (removeOldest(length))
+      Dropped++;
+  }
+
+  bool empty() const {
+    return Count == 0;
+  }
+  // Number of stored segments (batches)
+  uint32_t depth() const {
+    return Count;
+  }
+  // Total size of the stored segments in bytes
+  uint32_t bytes() const {
+    return Bytes;
+  }
+  // Batches stored since boot
+  uint32_t spilled() const {
+    return Spilled;
+  }
+  // Batches sent from the queue since boot, and their size in bytes
+  uint32_t replayed() const {
+    return Replayed;
+  }
+  uint32_t replayedBytes() const {
+    return ReplayedBytes;
+  }
+  // Batches lost because the queue was full, unavailable or the server rejected them
+  uint32_t dropped() const {
+    return Dropped;
+  }
+
+private:
+  static const uint8_t SpillPathSize = 48;
+
+  void segmentPath(char* path, uint32_t sequence, const char* extension) const {
+    snprintf(path, SpillPathSize, "%s/%010lu.%s", Directory, (unsigned long)sequence, extension);
+  }
+
+  bool removeOldest(size_t length) {
+    char path[SpillPathSize];
+    segmentPath(path, Head, "gz");
+    bool removed = FileSystem->remove(path);
+    if (!removed) {
+      segmentPath(path, Head, "lp");
+      removed = FileSystem->remove(path);
+    }
+    Head++;
+    if (Count > 0)
+      Count--;
+    Bytes = Bytes > length ? Bytes - length : 0;
+    return removed;
+  }
+
+  void dropOldest() {
+    bool compressed;
+    fs::File file = openOldest(compressed);
+    if (!file)
+      return;
+    size_t length = file.size();
+    file.close();
+    discard(length);
+  }
+
+  fs::FS* FileSystem = nullptr;
+  char Directory[24];
+  size_t MaxBytes = 0;
+  bool Ready = false;
+  uint32_t Head = 0;  // Sequence number of the oldest segment
+  uint32_t Tail = 0;  // Sequence number of the next segment
+  volatile uint32_t Count = 0;
+  volatile uint32_t Bytes = 0;
+  volatile uint32_t Spilled = 0;
+  volatile uint32_t Replayed = 0;
+  volatile uint32_t ReplayedBytes = 0;
+  volatile uint32_t Dropped = 0;
+};
+
+#endif  // SpillQueueCode
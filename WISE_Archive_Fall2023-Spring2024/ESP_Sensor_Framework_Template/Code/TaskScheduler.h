@@ -0,0 +1,180 @@
+/**
+ * @file TaskScheduler.h
+ * @brief Millisecond scheduler for the periodic low-rate sensor tasks.
+ *
+ * This file contains the scheduler that runs the low-rate sensor polling functions
+ * from loop(). Every task is registered once with its period; the scheduler keeps
+ * the tasks in a binary min-heap ordered by the time they are next due, so a pass
+ * through loop() with nothing due only compares the current time with the top of
+ * the heap, however many tasks are registered. Running a due task and moving it
+ * to its next due time costs O(log n).
+ *
+ * Tasks keep their phase: the next due time is the previous one plus the period,
+ * not the time the task actually ran. If loop() was held up for a whole period or
+ * more, the missed runs are skipped (the task runs once, not once per missed
+ * period) and counted as overruns of that task, together with the largest delay
+ * seen between the due time and the actual run.
+ *
+ * A task can point to a run flag (e.g. `RSSI_Run`); while the flag is false the
+ * task keeps its schedule but its function is not called.
+ *
+ * The scheduler is only used from loop(); the statistics may be read from the
+ * same context.
+ */
+
+#ifndef TaskSchedulerCode
+#define TaskSchedulerCode
+
+#include <atomic>
+#include <stdint.h>
+
+typedef void (*ScheduledFunction)();
+
+template<uint8_t MaxTasks>
+class TaskScheduler {
+public:
+  struct Task {
+    const char* Name;
+    ScheduledFunction Function;
+    const std::atomic<bool>* Run;  // Optional run flag, nullptr to always run
+    uint32_t PeriodMs;
+    int64_t DueMs;       // Next time the task is due
+    uint32_t Runs;       // Times the function was called
+    uint32_t Overruns;   // Runs skipped because the task was late by a whole period or more
+    uint32_t MaxLateMs;  // Largest delay between the due time and the run
+  };
+
+  /**
+   * @brief Registers a periodic task.
+   *
+   * The task first runs one period after `nowMs`.
+   *
+   * @param name Name of the task, for the statistics.
+   * @param function Function called every period.
+   * @param periodMs Period, in milliseconds (at least 1).
+   * @param run Flag that enables the task, or nullptr.
+   * @param nowMs The current time, in milliseconds.
+   *
+   * @return `false` if `MaxTasks` tasks are already registered.
+   */
+  bool add(const char* name, ScheduledFunction function, uint32_t periodMs, const std::atomic<bool>* run, int64_t nowMs) {
+    if (Count >= MaxTasks)
+      return false;
+    Task& task = Tasks[Count];
+    task.Name = name;
+    task.Function = function;
+    task.Run = run;
+    task.PeriodMs = periodMs > 0 ? periodMs : 1;
+    task.DueMs = nowMs + task.PeriodMs;
+    task.Runs = task.Overruns = task.MaxLateMs = 0;
+    Heap[Count] = Count;
+    siftUp(Count);
+    Count++;
+    return true;
+  }
+
+  // Unregisters all tasks
+  void clear() {
+    Count = 0;
+  }
+
+  /**
+   * @brief Changes the period of a task.
+   *
+   * The task next runs one new period after `nowMs`.
+   *
+   * @param name The name the task was registered with (the same pointer).
+   * @param periodMs The new period, in milliseconds (at least 1).
+   * @param nowMs The current time, in milliseconds.
+   *
+   * @return `false` if no task was registered with `name`.
+   */
+  bool setPeriod(const char* name, uint32_t periodMs, int64_t nowMs) {
+    for (uint8_t node = 0; node < Count; node++) {
+      Task& task = Tasks[Heap[node]];
+      if (task.Name != name)
+        continue;
+      task.PeriodMs = periodMs > 0 ? periodMs : 1;
+      task.DueMs = nowMs + task.PeriodMs;
+      siftUp(node);
+      siftDown(node);
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Runs every task that is due.
+   *
+   * @param nowMs The current time, in milliseconds.
+   *
+   * @return The number of task functions called.
+   */
+  uint8_t run(int64_t nowMs) {
+    uint8_t ran = 0;
+    while (Count > 0 && Tasks[Heap[0]].DueMs <= nowMs) {
+      Task& task = Tasks[Heap[0]];
+      uint64_t lateMs = (uint64_t)(nowMs - task.DueMs);
+      uint64_t missed = lateMs / task.PeriodMs;
+      if (lateMs > task.MaxLateMs)
+        task.MaxLateMs = lateMs > UINT32_MAX ? UINT32_MAX : (uint32_t)lateMs;
+      task.Overruns += (uint32_t)missed;
+      task.DueMs += (int64_t)(missed + 1) * task.PeriodMs;
+      siftDown(0);  // Reschedule before calling, in case the function clears the scheduler
+
+      if (task.Run == nullptr || task.Run->load()) {
+        task.Runs++;
+        ran++;
+        task.Function();
+      }
+    }
+    return ran;
+  }
+
+  uint8_t count() const {
+    return Count;
+  }
+  // Registered task, in registration order
+  const Task& task(uint8_t index) const {
+    return Tasks[index];
+  }
+
+private:
+  bool earlier(uint8_t a, uint8_t b) const {
+    return Tasks[Heap[a]].DueMs < Tasks[Heap[b]].DueMs;
+  }
+
+  void swap(uint8_t a, uint8_t b) {
+    uint8_t task = Heap[a];
+    Heap[a] = Heap[b];
+    Heap[b] = task;
+  }
+
+  void siftUp(uint8_t node) {
+    while (node > 0 && earlier(node, (node - 1) / 2)) {
+      swap(node, (node - 1) / 2);
+      node = (node - 1) / 2;
+    }
+  }
+
+  void siftDown(uint8_t node) {
+    for (;;) {
+      uint8_t first = node;
+      uint16_t left = 2 * node + 1;
+      if (left < Count && earlier(left, first))
+        first = left;
+      if (left + 1 < Count && earlier(left + 1, first))
+        first = left + 1;
+      if (first == node)
+        return;
+      swap(node, first);
+      node = first;
+    }
+  }
+
+  Task Tasks[MaxTasks];
+  uint8_t Heap[MaxTasks];  // Task indices, the next due task first
+  uint8_t Count = 0;
+};
+
+#endif  // TaskSchedulerCode
@@ -0,0 +1,96 @@
+/**
+ * @file TimestampClock.h
+ * @brief Consistent 64-bit microsecond epoch timestamps from a monotonic timer.
+ *
+ * This file contains the clock used to timestamp every sample. A timestamp is the
+ * monotonic microsecond timer (`esp_timer_get_time()` on the ESP32) mapped to the
+ * epoch, so it is read in one step: there is no separate seconds and microseconds
+ * read that a second boundary or a clock adjustment could fall between.
+ *
+ * The mapping is a line through an anchor point: at the monotonic time `base` the
+ * clock reads `epoch`, and from there it advances at the monotonic rate corrected
+ * by `ratePpb` parts per billion. Time synchronization moves the anchor (NTP, or
+ * the GPS PPS clock servo every second) and the servo sets the rate, so the clock
+ * can be slewed without ever stepping backwards.
+ *
+ * The mapping is set by the time synchronization code and read by every sensor.
+ * It is wider than the ESP32 can load atomically, so it is protected by a sequence
+ * lock: the writer makes the sequence number odd while it changes the fields, and
+ * a reader retries until it read all fields under the same even sequence number.
+ * Readers never block the writer or each other.
+ *
+ * There must only be one writer at a time, and the writer must not be interrupted
+ * by a reader on the same core, or the reader would wait for it forever; on the
+ * ESP32 `setTimestampClock()` writes inside a critical section.
+ */
+
+#ifndef TimestampClockCode
+#define TimestampClockCode
+
+#include <atomic>
+#include <stdint.h>
+
+class TimestampClock {
+public:
+  /**
+   * @brief Moves the anchor point and rate of the clock (writer side).
+   *
+   * @param monotonicUs Monotonic time of the anchor, in microseconds.
+   * @param epochUs Epoch time the clock reads at the anchor, in microseconds.
+   * @param ratePpb Rate correction from the anchor on, in parts per billion.
+   *
+   * @return void
+   */
+  void set(int64_t monotonicUs, int64_t epochUs, int32_t ratePpb) {
+    uint32_t sequence = Sequence.load(std::memory_order_relaxed);
+    Sequence.store(sequence + 1, std::memory_order_relaxed);  // Odd: update in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    BaseLow.store((uint32_t)monotonicUs, std::memory_order_relaxed);
+    BaseHigh.store((uint32_t)((uint64_t)monotonicUs >> 32), std::memory_order_relaxed);
+    EpochLow.store((uint32_t)epochUs, std::memory_order_relaxed);
+    EpochHigh.store((uint32_t)((uint64_t)epochUs >> 32), std::memory_order_relaxed);
+    Rate.store(ratePpb, std::memory_order_relaxed);
+    Sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  /**
+   * @brief Converts a monotonic timer reading to an epoch timestamp.
+   *
+   * @param monotonicUs The monotonic timer, in microseconds.
+   *
+   * @return Microseconds since the epoch.
+   */
+  uint64_t at(int64_t monotonicUs) const {
+    uint32_t before, after, baseLow, baseHigh, epochLow, epochHigh;
+    int32_t rate;
+    do {
+      before = Sequence.load(std::memory_order_acquire);
+      baseLow = BaseLow.load(std::memory_order_relaxed);
+      baseHigh = BaseHigh.load(std::memory_order_relaxed);
+      epochLow = EpochLow.load(std::memory_order_relaxed);
+      epochHigh = EpochHigh.load(std::memory_order_relaxed);
+      rate = Rate.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = Sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    int64_t elapsed = monotonicUs - (int64_t)(((uint64_t)baseHigh << 32) | baseLow);
+    int64_t epoch = (int64_t)(((uint64_t)epochHigh << 32) | epochLow);
+    return (uint64_t)(epoch + elapsed + elapsed * rate / 1000000000LL);
+  }
+
+  // Rate correction currently applied, in parts per billion
+  int32_t ratePpb() const {
+    return Rate.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<uint32_t> Sequence{ 0 };
+  std::atomic<uint32_t> BaseLow{ 0 };
+  std::atomic<uint32_t> BaseHigh{ 0 };
+  std::atomic<uint32_t> EpochLow{ 0 };
+  std::atomic<uint32_t> EpochHigh{ 0 };
+  std::atomic<int32_t> Rate{ 0 };
+};
+
+#endif  // TimestampClockCode
@@ -23,6 +23,7 @@
 #include "esp_timer.h"  // For sensor polling timers
 #include <WiFiMulti.h>  // For multi-core operations and WiFi
 #include "time.h"       // For epoch-time tracking
+#include "esp_sntp.h"   // NTP synchronization notifications
 #include <SPI.h>
 #include <Wire.h>  // I2C/StemmaQT Devices
 #include <Adafruit_NeoPixel.h>
@@ -34,6 +35,7 @@
 // InfluxDB
 #include <InfluxDbClient.h>
 #include <InfluxDbCloud.h>
+#include <HTTPClient.h>  // Influx writes from the network transmit task
 
 // MQTT Client
 #include <ESP32HTTPUpdateServer.h>
@@ -42,13 +44,37 @@
 // SD Card
 #include <FS.h>
 #include <SD.h>
+#include <unistd.h>  // truncate(), for the SD log recovery
+
+// Flash File System
+#include <LittleFS.h>  // Spill queue for Influx outages
 
 // Sensor Libraries
 #include <TinyGPSPlus.h>          // GPS NMEA Interpreter for GPS Module on Serial Connection
 #include <Adafruit_ISM330DHCX.h>  // Accelerometer/Gyro Data (from Adafruit LSM6DS library)
 
 // Local Libraries
+#include "Code/SampleTypes.h"
+#include "Code/Ism330Fifo.h"
+#include "Code/SensorCommand.h"
 #include "Code/Prototypes.h"
+#include "Code/SampleRing.h"
+#include "Code/LineProtocol.h"
+#include "Code/Crc32.h"
+#include "Code/Gzip.h"
+#include "Code/BatchHandoff.h"
+#include "Code/BatchController.h"
+#include "Code/SpillQueue.h"
+#include "Code/PipelineStats.h"
+#include "Code/TimestampClock.h"
+#include "Code/ClockServo.h"
+#include "Code/DrdyTracker.h"
+#include "Code/Decimator.h"
+#include "Code/TaskScheduler.h"
+#include "Code/SensorTiming.h"
+#include "Code/SdBlockWriter.h"
+#include "Code/SdBlockQueue.h"
+#include "Code/SdLogFormat.h"
 #include "Code/Configuration.h"
 #include "Code/SensorConfig.h"
 #include "Code/Functions.cpp"
@@ -68,12 +94,12 @@
  * 4. Initializes the GPS serial communication.
  * 5. Sets the initial system time using GPS or the internet (via `setTime()`).
  * 6. Connects to the WiFi network for operation (via `setWifiMultiConfig()`).
- * 7. Configures the InfluxDB client (if `InfluxLogging` is defined).
+ * 7. Configures the InfluxDB batches and starts the network transmit task (if
+ *    `InfluxLogging` is defined).
  * 8. Configures the SD card logging (if `SDLogging` is defined).
  * 9. Configures the attached sensors (via `setIsm330Config()`).
  * 10. Starts the low-rate and high-rate sensor timers.
- * 11. Creates a mutex for the InfluxDB client (if `InfluxLogging` is defined).
- * 12. Sets up the GPS module PPS (Pulse Per Second) time synchronization.
+ * 11. Sets up the GPS module PPS (Pulse Per Second) clock servo and interrupt.
  *
  * The function also performs various initialization checks and displays status
  * messages on the serial monitor, OLED display, and NeoPixel LED (if available).
@@ -141,6 +167,7 @@ void setup() {
     pixel.show();
 #endif
   }
+  beginDataLogSD();
 #endif
 
   // Setup Attached Sensors
@@ -149,11 +176,9 @@ void setup() {
   // Start Timers
   startLowRateSensors();
   startHighRateSensors();
-#ifdef InfluxLogging
-  InfluxClientMutex = xSemaphoreCreateMutex();
-#endif
 
   // Setup GPS Module PPS Time Sync
+  ppsServo.begin(PPSServoKp, PPSServoKi, PPSMaxRatePpb, PPSStepThresholdUs, PPSLockThresholdUs, PPSHoldoverSeconds * 1000000LL, PPSOffsetMicroseconds);
   pinMode(GPS_PPS_PIN, INPUT_PULLDOWN);  // Need a pull-down mode (not available in Arduino but is in ESP-IDF)
   attachInterrupt(digitalPinToInterrupt(GPS_PPS_PIN), GPS_PPS_ISR, RISING);
 
@@ -171,17 +196,26 @@ void setup() {
  * after the `setup()` function. It performs the following tasks:
  *
  * 1. Prints debug information to the serial monitor (if `SerialDebugMode` is defined),
- *    including WiFi signal strength, current time, and InfluxDB connection status.
+ *    including WiFi signal strength, current time, and the status and duration of
+ *    the last InfluxDB write.
  * 2. Prints the current time to the OLED display every 10 seconds (if `OLEDDebugging`
  *    is defined).
- * 3. Performs GPS time resynchronization if the `GPSSync` flag is set.
- * 4. Updates the stored system time for GPS interrupt usage.
- * 5. Transmits the Influx buffer if the total data points exceed a certain percentage
- *    of the batch size (if `InfluxLogging` is defined). Repeats until buffers emptied,
- *    or the sequential transmit limit is reached.
+ * 3. Disciplines the sample timestamp clock to the GPS PPS pulse captured by the
+ *    interrupt if the `GPSSync` flag is set (`disciplineTimestampClock()`), or
+ *    applies an NTP update if the `NTPSync` flag is set and the clock is not
+ *    locked to the PPS.
+ * 4. Logs all samples queued by the high-rate sensor callbacks, and hands the
+ *    buffered SD log data to the SD writer task once it waited
+ *    `SDFlushIntervalMs` (if `SDLogging` is defined).
+ * 5. Hands the Influx buffer to the network transmit task if the total data points
+ *    reach the flush threshold of the batch controller (`influxBatchControl`),
+ *    which adapts to the link quality (if `InfluxLogging` is defined).
+ *    This never waits on the network, the transmit task sends the batch while
+ *    loop() keeps running.
  * 6. Handles client write errors (if `InfluxLogging` is defined).
  * 7. Checks if any low-rate sensors should be polled again.
  * 8. Keeps the MQTT connection alive by calling `mqttClient.loop()`.
+ * 9. Publishes the pipeline health counters over MQTT every `StatsPublishSeconds`.
  *
  * The loop function continuously runs and handles various tasks related to data
  * acquisition, transmission, and time synchronization.
@@ -194,15 +228,31 @@ void loop() {
   Serial.print(getSeconds());
   Serial.print("  -  Loop Test - Core ");
   Serial.print(xPortGetCoreID());
+  Serial.print(" - PPS ");
+  Serial.print(ppsServo.tracking(esp_timer_get_time()) ? "locked" : "unlocked");
+  Serial.print(", offset ");
+  Serial.print(ppsServo.offsetUs());
+  Serial.print(" us, drift ");
+  Serial.print(ppsServo.driftPpb());
+  Serial.print(" ppb");
 #ifdef InfluxLogging
-  if (client.validateConnection()) {
-    Serial.print("Connected to InfluxDB: ");
-    Serial.println(client.getServerUrl());
-  } else {
-    Serial.print("InfluxDB connection failed: ");
-    Serial.println(client.getLastErrorMessage());
-  }
+  Serial.print(" - Last Influx write: ");
+  Serial.print(influxLastStatus);
+  Serial.print(" in ");
+  Serial.print(influxLastFlushMs);
+  Serial.print(" ms (max ");
+  Serial.print(influxMaxFlushMs);
+  Serial.print(" ms), batch threshold ");
+  Serial.print(influxBatchControl.threshold());
+#ifdef InfluxSpillToFlash
+  Serial.print(", spilled batches ");
+  Serial.print(influxSpill.depth());
+  Serial.print(" (");
+  Serial.print(influxSpill.replayed());
+  Serial.print(" replayed)");
+#endif
 #endif
+  Serial.println();
   delay(200);
 #endif
 
@@ -214,28 +264,35 @@ void loop() {
 #endif
 
 
-  // GPS Time Resync
+  // GPS Time Resync (the pulse time was captured by the interrupt, so the delay until here does not matter)
   if (GPSSync) {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
+    portENTER_CRITICAL(&GPSMux);
+    int64_t pulseUs = GPS_us;
     GPSSync = false;
-    tv.tv_sec += PPSOffsetSeconds;  // Adjust seconds as needed
-
-    // Calculate how long it took since the GPS PPS interrupt to run this, then reset the clock to zero + that offset;
-    unsigned long us = micros();
-    tv.tv_usec = us - GPS_us + PPSOffsetMicroseconds;
+    portEXIT_CRITICAL(&GPSMux);
+    disciplineTimestampClock(pulseUs);
+  }
 
-    settimeofday(&tv, nullptr);
+  // NTP Time Resync (only while the PPS is not available)
+  if (NTPSync) {
+    NTPSync = false;
+    if (!ppsServo.tracking(esp_timer_get_time()))
+      syncTimestampClock();
   }
 
+  // Log samples queued by the high-rate sensor callbacks
+  drainHighRateSensors();
+
+#ifdef SDLogging
+  // Queue the SD log block to the writer task once its oldest data waited SDFlushIntervalMs (full blocks are queued as they fill)
+  if (!dataLog.poll(millis(), SDFlushIntervalMs))
+    pipelineStats.SdWriteErrors.fetch_add(1, std::memory_order_relaxed);
+#endif
 
 #ifdef InfluxLogging
-  // Start Transmitting Data if total amount is nearing target Batch Size, repeat until buffer not considered "nearing full"
-  char count = 0; // In theory, could get stuck transmitting infinitely if highrate runs too fast; limit how many sequential runs can occur
-  while ((slowPointCount + fastPointCount) > (BATCH_SIZE * (StartTransmissionPercentage / 100.0)) && (count < InfluxSequentialTransmitLimit)) {
+  // Hand the batch to the transmit task once it reaches the adaptive flush threshold (retried next loop if the task is busy)
+  if (influxHandoff.filling()->points() >= influxBatchControl.threshold())
     transmitInfluxBuffer();
-    count++;
-  } 
 
   // Client Write Error Handling
   if (writeError) {
@@ -243,16 +300,16 @@ void loop() {
 
 #ifdef SerialDebugMode
     Serial.print("Write Error Occured: ");
-    Serial.println(client.getLastErrorMessage());
-    Serial.print("Full buffer: ");
-    Serial.println(client.isBufferFull() ? "Yes" : "No");
+    Serial.println(influxLastStatus);
+    Serial.print("Transmit task busy: ");
+    Serial.println(influxHandoff.inFlight() ? "Yes" : "No");
 #endif
 
 #ifdef OLEDDebugging
     display.print("Write Error Occured: ");
-    display.println(client.getLastErrorMessage());
-    display.print("Full buffer: ");
-    display.println(client.isBufferFull() ? "Yes" : "No");
+    display.println(influxLastStatus);
+    display.print("Transmit task busy: ");
+    display.println(influxHandoff.inFlight() ? "Yes" : "No");
     display.display();
 #endif
   } // end writeError handling
@@ -263,4 +320,7 @@ void loop() {
 
   // Call the loop function to keep the connection alive
   mqttClient.loop();
+
+  // Report where samples are lost or delayed, without needing serial debugging
+  publishPipelineStats();
 }
@@ -0,0 +1,196 @@
+/**
+ * @file AllocationTest.cpp
+ * @brief Checks that logging a sample never allocates heap memory.
+ *
+ * Every call of malloc, calloc, realloc and operator new is counted (the C
+ * functions are wrapped by the linker, see CMakeLists.txt). After the one-time
+ * setup, samples are passed along the whole path they take on the ESP32:
+ *
+ * 1. Producer: FIFO words decoded by `Ism330FifoDecoder`, filtered by
+ *    `FirDecimator`, built into a `SampleFrame` and pushed into a `SampleRing`.
+ * 2. Consumer: frames popped from the ring, encoded as line protocol into a
+ *    reused `LineProtocolBatch`, and as binary SD log entries by `SdLogEncoder`
+ *    into an `SdBlockWriter` block pool.
+ *
+ * Not a single allocation may be counted, so the heap can not fragment however
+ * long the sensor runs. A `std::string` at the end shows that the counting works.
+ */
+
+#include "HostTest.h"
+#include "Ism330FifoDump.h"
+#include "Decimator.h"
+#include "LineProtocol.h"
+#include "SampleRing.h"
+#include "SampleTypes.h"
+#include "SdBlockWriter.h"
+#include "SdLogFormat.h"
+#include <new>
+#include <stdlib.h>
+#include <string>
+
+static size_t Allocations = 0;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* data, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  Allocations++;
+  return __real_malloc(size);
+}
+void* __wrap_calloc(size_t count, size_t size) {
+  Allocations++;
+  return __real_calloc(count, size);
+}
+void* __wrap_realloc(void* data, size_t size) {
+  Allocations++;
+  return __real_realloc(data, size);
+}
+}
+
+// operator new is routed through the counted malloc
+void* operator new(size_t size) {
+  void* data = malloc(size ? size : 1);
+  if (data == nullptr)
+    throw std::bad_alloc();
+  return data;
+}
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+void operator delete(void* data) noexcept {
+  free(data);
+}
+void operator delete[](void* data) noexcept {
+  free(data);
+}
+void operator delete(void* data, size_t) noexcept {
+  free(data);
+}
+void operator delete[](void* data, size_t) noexcept {
+  free(data);
+}
+
+// Block pool that hands every queued block straight back, like a writer task that is never slow
+struct RecyclingQueue {
+  static const uint8_t Blocks = 4;
+  uint8_t Memory[Blocks][4096];
+  uint8_t* Free[Blocks];
+  uint8_t FreeCount = 0;
+  size_t Bytes = 0;
+
+  void begin() {
+    for (uint8_t i = 0; i < Blocks; i++)
+      Free[FreeCount++] = Memory[i];
+  }
+  uint8_t* acquire() {
+    return FreeCount > 0 ? Free[--FreeCount] : nullptr;
+  }
+  bool submit(const SdBlock& block) {
+    Bytes += block.Length;
+    Free[FreeCount++] = block.Data;
+    return true;
+  }
+  bool takeFailure() {
+    return false;
+  }
+};
+
+static const uint8_t Ism330Sensor = 0;
+static const char* const FieldKeys[6] = { "gyro_x", "gyro_y", "gyro_z", "accel_x", "accel_y", "accel_z" };
+static const float FieldScales[6] = { 0.0175f, 0.0175f, 0.0175f, 0.000598f, 0.000598f, 0.000598f };
+
+static SampleRing<SampleFrame, 512> Ring;
+static FirDecimator<6, 8, 97> Decimator;
+static Ism330FifoDecoder Fifo;
+static LineProtocolBatch Batch;
+static SdLogEncoder<1> Encoder;
+static RecyclingQueue Pool;
+static SdBlockWriter<4096, RecyclingQueue> Writer;
+static uint32_t FramesQueued = 0;
+static uint32_t FramesLogged = 0;
+static uint32_t BatchesSent = 0;
+
+// Producer: the body of queueIsm330Sample()
+static void queueSample(uint64_t timestamp, const Ism330RawSample& sample) {
+  int16_t axes[6];
+  for (uint8_t axis = 0; axis < 3; axis++) {
+    axes[axis] = sample.Gyro[axis];
+    axes[axis + 3] = sample.Accel[axis];
+  }
+  if (!Decimator.push(timestamp, axes, timestamp, axes))
+    return;
+  SampleFrame frame;
+  frame.begin(Ism330Sensor, timestamp);
+  for (uint8_t axis = 0; axis < 6; axis++)
+    frame.addRaw(axes[axis]);
+  if (Ring.push(frame))
+    FramesQueued++;
+}
+
+// Consumer: drainHighRateSensors(), with logDataInflux() and logDataSD()
+static void drainRing(uint32_t nowMs) {
+  SampleFrame frame;
+  while (Ring.pop(frame)) {
+    if (Batch.available() < 256) {
+      Batch.clear();  // Handed to the transmit task on the ESP32
+      BatchesSent++;
+    }
+    Batch.beginPoint("ism330dhcx,device=test");
+    for (uint8_t i = 0; i < frame.FieldCount; i++)
+      Batch.addField(FieldKeys[i], frame.Values[i].I * FieldScales[i], 4);
+    Batch.endPoint(frame.Timestamp);
+
+    uint8_t record[128];
+    size_t length = Encoder.encodeFrame(record, sizeof(record), frame, "ISM330DHCX", [](uint8_t i) {
+      SdLogField field = { FieldKeys[i], FieldScales[i] };
+      return field;
+    });
+    if (length > 0 && Writer.write((const char*)record, length, nowMs)) {
+      Encoder.commitFrame();
+      FramesLogged++;
+    }
+  }
+  Writer.poll(nowMs, 1000);
+}
+
+int main() {
+  // Setup: everything that may allocate
+  Ism330FifoDump dump;
+  dump.slots(0, 40000, 0, 48);
+  CHECK(Batch.begin(16384));
+  Fifo.begin(7);
+  Pool.begin();
+  Writer.setQueue(&Pool);
+  Writer.begin();
+  uint8_t header[64];
+  CHECK(Writer.write((const char*)header, Encoder.beginFile(header, sizeof(header), "test"), 0));
+
+  size_t before = Allocations;
+  for (size_t word = 0; word < dump.words(); word += 32) {
+    uint16_t count = (uint16_t)(dump.words() - word < 32 ? dump.words() - word : 32);
+    Fifo.decode(dump.at(word), count, [](const Ism330FifoSample& sample) {
+      queueSample((uint64_t)sample.Ticks * 25, sample);
+    });
+    drainRing((uint32_t)(word / 10));
+  }
+  Writer.close();
+  size_t during = Allocations - before;
+
+  printf("%u frames logged, %u batches, %zu SD bytes, %zu allocations\n", FramesLogged, BatchesSent, Pool.Bytes, during);
+  CHECK_EQ(during, 0);
+  CHECK_EQ(FramesLogged, FramesQueued);
+  CHECK(FramesQueued > 40000 / 8 - 16);  // Decimated by 8, less the filter start
+  CHECK_EQ(Ring.dropped(), 0);
+  CHECK_EQ(Writer.dropped(), 0);
+  CHECK(BatchesSent > 0);
+
+  // The counting works
+  before = Allocations;
+  std::string text(100, 'x');
+  CHECK(Allocations > before);
+
+  free((void*)Batch.data());
+  return testResult();
+}
@@ -0,0 +1,123 @@
+/**
+ * @file BatchControllerTest.cpp
+ * @brief BatchController rules and its behaviour on a simulated link.
+ *
+ * First the single rules: growth, shrinking and halving of the threshold, its
+ * bounds, the error rate that stops growth and the RSSI cap.
+ *
+ * Then the controller runs against a link model, where a write of a batch takes
+ * the round trip time plus the gzip-compressed batch (about 40 bytes per point)
+ * over the link throughput, and fails when it is lost or takes longer than the
+ * 10 s HTTP timeout. The link goes through four phases of 40 writes:
+ *
+ * - Good (-55 dBm, 40 ms, 200 kB/s): the threshold grows to the maximum.
+ * - Degraded (-78 dBm, 300 ms, 15 kB/s, 5% loss): the threshold shrinks until a
+ *   write stays around the 1 s target.
+ * - Outage (-90 dBm, 2 s, 1 kB/s, 90% loss): the threshold drops to the minimum.
+ * - Recovered (-60 dBm, like good): the threshold grows back to the maximum.
+ */
+
+#include "HostTest.h"
+#include "BatchController.h"
+#include <random>
+
+static void rules() {
+  BatchController c;
+  c.begin(25, 250, 100, 1000, -85, -65);
+  CHECK_EQ(c.threshold(), 100);
+
+  c.onFlush(100, true);  // Well under the target: +1/8
+  CHECK_EQ(c.threshold(), 112);
+  c.onFlush(700, true);  // Between half the target and the target: unchanged
+  CHECK_EQ(c.threshold(), 112);
+  c.onFlush(1500, true);  // Over the target: -1/4
+  CHECK_EQ(c.threshold(), 84);
+  c.onFlush(100, false);  // Failed: halved
+  CHECK_EQ(c.threshold(), 42);
+  CHECK_EQ(c.errorRate(), 125);
+  c.onFlush(100, true);  // 10% or more of recent writes failed: no growth yet
+  CHECK_EQ(c.threshold(), 42);
+  CHECK_EQ(c.errorRate(), 110);
+  c.onFlush(100, true);
+  CHECK_EQ(c.errorRate(), 97);
+  CHECK_EQ(c.threshold(), 47);
+
+  for (int i = 0; i < 5; i++)
+    c.onFlush(100, false);
+  CHECK_EQ(c.threshold(), 25);  // Never below the minimum
+  for (int i = 0; i < 100; i++)
+    c.onFlush(100, true);
+  CHECK_EQ(c.threshold(), 250);  // Nor above the maximum
+
+  c.onRssi(-90);
+  CHECK_EQ(c.threshold(), 25);
+  c.onRssi(0);  // Disconnected: no reading, the weak signal cap stays
+  CHECK_EQ(c.threshold(), 25);
+  c.onRssi(-75);  // Halfway between weak and strong
+  CHECK_EQ(c.threshold(), 137);
+  c.onRssi(-65);
+  CHECK_EQ(c.threshold(), 250);
+
+  BatchController start;
+  start.begin(25, 250, 400, 1000, -85, -65);
+  CHECK_EQ(start.threshold(), 250);  // The start is clamped too
+}
+
+struct LinkPhase {
+  const char* Name;
+  int Rssi;
+  double RoundTripMs;
+  double KBytesPerSecond;
+  double Loss;
+};
+
+static void link() {
+  static const LinkPhase Phases[] = {
+    { "good", -55, 40, 200, 0.0 },
+    { "degraded", -78, 300, 15, 0.05 },
+    { "outage", -90, 2000, 1, 0.9 },
+    { "recovered", -60, 40, 200, 0.0 },
+  };
+  static const uint32_t TargetMs = 1000;
+  static const double BytesPerPoint = 40;
+  static const int Writes = 40;
+
+  BatchController c;
+  c.begin(25, 250, 125, TargetMs, -85, -65);
+  std::mt19937 random(3);
+  std::uniform_real_distribution<double> chance(0, 1);
+  uint16_t ends[4];
+  double lateLatency[4];  // Mean latency of the last 10 writes of each phase
+
+  for (int p = 0; p < 4; p++) {
+    const LinkPhase& phase = Phases[p];
+    c.onRssi(phase.Rssi);
+    double latencySum = 0;
+    int failures = 0;
+    lateLatency[p] = 0;
+    for (int i = 0; i < Writes; i++) {
+      double latency = phase.RoundTripMs + c.threshold() * BytesPerPoint / phase.KBytesPerSecond;
+      bool success = chance(random) >= phase.Loss && latency < 10000;
+      failures += success ? 0 : 1;
+      latencySum += latency;
+      if (i >= Writes - 10)
+        lateLatency[p] += latency / 10;
+      c.onFlush((uint32_t)latency, success);
+    }
+    ends[p] = c.threshold();
+    printf("%-9s threshold %3u, mean write %5.0f ms (last 10: %5.0f ms), %2d failed, error rate %u/1000\n",
+           phase.Name, ends[p], latencySum / Writes, lateLatency[p], failures, c.errorRate());
+  }
+
+  CHECK_EQ(ends[0], 250);
+  CHECK(ends[1] >= 40 && ends[1] <= 130);
+  CHECK(lateLatency[1] < TargetMs * 1.5);  // The degraded link settles around the target
+  CHECK_EQ(ends[2], 25);
+  CHECK_EQ(ends[3], 250);
+}
+
+int main() {
+  rules();
+  link();
+  return testResult();
+}
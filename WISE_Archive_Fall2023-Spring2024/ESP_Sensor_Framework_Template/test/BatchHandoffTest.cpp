@@ -0,0 +1,166 @@
+/**
+ * @file BatchHandoffTest.cpp
+ * @brief loop() keeps its cadence while the Influx server stalls a write.
+ *
+ * The main thread plays loop(): every millisecond it encodes one numbered point
+ * into the batch being filled, as `logDataInflux()` does, and hands the batch to
+ * the transmit thread through `BatchHandoff` once it holds the flush threshold,
+ * as `transmitInfluxBuffer()` does. The transmit thread plays
+ * `influxTransmitTask()` against a fake server that answers a write in 5 ms, but
+ * holds every write started during a stall window until the window ends.
+ *
+ * - Cadence: no loop() iteration may wait on the stalled write (an iteration may
+ *   still be preempted by the host for a few milliseconds), and loop() keeps
+ *   running through the stall.
+ * - Data: the points that reach the server are in order, and with the points
+ *   dropped because both batches were full add up to all points; once the server
+ *   answers again, nothing more is dropped.
+ */
+
+#include "HostTest.h"
+#include "BatchHandoff.h"
+#include "LineProtocol.h"
+#include <condition_variable>
+#include <mutex>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint32_t RunMs = 1500;
+static const uint32_t StallFromMs = 300;  // Writes started in this window return at its end
+static const uint32_t StallToMs = 1100;
+static const uint32_t WriteMs = 5;
+static const size_t BytesPerPoint = 64;  // InfluxBytesPerPoint
+static const uint16_t FlushPoints = 50;  // Flush threshold of the batch controller
+static const uint16_t BatchPoints = 100;
+
+static LineProtocolBatch Batches[2];
+static BatchHandoff<LineProtocolBatch> Handoff;
+static Clock::time_point Start;
+
+// InfluxTransmitQueue: loop() only ever posts without waiting
+static std::mutex QueueMutex;
+static std::condition_variable QueueReady;
+static LineProtocolBatch* Queued = nullptr;
+static bool Stop = false;
+
+static std::vector<long> Received;  // Point numbers that reached the server
+static uint32_t StalledWrites = 0;
+
+static uint32_t elapsedMs() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - Start).count();
+}
+
+// influxTransmitTask()
+static void transmitTask() {
+  for (;;) {
+    LineProtocolBatch* batch;
+    {
+      std::unique_lock<std::mutex> lock(QueueMutex);
+      QueueReady.wait(lock, [] { return Queued != nullptr || Stop; });
+      if (Queued == nullptr)
+        return;
+      batch = Queued;
+      Queued = nullptr;
+    }
+
+    // The fake server
+    uint32_t now = elapsedMs();
+    if (now >= StallFromMs && now < StallToMs) {
+      StalledWrites++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(StallToMs - now));
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(WriteMs));
+    }
+    for (const char* p = strstr(batch->data(), "seq="); p != nullptr; p = strstr(p + 4, "seq="))
+      Received.push_back(atol(p + 4));
+
+    batch->clear();
+    Handoff.release();
+  }
+}
+
+// transmitInfluxBuffer()
+static bool transmitBuffer() {
+  if (Handoff.filling()->points() == 0)
+    return true;
+  LineProtocolBatch* full = Handoff.handOff();
+  if (full == nullptr)
+    return false;
+  std::lock_guard<std::mutex> lock(QueueMutex);
+  Queued = full;
+  QueueReady.notify_one();
+  return true;
+}
+
+int main() {
+  CHECK(Batches[0].begin(BatchPoints * BytesPerPoint));
+  CHECK(Batches[1].begin(BatchPoints * BytesPerPoint));
+  Handoff.begin(&Batches[0], &Batches[1]);
+  Start = Clock::now();
+  std::thread task(transmitTask);
+
+  long produced = 0;
+  std::vector<long> dropped;
+  uint64_t maxIterationNs = 0;
+  uint32_t stallIterations = 0;
+  Clock::time_point next = Start;
+  while (elapsedMs() < RunMs) {
+    next += std::chrono::milliseconds(1);
+    std::this_thread::sleep_until(next);
+    uint64_t begin = nowNs();
+
+    // logDataInflux()
+    if (Handoff.filling()->available() < BytesPerPoint)
+      transmitBuffer();
+    LineProtocolBatch* batch = Handoff.filling();
+    batch->beginPoint("test,device=host");
+    batch->addField("seq", produced);
+    if (!batch->endPoint(1718000000000000ULL + produced * 1000ULL))
+      dropped.push_back(produced);
+    produced++;
+
+    // loop(): flush at the threshold
+    if (Handoff.filling()->points() >= FlushPoints)
+      transmitBuffer();
+
+    uint64_t took = nowNs() - begin;
+    if (took > maxIterationNs)
+      maxIterationNs = took;
+    uint32_t now = elapsedMs();
+    if (now > StallFromMs + 50 && now < StallToMs)
+      stallIterations++;
+  }
+
+  // Send what is left once the transmit task is free
+  while (!transmitBuffer())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  while (Handoff.inFlight())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  {
+    std::lock_guard<std::mutex> lock(QueueMutex);
+    Stop = true;
+    QueueReady.notify_one();
+  }
+  task.join();
+
+  printf("%ld points: %zu sent, %zu dropped, %u stalled write(s); longest loop() iteration %.3f ms, %u iterations during the stall\n",
+         produced, Received.size(), dropped.size(), StalledWrites, maxIterationNs / 1e6, stallIterations);
+
+  CHECK(StalledWrites > 0);
+  CHECK(maxIterationNs < 50000000ULL);                              // No iteration waited on the 800 ms stall
+  CHECK(stallIterations > (StallToMs - StallFromMs - 50) * 9 / 10);  // loop() ran on through the stall
+  CHECK_EQ((long)(Received.size() + dropped.size()), produced);
+  bool ordered = true;
+  for (size_t i = 1; i < Received.size(); i++)
+    ordered = ordered && Received[i] > Received[i - 1];
+  CHECK(ordered);
+  CHECK(!dropped.empty());
+  CHECK(dropped.empty() || dropped.back() < (long)(StallToMs + 50));  // Nothing dropped once the server answered again
+
+  free((void*)Batches[0].data());
+  free((void*)Batches[1].data());
+  return testResult();
+}
@@ -0,0 +1,150 @@
+/**
+ * @file ClockServoTest.cpp
+ * @brief ClockServo and TimestampClock against a simulated drifting oscillator and GPS.
+ *
+ * The monotonic timer runs 30 ppm fast against true time, the way an ESP32
+ * crystal can, and the PPS pulse is captured with up to 5 us of interrupt
+ * latency. Every simulated second the servo corrects the clock as in
+ * `disciplineTimestampClock()`; in between, the clock is read ten times and compared with true
+ * time. The servo uses the gains of Configuration.h.
+ *
+ * - Lock: from a clock that is 12 ms off at boot, the servo must step once, lock
+ *   within a minute, estimate the drift within 1 ppm, and then keep every
+ *   timestamp within 20 us of true time.
+ * - Outlier: a single pulse captured 2 ms late is ignored without losing the lock.
+ * - GPS outage: without pulses the clock keeps running at the drift estimate;
+ *   `tracking()` turns false after the holdover, and the pulses after the outage
+ *   are slewed, not stepped.
+ * - Step: when the clock is moved 5 ms off (e.g. by NTP), repeated outliers step
+ *   it back and the servo locks again.
+ *
+ * Timestamps must never go backwards except at a step.
+ */
+
+#include "HostTest.h"
+#include "ClockServo.h"
+#include "TimestampClock.h"
+#include <math.h>
+#include <random>
+
+static const double DriftPpm = 30;
+static const double JitterUs = 5;
+static const int64_t EpochStartUs = 1700000000LL * 1000000LL;
+static const int64_t MonotonicStartUs = 123456789;
+
+struct Simulation {
+  TimestampClock Clock;
+  ClockServo Servo;
+  std::mt19937 Random{ 1 };
+  std::uniform_real_distribution<double> Latency{ 0, JitterUs };
+  int Second = 0;
+  uint64_t Previous = 0;
+  uint32_t Backwards = 0;
+  double MaxErrorUs = 0;  // Largest timestamp error since resetError()
+
+  Simulation() {
+    Servo.begin(0.3, 0.05, 500000, 500, 20, 10000000, 0);
+    Clock.set(monotonic(0), EpochStartUs + 12000, 0);  // Set from NTP at boot, 12 ms off
+  }
+
+  // Monotonic timer at `seconds` of true time
+  static int64_t monotonic(double seconds) {
+    return (int64_t)llround(MonotonicStartUs + seconds * 1e6 * (1 + DriftPpm * 1e-6));
+  }
+
+  // One second: a pulse captured `lateUs` after it (none if negative), then ten clock reads
+  void run(bool pulse = true, double lateUs = 0) {
+    Second++;
+    if (pulse) {
+      int64_t captured = monotonic(Second + (Latency(Random) + lateUs) * 1e-6);
+      if (Servo.onPulse(captured, (int64_t)Clock.at(captured))) {
+        bool step = Servo.offsetUs() > 500 || Servo.offsetUs() < -500;
+        Clock.set(captured, Servo.epochUs(), Servo.ratePpb());
+        if (step)
+          Previous = 0;
+      }
+    }
+    for (int i = 1; i <= 10; i++) {
+      double seconds = Second + i * 0.1 - 0.05;
+      uint64_t timestamp = Clock.at(monotonic(seconds));
+      if (timestamp < Previous)
+        Backwards++;
+      Previous = timestamp;
+      double error = fabs((double)((int64_t)timestamp - EpochStartUs) - seconds * 1e6);
+      if (error > MaxErrorUs)
+        MaxErrorUs = error;
+    }
+  }
+
+  void run(int seconds) {
+    for (int i = 0; i < seconds; i++)
+      run();
+  }
+};
+
+static void lock(Simulation& sim) {
+  int lockedAt = -1;
+  for (int i = 0; i < 60 && lockedAt < 0; i++) {
+    sim.run();
+    if (sim.Servo.locked())
+      lockedAt = sim.Second;
+  }
+  sim.run(120);
+  sim.MaxErrorUs = 0;
+  sim.run(300);
+  printf("Lock: locked after %d s, drift %d ppb, max error %.1f us\n", lockedAt, sim.Servo.driftPpb(), sim.MaxErrorUs);
+  CHECK(lockedAt > 0);
+  CHECK_EQ(sim.Servo.steps(), 1);
+  CHECK(sim.Servo.locked());
+  CHECK_NEAR(sim.Servo.driftPpb(), DriftPpm * 1000, 1000);
+  CHECK(sim.MaxErrorUs < 20);
+}
+
+static void outlier(Simulation& sim) {
+  uint32_t ignored = sim.Servo.ignored();
+  sim.MaxErrorUs = 0;
+  sim.run(true, 2000);
+  CHECK_EQ(sim.Servo.ignored(), ignored + 1);
+  CHECK(sim.Servo.locked());
+  sim.run(10);
+  CHECK(sim.MaxErrorUs < 20);
+  CHECK_EQ(sim.Servo.steps(), 1);
+}
+
+static void outage(Simulation& sim) {
+  sim.MaxErrorUs = 0;
+  for (int i = 0; i < 60; i++)
+    sim.run(false);
+  printf("Outage: max error %.1f us after 60 s without pulses\n", sim.MaxErrorUs);
+  CHECK(!sim.Servo.tracking(Simulation::monotonic(sim.Second)));
+  CHECK(sim.MaxErrorUs < 100);
+  sim.run(30);
+  CHECK(sim.Servo.tracking(Simulation::monotonic(sim.Second)));
+  CHECK_EQ(sim.Servo.steps(), 1);
+  sim.MaxErrorUs = 0;
+  sim.run(10);
+  CHECK(sim.MaxErrorUs < 20);
+}
+
+static void step(Simulation& sim) {
+  int64_t now = Simulation::monotonic(sim.Second + 0.5);
+  sim.Clock.set(now, (int64_t)sim.Clock.at(now) + 5000, sim.Clock.ratePpb());
+  sim.Previous = 0;
+  sim.run(3);
+  CHECK_EQ(sim.Servo.steps(), 2);
+  sim.run(60);
+  sim.MaxErrorUs = 0;
+  sim.run(10);
+  CHECK(sim.Servo.locked());
+  CHECK(sim.MaxErrorUs < 20);
+}
+
+int main() {
+  Simulation sim;
+  lock(sim);
+  outlier(sim);
+  outage(sim);
+  step(sim);
+  CHECK_EQ(sim.Backwards, 0);
+  return testResult();
+}
@@ -0,0 +1,81 @@
+/**
+ * @file DecimatorBenchmark.cpp
+ * @brief Cost per input sample of FirDecimator.
+ *
+ * Six channels (the ISM330DHCX gyro and accelerometer) are decimated with the
+ * default filter (ratio 8, 97 taps) and the 208 Hz one (ratio 4, 49 taps), and
+ * compared with the same filter in direct form, which computes an output for
+ * every input sample and then keeps one in `Ratio`. The time and the
+ * multiply-accumulates per input sample of all six channels are printed; the
+ * polyphase form must do `Ratio` times fewer multiply-accumulates and be faster.
+ * Pass the number of input samples as the first argument (default 3000000).
+ */
+
+#include "HostTest.h"
+#include "Decimator.h"
+#include <stdlib.h>
+
+// The same filter, computing every output
+template<uint8_t Channels, uint8_t Ratio, uint16_t Taps>
+class DirectDecimator {
+public:
+  bool push(const int16_t* in, int16_t* out) {
+    for (uint8_t channel = 0; channel < Channels; channel++) {
+      History[channel][Position] = History[channel][Position + Taps] = in[channel];
+      const int16_t* window = &History[channel][Position + 1];
+      int32_t sum = 1 << 14;
+      for (uint16_t tap = 0; tap < Taps; tap++)
+        sum += (int32_t)FirDesign<Ratio, Taps>::Coefficients[tap] * window[tap];
+      Output[channel] = (int16_t)(sum >> 15);
+    }
+    Position = Position + 1 == Taps ? 0 : Position + 1;
+    if (++Phase < Ratio)
+      return false;
+    Phase = 0;
+    for (uint8_t channel = 0; channel < Channels; channel++)
+      out[channel] = Output[channel];
+    return true;
+  }
+
+private:
+  int16_t History[Channels][2 * Taps] = {};
+  int16_t Output[Channels];
+  uint16_t Position = 0;
+  uint8_t Phase = 0;
+};
+
+template<uint8_t Ratio, uint16_t Taps>
+static void measure(uint32_t samples) {
+  static FirDecimator<6, Ratio, Taps> polyphase;
+  static DirectDecimator<6, Ratio, Taps> direct;
+  int16_t in[6] = { 1, 2, 3, 4, 5, 6 }, out[6];
+  uint64_t timestamp;
+  uint32_t outputs = 0;
+
+  uint64_t begin = nowNs();
+  for (uint32_t k = 0; k < samples; k++) {
+    in[k % 6] ^= (int16_t)k;
+    outputs += polyphase.push(k, in, timestamp, out);
+  }
+  double polyphaseNs = (double)(nowNs() - begin) / samples;
+  asm volatile("" : : "r"(out) : "memory");
+
+  begin = nowNs();
+  for (uint32_t k = 0; k < samples; k++) {
+    in[k % 6] ^= (int16_t)k;
+    direct.push(in, out);
+  }
+  double directNs = (double)(nowNs() - begin) / samples;
+  asm volatile("" : : "r"(out) : "memory");
+
+  printf("Ratio %u, %u taps, 6 channels: polyphase %6.1f ns (%3u MAC), direct %6.1f ns (%3u MAC) per input sample\n", Ratio, Taps, polyphaseNs, 6 * Taps / Ratio, directNs, 6 * Taps);
+  CHECK(outputs >= samples / Ratio - Taps);
+  CHECK(polyphaseNs < directNs);
+}
+
+int main(int argc, char** argv) {
+  uint32_t samples = argc > 1 ? (uint32_t)atol(argv[1]) : 3000000;
+  measure<8, 97>(samples);
+  measure<4, 49>(samples);
+  return testResult();
+}
@@ -0,0 +1,109 @@
+/**
+ * @file DecimatorTest.cpp
+ * @brief Frequency response and timestamps of FirDecimator.
+ *
+ * The filter of the ISM330DHCX at its default configuration (833 Hz sampled, 104 Hz
+ * logged: a ratio of 8 and 97 taps) is fed full-scale sine waves, and the largest
+ * output after the filter settled gives its gain at that frequency:
+ *
+ * - Passband: flat within 0.05 dB up to 30 Hz.
+ * - Transition: about -6 dB at the output Nyquist frequency (52 Hz), at most -40 dB
+ *   at 70 Hz.
+ * - Stopband: at most -73 dB from 84 Hz up, including the frequencies that alias
+ *   onto the logged band.
+ *
+ * The Q15 coefficients must sum to exactly one (32768) and stay within a
+ * least significant bit of the same design in double precision, and an impulse
+ * must come out at the output timestamped nearest to it. The ratio of 4 (208 Hz
+ * logged) is checked the same way.
+ */
+
+#include "HostTest.h"
+#include "Decimator.h"
+#include <math.h>
+#include <stdlib.h>
+
+static const double SampleRateHz = 833.333;
+
+// Gain at `frequencyHz`, in dB, from the largest output once the filter settled
+template<uint8_t Ratio, uint16_t Taps>
+static double gainDb(double frequencyHz) {
+  static FirDecimator<1, Ratio, Taps> decimator;
+  decimator.reset();
+  const double Amplitude = 20000;
+  double peak = 0;
+  for (uint32_t k = 0; k < 20000; k++) {
+    int16_t in = (int16_t)lround(Amplitude * cos(2 * M_PI * frequencyHz * k / SampleRateHz)), out;
+    uint64_t timestamp;
+    if (decimator.push(k, &in, timestamp, &out) && k > 2000)
+      peak = fmax(peak, fabs(out));
+  }
+  return 20 * log10(fmax(peak, 0.5) / Amplitude);  // Half an LSB is the floor
+}
+
+template<uint8_t Ratio, uint16_t Taps>
+static void design() {
+  typedef FirDesign<Ratio, Taps> Design;
+  int32_t sum = 0;
+  double h[Taps], doubleSum = 0, deviation = 0;
+  for (int i = 0; i < Taps; i++) {
+    int m = i - (Taps - 1) / 2;
+    double cutoff = 0.5 / Ratio;
+    double sinc = m == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * m) / (M_PI * m);
+    h[i] = sinc * (0.42 - 0.5 * cos(2 * M_PI * i / (Taps - 1)) + 0.08 * cos(4 * M_PI * i / (Taps - 1)));
+    doubleSum += h[i];
+    sum += Design::Coefficients[i];
+  }
+  for (int i = 0; i < Taps; i++)
+    deviation = fmax(deviation, fabs(h[i] / doubleSum * 32768 - Design::Coefficients[i]));
+  printf("Ratio %u, %u taps: coefficient sum %d, largest deviation from the double design %.2f LSB\n", Ratio, Taps, sum, deviation);
+  CHECK_EQ(sum, 32768);
+  CHECK(deviation <= 3);
+  bool symmetric = true;  // Linear phase
+  for (int i = 0; i < Taps; i++)
+    symmetric = symmetric && Design::Coefficients[i] == Design::Coefficients[Taps - 1 - i];
+  CHECK(symmetric);
+
+  // An impulse comes out at the output timestamped nearest to it
+  FirDecimator<1, Ratio, Taps> decimator;
+  int16_t best = 0;
+  uint64_t bestTimestamp = 0;
+  for (uint32_t k = 0; k < 400; k++) {
+    int16_t in = k == 200 ? 30000 : 0, out;
+    uint64_t timestamp;
+    if (decimator.push(k, &in, timestamp, &out) && out > best) {
+      best = out;
+      bestTimestamp = timestamp;
+    }
+  }
+  CHECK(llabs((long long)bestTimestamp - 200) <= Ratio / 2);
+}
+
+static void response() {
+  const double Frequencies[] = { 0, 5, 10, 20, 30, 40, 45, 52, 60, 70, 84, 100, 150, 200, 300, 400 };
+  for (double frequency : Frequencies) {
+    double gain = gainDb<8, 97>(frequency);
+    printf("%5.0f Hz: %7.2f dB\n", frequency, gain);
+    if (frequency <= 30)
+      CHECK_NEAR(gain, 0, 0.05);
+    else if (frequency == 52)
+      CHECK_NEAR(gain, -6, 0.5);
+    else if (frequency == 70)
+      CHECK(gain <= -40);
+    else if (frequency >= 84)
+      CHECK(gain <= -73);
+  }
+
+  // Ratio 4: Nyquist at 104 Hz
+  double passband = gainDb<4, 49>(40), stopband = gainDb<4, 49>(170);
+  printf("Ratio 4: %.2f dB at 40 Hz, %.2f dB at 170 Hz\n", passband, stopband);
+  CHECK_NEAR(passband, 0, 0.05);
+  CHECK(stopband <= -60);
+}
+
+int main() {
+  design<8, 97>();
+  design<4, 49>();
+  response();
+  return testResult();
+}
@@ -0,0 +1,89 @@
+/**
+ * @file DrdyTrackerTest.cpp
+ * @brief DrdyTracker against a simulated data-ready sensor and sampling task.
+ *
+ * - Simulated run: a sensor whose clock runs 0.4% slow against its nominal 833 Hz
+ *   period raises an edge for every sample, captured with up to 15 us of interrupt
+ *   latency. The task usually reads the sample well within the period, but now and
+ *   then wakes several milliseconds late, so samples are overwritten before they
+ *   are read, and it sometimes wakes again without new data. The tracker must count
+ *   exactly the samples logged, missed and duplicated, and measure the period.
+ * - Glitch: an edge a fraction of a period after the last logged one, or earlier
+ *   than it, is counted as a duplicate and changes neither the period nor the
+ *   edge the next interval is measured from.
+ */
+
+#include "HostTest.h"
+#include "DrdyTracker.h"
+#include <algorithm>
+#include <random>
+
+static const uint32_t NominalPeriodNs = 1200480;  // 833 Hz
+static const double PeriodS = NominalPeriodNs * 1.004e-9;
+
+static void simulatedRun() {
+  std::mt19937 random(7);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  DrdyTracker tracker;
+  tracker.begin(NominalPeriodNs);
+
+  double taskFree = 0;
+  uint32_t logged = 0, missed = 0, duplicates = 0, wrong = 0;
+  bool unread = false;
+  for (uint32_t k = 1; k <= 200000; k++) {
+    double edge = k * PeriodS;
+    int64_t edgeUs = (int64_t)((edge + uniform(random) * 15e-6) * 1e6);
+    if (unread)
+      missed++;  // The previous sample was overwritten before the task read it
+    unread = true;
+    double latency = uniform(random) < 0.002 ? 3e-3 + uniform(random) * 3e-3 : 30e-6 + uniform(random) * 50e-6;
+    double wake = std::max(edge, taskFree) + latency;
+    if (wake < (k + 1) * PeriodS) {
+      if (!tracker.onRead(edgeUs, true))
+        wrong++;
+      logged++;
+      unread = false;
+      taskFree = wake + 100e-6;
+      if (uniform(random) < 0.001) {  // Woken again before the next sample
+        if (tracker.onRead(edgeUs, false))
+          wrong++;
+        duplicates++;
+      }
+    } else {
+      taskFree = wake;  // Still late at the next edge, which replaces this one
+    }
+  }
+
+  printf("Simulated run: %u logged, %u missed, %u duplicates, period %u ns (sensor %.0f ns)\n", tracker.samples(), tracker.missed(), tracker.duplicates(), tracker.periodNs(), PeriodS * 1e9);
+  CHECK_EQ(wrong, 0);
+  CHECK_EQ(tracker.samples(), logged);
+  CHECK_EQ(tracker.missed(), missed);
+  CHECK_EQ(tracker.duplicates(), duplicates);
+  CHECK_NEAR(tracker.periodNs(), PeriodS * 1e9, PeriodS * 1e9 * 0.001);
+}
+
+static void glitch() {
+  DrdyTracker tracker;
+  tracker.begin(NominalPeriodNs);
+  int64_t edgeUs = 1000000;
+  for (int i = 0; i < 10; i++, edgeUs += 1200)
+    CHECK(tracker.onRead(edgeUs, true));
+  edgeUs -= 1200;
+  uint32_t period = tracker.periodNs();
+
+  CHECK(!tracker.onRead(edgeUs + 150, true));  // Glitch an eighth of a period later
+  CHECK(!tracker.onRead(edgeUs - 1200, true));  // Edge time before the last logged one
+  CHECK_EQ(tracker.duplicates(), 2);
+  CHECK_EQ(tracker.periodNs(), period);
+
+  CHECK(tracker.onRead(edgeUs + 1200, true));  // The next sample is still consecutive
+  CHECK_EQ(tracker.samples(), 11);
+  CHECK_EQ(tracker.missed(), 0);
+  CHECK_NEAR(tracker.periodNs(), period, 100);
+}
+
+int main() {
+  simulatedRun();
+  glitch();
+  return testResult();
+}
@@ -0,0 +1,65 @@
+/**
+ * @file GzipBenchmark.cpp
+ * @brief Compression ratio and time of GzipEncoder on an Influx batch.
+ *
+ * Builds a full batch of 250 ISM330DHCX points (a sensor at rest with Gaussian
+ * noise, samples about 10 ms apart) with `LineProtocolBatch`, and compresses it
+ * with every window size from 9 to 15 bits and every level. The ratio and the
+ * time per batch are printed for each, with zlib level 6 (dynamic Huffman codes)
+ * for comparison. Every output is checked with zlib. Pass the number of
+ * repetitions per setting as the first argument (default 50).
+ */
+
+#include "HostTest.h"
+#include "GzipInflate.h"
+#include "Gzip.h"
+#include "LineProtocol.h"
+#include <random>
+#include <stdlib.h>
+
+int main(int argc, char** argv) {
+  int repetitions = argc > 1 ? atoi(argv[1]) : 50;
+
+  std::mt19937 random(1);
+  std::normal_distribution<float> noise(0, 0.02f);
+  LineProtocolBatch batch;
+  CHECK(batch.begin(250 * 192));
+  unsigned long long timestamp = 1697000000000000ULL;
+  while (batch.points() < 250) {
+    batch.beginPoint("Onboard\\ Gyro/Accelerometer,device=ESP32-X");
+    batch.addField("Gyro\\ X", noise(random), 6);
+    batch.addField("Gyro\\ Y", noise(random), 6);
+    batch.addField("Gyro\\ Z", noise(random), 6);
+    batch.addField("Accel\\ X", 0.1f + noise(random), 6);
+    batch.addField("Accel\\ Y", -0.2f + noise(random), 6);
+    batch.addField("Accel\\ Z", 9.81f + noise(random), 6);
+    batch.endPoint(timestamp);
+    timestamp += 10000 + random() % 50;
+  }
+  const uint8_t* in = (const uint8_t*)batch.data();
+  size_t length = batch.length();
+
+  uLongf zlibLength = compressBound(length);
+  std::vector<uint8_t> zlibOut(zlibLength);
+  compress2(zlibOut.data(), &zlibLength, in, length, 6);
+  printf("Batch of %u points, %zu bytes; zlib level 6: %.2fx\n", batch.points(), length, (double)length / zlibLength);
+  printf("window  level   bytes  ratio  us per batch\n");
+
+  std::vector<uint8_t> out(length);
+  for (uint8_t windowBits = 9; windowBits <= 15; windowBits += 3) {
+    for (uint8_t level = 1; level <= 9; level++) {
+      GzipEncoder gzip;
+      CHECK(gzip.begin(windowBits, level));
+      size_t size = 0;
+      uint64_t begin = nowNs();
+      for (int r = 0; r < repetitions; r++)
+        size = gzip.compress(in, length, out.data(), out.size());
+      double us = (double)(nowNs() - begin) / repetitions / 1000.0;
+      CHECK(size > 0 && inflatesTo(out.data(), size, in, length));
+      printf("%6u  %5u  %6zu  %4.2fx  %8.0f\n", windowBits, level, size, size ? (double)length / size : 0.0, us);
+    }
+  }
+
+  free((void*)batch.data());
+  return testResult();
+}
@@ -0,0 +1,31 @@
+/**
+ * @file GzipInflate.h
+ * @brief Decompresses gzip data with zlib, to check GzipEncoder in the host tests.
+ */
+
+#ifndef GzipInflateCode
+#define GzipInflateCode
+
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+
+// `true` if `gzip` is one complete gzip member that decompresses to exactly `expected`
+inline bool inflatesTo(const uint8_t* gzip, size_t gzipLength, const uint8_t* expected, size_t expectedLength) {
+  std::vector<uint8_t> out(expectedLength + 16);
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, 16 + 15) != Z_OK)  // gzip wrapper, any window
+    return false;
+  stream.next_in = (Bytef*)gzip;
+  stream.avail_in = (uInt)gzipLength;
+  stream.next_out = out.data();
+  stream.avail_out = (uInt)out.size();
+  int result = inflate(&stream, Z_FINISH);
+  bool same = result == Z_STREAM_END && stream.avail_in == 0 && stream.total_out == expectedLength &&
+              (expectedLength == 0 || memcmp(out.data(), expected, expectedLength) == 0);
+  inflateEnd(&stream);
+  return same;
+}
+
+#endif  // GzipInflateCode
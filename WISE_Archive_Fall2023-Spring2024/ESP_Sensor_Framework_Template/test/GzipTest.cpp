@@ -0,0 +1,90 @@
+/**
+ * @file GzipTest.cpp
+ * @brief GzipEncoder output decompressed by zlib.
+ *
+ * Every output must be a gzip member that zlib decompresses to exactly the input:
+ *
+ * - Random inputs of up to 5000 bytes, from a single repeated byte to all byte
+ *   values, with every window size and level.
+ * - Periodic inputs, where matches overlap their own source.
+ * - An input of 200 KB, longer than the 16-bit match positions.
+ * - Empty input.
+ *
+ * An output buffer that is too small must give 0, so the batch is sent
+ * uncompressed.
+ */
+
+#include "HostTest.h"
+#include "GzipInflate.h"
+#include "Gzip.h"
+#include <random>
+
+int main() {
+  std::mt19937 random(1);
+  uint32_t failed = 0, cases = 0;
+
+  for (int i = 0; i < 3000; i++) {
+    size_t length = random() % 5000;
+    std::vector<uint8_t> in(length);
+    uint32_t alphabet = 1 + random() % 256;
+    for (size_t k = 0; k < length; k++)
+      in[k] = i % 3 == 0 ? "abcabcabd"[k % 9] : (uint8_t)(random() % alphabet);
+
+    GzipEncoder gzip;
+    CHECK(gzip.begin(8 + random() % 8, 1 + random() % 9));
+    std::vector<uint8_t> out(length * 2 + 64);
+    size_t size = gzip.compress(in.data(), length, out.data(), out.size());
+    cases++;
+    if (size == 0 || !inflatesTo(out.data(), size, in.data(), length))
+      failed++;
+  }
+  printf("%u of %u random inputs failed\n", failed, cases);
+  CHECK_EQ(failed, 0);
+
+  // Longer than the 16-bit positions of the match tables
+  {
+    size_t length = 200000;
+    std::vector<uint8_t> in(length);
+    for (size_t k = 0; k < length; k++)
+      in[k] = (uint8_t)((k * 7 / 13) % 97 + random() % 3);
+    GzipEncoder gzip;
+    CHECK(gzip.begin(15, 9));
+    std::vector<uint8_t> out(length * 2);
+    size_t size = gzip.compress(in.data(), length, out.data(), out.size());
+    CHECK(size > 0 && size < length);
+    CHECK(inflatesTo(out.data(), size, in.data(), length));
+  }
+
+  // Empty input
+  {
+    GzipEncoder gzip;
+    CHECK(gzip.begin(12, 4));
+    uint8_t out[64];
+    size_t size = gzip.compress(nullptr, 0, out, sizeof(out));
+    CHECK(size > 0);
+    CHECK(inflatesTo(out, size, nullptr, 0));
+  }
+
+  // Does not fit
+  {
+    std::vector<uint8_t> in(4000);
+    for (size_t k = 0; k < in.size(); k++)
+      in[k] = (uint8_t)random();
+    GzipEncoder gzip;
+    CHECK(gzip.begin(12, 4));
+    uint8_t small[20];
+    CHECK_EQ(gzip.compress(in.data(), in.size(), small, sizeof(small)), 0);
+    std::vector<uint8_t> out(in.size() * 2);
+    size_t size = gzip.compress(in.data(), in.size(), out.data(), out.size());  // Usable again after an overflow
+    CHECK(size > 0 && inflatesTo(out.data(), size, in.data(), in.size()));
+  }
+
+  // Not begun
+  {
+    GzipEncoder gzip;
+    uint8_t out[64];
+    CHECK_EQ(gzip.compress((const uint8_t*)"abc", 3, out, sizeof(out)), 0);
+  }
+
+  return testResult();
+}
@@ -0,0 +1,61 @@
+/**
+ * @file HostTest.h
+ * @brief Minimal checks for the host tests of the sketch code.
+ *
+ * This file contains the check macros shared by the host tests. A failed check
+ * prints its file, line and expression and the test goes on; `testResult()` at
+ * the end of `main()` reports the number of failed checks and gives the exit
+ * status for ctest.
+ */
+
+#ifndef HostTestCode
+#define HostTestCode
+
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static int TestFailures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      TestFailures++; \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+    } \
+  } while (0)
+
+#define CHECK_EQ(actual, expected) \
+  do { \
+    long long a_ = (long long)(actual), e_ = (long long)(expected); \
+    if (a_ != e_) { \
+      TestFailures++; \
+      printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #actual, #expected, a_, e_); \
+    } \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+  do { \
+    double a_ = (double)(actual), e_ = (double)(expected); \
+    if (!(fabs(a_ - e_) <= (double)(tolerance))) { \
+      TestFailures++; \
+      printf("%s:%d: CHECK_NEAR(%s, %s, %s) failed: %g != %g\n", __FILE__, __LINE__, #actual, #expected, #tolerance, a_, e_); \
+    } \
+  } while (0)
+
+// Exit status of the test: 0 if every check passed
+static inline int testResult() {
+  if (TestFailures > 0)
+    printf("%d check(s) failed\n", TestFailures);
+  else
+    printf("All checks passed\n");
+  return TestFailures > 0 ? 1 : 0;
+}
+
+// Monotonic time in nanoseconds, for the benchmarks
+static inline uint64_t nowNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif  // HostTestCode
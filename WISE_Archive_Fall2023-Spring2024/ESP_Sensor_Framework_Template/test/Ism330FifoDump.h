@@ -0,0 +1,97 @@
+/**
+ * @file Ism330FifoDump.h
+ * @brief Synthetic ISM330DHCX FIFO contents for the host tests.
+ *
+ * This file builds the words the ISM330DHCX FIFO would hold when batching the gyro
+ * and accelerometer with a timestamp every 8th slot, as configured by the sketch:
+ * every word is a tag byte (sensor tag in bits 7-3, slot counter in bits 2-1)
+ * followed by 6 data bytes. The values of slot `s` are given by `dumpSample(s)`, so
+ * a test can check every decoded sample; the gyro and accelerometer order varies
+ * and a temperature word is mixed in now and then, as the sensor may do.
+ */
+
+#ifndef Ism330FifoDumpCode
+#define Ism330FifoDumpCode
+
+#include <vector>
+#include "Ism330Fifo.h"
+
+static const uint8_t DumpGyroTag = 0x01;
+static const uint8_t DumpAccelTag = 0x02;
+static const uint8_t DumpTemperatureTag = 0x03;
+static const uint8_t DumpTimestampTag = 0x04;
+
+// Sensor values of slot `slot`
+inline Ism330RawSample dumpSample(uint32_t slot) {
+  Ism330RawSample sample;
+  sample.Gyro[0] = (int16_t)slot;
+  sample.Gyro[1] = (int16_t)-slot;
+  sample.Gyro[2] = (int16_t)(slot * 3);
+  sample.Accel[0] = (int16_t)(slot + 1);
+  sample.Accel[1] = (int16_t)(-slot - 1);
+  sample.Accel[2] = (int16_t)(slot * 7);
+  return sample;
+}
+
+struct Ism330FifoDump {
+  std::vector<uint8_t> Bytes;
+
+  void word(uint8_t tag, uint8_t counter, const uint8_t* data) {
+    Bytes.push_back((uint8_t)(tag << 3 | (counter & 0x03) << 1));
+    Bytes.insert(Bytes.end(), data, data + 6);
+  }
+
+  void axes(uint8_t tag, uint8_t counter, const int16_t* values) {
+    uint8_t data[6];
+    for (int i = 0; i < 3; i++) {
+      data[2 * i] = (uint8_t)values[i];
+      data[2 * i + 1] = (uint8_t)((uint16_t)values[i] >> 8);
+    }
+    word(tag, counter, data);
+  }
+
+  void timestamp(uint8_t counter, uint32_t ticks) {
+    uint8_t data[6] = { (uint8_t)ticks, (uint8_t)(ticks >> 8), (uint8_t)(ticks >> 16), (uint8_t)(ticks >> 24), 0, 0 };
+    word(DumpTimestampTag, counter, data);
+  }
+
+  /**
+   * @brief Appends slots `first` to `first + count - 1`.
+   *
+   * @param first Number of the first slot; slots that are a multiple of 8 start with a timestamp.
+   * @param count Number of slots.
+   * @param firstTicks Timestamp counter of slot 0.
+   * @param slotTicks Counter ticks between slots (48 at 833 Hz).
+   *
+   * @return void
+   */
+  void slots(uint32_t first, uint32_t count, uint32_t firstTicks, uint32_t slotTicks) {
+    for (uint32_t s = first; s < first + count; s++) {
+      uint8_t counter = (uint8_t)s;
+      if (s % 8 == 0)
+        timestamp(counter, firstTicks + slotTicks * s);
+      Ism330RawSample sample = dumpSample(s);
+      if (s % 5 == 0) {
+        axes(DumpAccelTag, counter, sample.Accel);
+        axes(DumpGyroTag, counter, sample.Gyro);
+      } else {
+        axes(DumpGyroTag, counter, sample.Gyro);
+        axes(DumpAccelTag, counter, sample.Accel);
+      }
+      if (s % 50 == 0) {
+        uint8_t temperature[6] = { 0x10, 0x02, 0, 0, 0, 0 };
+        word(DumpTemperatureTag, counter, temperature);
+      }
+    }
+  }
+
+  size_t words() const {
+    return Bytes.size() / Ism330FifoWordSize;
+  }
+
+  const uint8_t* at(size_t word) const {
+    return Bytes.data() + word * Ism330FifoWordSize;
+  }
+};
+
+#endif  // Ism330FifoDumpCode
@@ -0,0 +1,138 @@
+/**
+ * @file Ism330FifoTest.cpp
+ * @brief Ism330FifoDecoder and Ism330TickClock on synthetic FIFO contents.
+ *
+ * The FIFO words come from Ism330FifoDump.h: gyro and accelerometer words in
+ * either order, a timestamp word every 8th slot and a temperature word now and
+ * then, with the timestamp counter close to wrapping.
+ *
+ * - Bursts: the same words are decoded in bursts of every length from 1 to 20
+ *   words and of random lengths, so bursts end inside slots and between the
+ *   timestamp and the data of a slot. Every sample must come out once, in order,
+ *   with its values and timestamp, across the counter wrap.
+ * - Mid-stream start: decoding from the middle of a slot, as after a FIFO
+ *   overrun, skips the partial slot and the slots before the first timestamp.
+ * - Missing sensor: a slot without its accelerometer word is skipped.
+ * - Tick clock: counter ticks convert to monotonic time with the nominal 25 us
+ *   period, the INTERNAL_FREQ_FINE trim, and across the counter wrap.
+ */
+
+#include "HostTest.h"
+#include "Ism330FifoDump.h"
+#include <random>
+#include <vector>
+
+static const uint32_t FirstTicks = 0xFFFFF000u;  // Wraps after 85 slots
+static const uint32_t SlotTicks = 48;             // 833 Hz
+static const uint32_t Slots = 1000;
+
+struct Collector {
+  std::vector<Ism330FifoSample>* Samples;
+  void operator()(const Ism330FifoSample& sample) {
+    Samples->push_back(sample);
+  }
+};
+
+static bool matches(const Ism330FifoSample& sample, uint32_t slot) {
+  Ism330RawSample expected = dumpSample(slot);
+  for (int i = 0; i < 3; i++)
+    if (sample.Gyro[i] != expected.Gyro[i] || sample.Accel[i] != expected.Accel[i])
+      return false;
+  return sample.Ticks == FirstTicks + SlotTicks * slot;
+}
+
+// Decodes the dump in bursts of `burst(i)` words and checks every sample
+template<typename Burst>
+static void decodeInBursts(const Ism330FifoDump& dump, Burst burst, const char* name) {
+  Ism330FifoDecoder decoder;
+  decoder.begin(7);
+  std::vector<Ism330FifoSample> samples;
+  size_t word = 0, calls = 0;
+  while (word < dump.words()) {
+    size_t count = burst(calls++);
+    if (count > dump.words() - word)
+      count = dump.words() - word;
+    decoder.decode(dump.at(word), (uint16_t)count, Collector{ &samples });
+    word += count;
+  }
+
+  uint32_t errors = 0;
+  for (size_t i = 0; i < samples.size(); i++)
+    if (!matches(samples[i], (uint32_t)i))
+      errors++;
+  if (errors > 0 || samples.size() != Slots - 1)
+    printf("Bursts of %s words: %zu samples, %u wrong\n", name, samples.size(), errors);
+  CHECK_EQ(samples.size(), Slots - 1);  // The last slot waits for the next burst
+  CHECK_EQ(errors, 0);
+  CHECK_EQ(decoder.skipped(), 0);
+}
+
+static void bursts() {
+  Ism330FifoDump dump;
+  dump.slots(0, Slots, FirstTicks, SlotTicks);
+
+  for (size_t length = 1; length <= 20; length++) {
+    char name[8];
+    snprintf(name, sizeof(name), "%zu", length);
+    decodeInBursts(dump, [length](size_t) { return length; }, name);
+  }
+  std::mt19937 random(3);
+  decodeInBursts(dump, [&random](size_t) { return (size_t)(1 + random() % 40); }, "random");
+}
+
+static void midStream() {
+  Ism330FifoDump dump;
+  dump.slots(3, 100, FirstTicks, SlotTicks);
+  Ism330FifoDecoder decoder;
+  decoder.begin(7);
+  std::vector<Ism330FifoSample> samples;
+  decoder.decode(dump.at(1), (uint16_t)(dump.words() - 1), Collector{ &samples });  // From the second word of slot 3
+
+  CHECK_EQ(decoder.skipped(), 5);  // Slot 3 partly read, slots 4 to 7 before the timestamp of slot 8
+  CHECK_EQ(samples.size(), 103 - 8 - 1);
+  bool ordered = true;
+  for (size_t i = 0; i < samples.size(); i++)
+    ordered = ordered && matches(samples[i], (uint32_t)(8 + i));
+  CHECK(ordered);
+}
+
+static void missingSensor() {
+  Ism330FifoDump dump;
+  dump.slots(0, 2, FirstTicks, SlotTicks);
+  Ism330RawSample sample = dumpSample(2);
+  dump.axes(DumpGyroTag, 2, sample.Gyro);  // Slot 2 without its accelerometer word
+  dump.slots(3, 2, FirstTicks, SlotTicks);
+
+  Ism330FifoDecoder decoder;
+  decoder.begin(7);
+  std::vector<Ism330FifoSample> samples;
+  decoder.decode(dump.at(0), (uint16_t)dump.words(), Collector{ &samples });
+  CHECK_EQ(decoder.skipped(), 1);
+  CHECK_EQ(samples.size(), 3);
+  CHECK(samples.size() == 3 && matches(samples[0], 0) && matches(samples[1], 1) && matches(samples[2], 3));
+}
+
+static void tickClock() {
+  Ism330TickClock clock;
+  clock.begin(0);
+  clock.anchor(FirstTicks + 48000, 1000000);
+  CHECK_EQ(clock.monotonicAt(FirstTicks + 48000), 1000000);
+  CHECK_EQ(clock.monotonicAt(FirstTicks), 1000000 - 1200000);  // 48000 ticks of 25 us before, across the wrap
+  CHECK_EQ(clock.monotonicAt(FirstTicks + 48040), 1001000);
+
+  clock.begin(10);  // 1.5% fast
+  clock.anchor(5, 0);
+  CHECK_NEAR(clock.monotonicAt(40005), 1000000 / 1.015, 1);
+
+  clock.begin(-5);  // 0.75% slow
+  clock.anchor(0xFFFFFFF0u, 0);
+  CHECK_NEAR(clock.monotonicAt(0x10), 32 * 25 / 0.9925, 1);
+}
+
+int main() {
+  bursts();
+  midStream();
+  missingSensor();
+  tickClock();
+  return testResult();
+}
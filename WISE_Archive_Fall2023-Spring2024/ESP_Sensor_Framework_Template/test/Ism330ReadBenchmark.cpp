@@ -0,0 +1,172 @@
+/**
+ * @file Ism330ReadBenchmark.cpp
+ * @brief I2C bus time and CPU time of reading one ISM330DHCX sample.
+ *
+ * A mock I2C bus charges every read transaction its bus time: the address, the
+ * register and the repeated start (3 bytes) plus the data bytes, 9 bit times each,
+ * plus the start and stop conditions and an optional fixed overhead per
+ * transaction for the driver. Both versions read one sample and fill a
+ * `SampleFrame` with its six values:
+ *
+ * - getEvent: the former Adafruit `getEvent()` path; reads 14 bytes including the
+ *   temperature, converts everything to floats in three `sensors_event_t` structs
+ *   and copies the gyro and accelerometer values.
+ * - Raw: `readIsm330Raw()`; reads the 12 bytes from OUTX_L_G in one burst and adds
+ *   the int16 values with `SampleFrame::addRaw()`, scaled only when logged.
+ *
+ * The bus time and host CPU time per sample are printed at 400 kHz and 1 MHz, and
+ * the scaled raw values are checked against the getEvent values. Pass the number
+ * of samples as the first argument (default 2000000).
+ */
+
+#include "HostTest.h"
+#include "Ism330Fifo.h"
+#include "SampleTypes.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct MockBus {
+  double ClockHz;
+  double OverheadUs;  // Driver time per transaction
+  double BusUs = 0;
+  uint8_t Registers[128];
+
+  bool read(uint8_t reg, uint8_t* data, size_t length) {
+    BusUs += OverheadUs + ((3 + length) * 9 + 3) * 1e6 / ClockHz;
+    memcpy(data, Registers + reg, length);
+    Registers[ISM330_OUTX_L_G]++;  // A new reading every time
+    return true;
+  }
+};
+
+// sensors_event_t of the Adafruit Unified Sensor library
+struct sensors_vec_t {
+  float x, y, z;
+  int8_t status;
+  uint8_t reserved[3];
+};
+struct sensors_event_t {
+  int32_t version, sensor_id, type, reserved0, timestamp;
+  union {
+    float data[4];
+    sensors_vec_t acceleration;
+    sensors_vec_t gyro;
+    float temperature;
+  };
+};
+
+static const float GyroScale = 8.75f * 0.017453293f / 1000;  // 250 dps range, rad/s per LSB
+static const float AccelScale = 0.061f * 9.80665f / 1000;    // 2 g range, m/s^2 per LSB
+static volatile uint32_t FakeMillis = 0;
+
+__attribute__((noinline)) static void getEventRead(MockBus& bus, SampleFrame& frame) {
+  uint8_t data[14];
+  bus.read(ISM330_OUTX_L_G - 2, data, 14);  // OUT_TEMP_L to OUTZ_H_A
+  int16_t temperature, gyro[3], accel[3];
+  decodeIsm330Axes(data, &temperature, 1);
+  decodeIsm330Axes(data + 2, gyro, 3);
+  decodeIsm330Axes(data + 8, accel, 3);
+
+  sensors_event_t accelEvent, gyroEvent, temperatureEvent;
+  memset(&temperatureEvent, 0, sizeof(temperatureEvent));
+  temperatureEvent.version = sizeof(temperatureEvent);
+  temperatureEvent.type = 13;
+  temperatureEvent.timestamp = FakeMillis;
+  temperatureEvent.temperature = temperature / 256.0f + 25;
+  memset(&gyroEvent, 0, sizeof(gyroEvent));
+  gyroEvent.version = sizeof(gyroEvent);
+  gyroEvent.type = 4;
+  gyroEvent.timestamp = FakeMillis;
+  gyroEvent.gyro.x = gyro[0] * GyroScale;
+  gyroEvent.gyro.y = gyro[1] * GyroScale;
+  gyroEvent.gyro.z = gyro[2] * GyroScale;
+  memset(&accelEvent, 0, sizeof(accelEvent));
+  accelEvent.version = sizeof(accelEvent);
+  accelEvent.type = 1;
+  accelEvent.timestamp = FakeMillis;
+  accelEvent.acceleration.x = accel[0] * AccelScale;
+  accelEvent.acceleration.y = accel[1] * AccelScale;
+  accelEvent.acceleration.z = accel[2] * AccelScale;
+  asm volatile("" : : "r"(&temperatureEvent) : "memory");  // The temperature is filled in, then thrown away
+
+  frame.begin(0, 0);
+  frame.add(gyroEvent.gyro.x);
+  frame.add(gyroEvent.gyro.y);
+  frame.add(gyroEvent.gyro.z);
+  frame.add(accelEvent.acceleration.x);
+  frame.add(accelEvent.acceleration.y);
+  frame.add(accelEvent.acceleration.z);
+}
+
+__attribute__((noinline)) static void rawRead(MockBus& bus, SampleFrame& frame) {
+  uint8_t data[12];
+  bus.read(ISM330_OUTX_L_G, data, 12);
+  Ism330RawSample sample;
+  decodeIsm330Axes(data, sample.Gyro, 3);
+  decodeIsm330Axes(data + 6, sample.Accel, 3);
+
+  frame.begin(0, 0);
+  for (int i = 0; i < 3; i++)
+    frame.addRaw(sample.Gyro[i]);
+  for (int i = 0; i < 3; i++)
+    frame.addRaw(sample.Accel[i]);
+}
+
+static void fillRegisters(MockBus& bus) {
+  for (int i = 0; i < 128; i++)
+    bus.Registers[i] = (uint8_t)(i * 37 + 11);
+}
+
+// Bus time per sample, in microseconds; prints it with the CPU time
+template<typename Read>
+static double measure(const char* name, Read read, double clockHz, double overheadUs, uint32_t samples) {
+  MockBus bus;
+  bus.ClockHz = clockHz;
+  bus.OverheadUs = overheadUs;
+  fillRegisters(bus);
+  SampleFrame frame;
+  uint64_t begin = nowNs();
+  for (uint32_t i = 0; i < samples; i++) {
+    read(bus, frame);
+    asm volatile("" : : "r"(&frame) : "memory");
+  }
+  double ns = (double)(nowNs() - begin) / samples;
+  printf("%-8s %4.0f kHz, %2.0f us overhead: bus %6.1f us, CPU %5.1f ns per sample\n", name, clockHz / 1000, overheadUs, bus.BusUs / samples, ns);
+  return bus.BusUs / samples;
+}
+
+// The raw values, scaled as when they are logged, must equal the getEvent values
+static void checkValues() {
+  MockBus eventBus, rawBus;
+  eventBus.ClockHz = rawBus.ClockHz = 400000;
+  eventBus.OverheadUs = rawBus.OverheadUs = 0;
+  fillRegisters(eventBus);
+  fillRegisters(rawBus);
+  SampleFrame event, raw;
+  uint32_t errors = 0;
+  for (int i = 0; i < 1000; i++) {
+    getEventRead(eventBus, event);
+    rawRead(rawBus, raw);
+    for (uint8_t v = 0; v < 6; v++) {
+      float value = raw.Values[v].I * (v < 3 ? GyroScale : AccelScale);
+      if (raw.Values[v].Type != SampleValue::Raw || fabsf(value - event.Values[v].F) > 1e-6f * fabsf(value))
+        errors++;
+    }
+  }
+  CHECK_EQ(errors, 0);
+}
+
+int main(int argc, char** argv) {
+  uint32_t samples = argc > 1 ? (uint32_t)atol(argv[1]) : 2000000;
+  checkValues();
+  const double Clocks[] = { 400000, 1000000 };
+  const double Overheads[] = { 0, 50 };
+  for (double clockHz : Clocks)
+    for (double overheadUs : Overheads) {
+      double eventUs = measure("getEvent", getEventRead, clockHz, overheadUs, samples);
+      double rawUs = measure("Raw", rawRead, clockHz, overheadUs, samples);
+      CHECK(rawUs < eventUs);
+    }
+  return testResult();
+}
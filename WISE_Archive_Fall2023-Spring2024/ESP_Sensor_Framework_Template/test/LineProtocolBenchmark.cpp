@@ -0,0 +1,172 @@
+/**
+ * @file LineProtocolBenchmark.cpp
+ * @brief Time and bytes per point of Point objects and the LineProtocolBatch encoder.
+ *
+ * Builds batches of 250 ISM330DHCX points in two ways:
+ *
+ * - Point: like the InfluxDB client, one heap-allocated Point per reading holding
+ *   its measurement, tags, fields and timestamp as strings (floats formatted like
+ *   `String(value, 6)`), turned into a line when it is written and collected in
+ *   the client's batch, which is joined into the request body when sent.
+ *   `std::string` stands in for the Arduino String.
+ * - Batch: `LineProtocolBatch`, appending each point with cached, escaped names
+ *   into one reused buffer, as `logDataInflux()` does.
+ *
+ * The time, heap allocations (operator new) and bytes per point are printed, and
+ * the values of both bodies are compared. Pass the number of batches as the first
+ * argument (default 400).
+ */
+
+#include "HostTest.h"
+#include "LineProtocol.h"
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static size_t Allocations = 0;
+
+void* operator new(size_t size) {
+  Allocations++;
+  void* data = malloc(size ? size : 1);
+  if (data == nullptr)
+    throw std::bad_alloc();
+  return data;
+}
+void operator delete(void* data) noexcept {
+  free(data);
+}
+void operator delete(void* data, size_t) noexcept {
+  free(data);
+}
+
+static const uint16_t BatchPoints = 250;
+static const char* const Module = "Onboard Gyro/Accelerometer";
+static const char* const Device = "ESP32-Bench";
+static const char* const FieldNames[6] = { "Gyro X", "Gyro Y", "Gyro Z", "Accel X", "Accel Y", "Accel Z" };
+
+static std::string escape(const char* text, const char* special) {
+  std::string out;
+  for (; *text; text++) {
+    if (strchr(special, *text))
+      out += '\\';
+    out += *text;
+  }
+  return out;
+}
+
+// The InfluxDB client's Point, reduced to what the sketch used
+class Point {
+public:
+  explicit Point(const std::string& measurement)
+    : Measurement(escape(measurement.c_str(), ", ")) {}
+
+  void addTag(const std::string& name, const std::string& value) {
+    Tags += ',' + escape(name.c_str(), ",= ") + '=' + escape(value.c_str(), ",= ");
+  }
+  void addField(const std::string& name, float value, int precision) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f", precision, value);  // String(value, precision)
+    if (!Fields.empty())
+      Fields += ',';
+    Fields += escape(name.c_str(), ",= ") + '=' + text;
+  }
+  void setTime(unsigned long long timestamp) {
+    Timestamp = std::to_string(timestamp);
+  }
+  std::string toLineProtocol() const {
+    return Measurement + Tags + ' ' + Fields + ' ' + Timestamp;
+  }
+
+private:
+  std::string Measurement, Tags, Fields, Timestamp;
+};
+
+static float valueOf(uint32_t reading, uint8_t axis) {
+  uint32_t n = (reading * 6 + axis) * 2654435761u;
+  float noise = (float)(int32_t)((n ^ n >> 15) % 20000 - 10000) / 10000.0f;
+  return axis < 3 ? 0.4f * noise : (axis == 5 ? 9.80665f : 0.0f) + 0.05f * noise;
+}
+
+// Sum of all field values of a body, to compare the two encodings
+static double valueSum(const char* body) {
+  double sum = 0;
+  for (const char* line = body; *line; line = strchr(line, '\n') + 1) {
+    const char* fields = line;
+    while (*fields != ' ' || fields[-1] == '\\')
+      fields++;
+    const char* end = strchr(fields + 1, ' ');
+    for (const char* p = strchr(fields, '='); p != nullptr && p < end; p = strchr(p + 1, '='))
+      sum += atof(p + 1);
+  }
+  return sum;
+}
+
+int main(int argc, char** argv) {
+  uint32_t batches = argc > 1 ? (uint32_t)atol(argv[1]) : 400;
+  unsigned long long start = 1718000000000000ULL;
+
+  // Point objects, collected by the client and joined when sent
+  size_t allocations = Allocations, pointBytes = 0;
+  std::string pointBody;
+  uint64_t begin = nowNs();
+  for (uint32_t b = 0; b < batches; b++) {
+    std::vector<std::string> lines;
+    for (uint16_t i = 0; i < BatchPoints; i++) {
+      uint32_t r = b * BatchPoints + i;
+      Point* point = new Point(Module);
+      point->addTag("device", Device);
+      for (uint8_t axis = 0; axis < 6; axis++)
+        point->addField(FieldNames[axis], valueOf(r, axis), 6);
+      point->setTime(start + r * 1200ULL);
+      lines.push_back(point->toLineProtocol());
+      delete point;
+    }
+    pointBody.clear();
+    for (const std::string& line : lines)
+      pointBody += line + '\n';
+    pointBytes += pointBody.length();
+  }
+  double pointNs = (double)(nowNs() - begin) / ((double)batches * BatchPoints);
+  double pointAllocations = (double)(Allocations - allocations) / ((double)batches * BatchPoints);
+
+  // LineProtocolBatch with names escaped once
+  char prefix[96], keys[6][24];
+  size_t length = LineProtocolBatch::escapeMeasurement(prefix, sizeof(prefix), Module);
+  snprintf(prefix + length, sizeof(prefix) - length, ",device=%s", Device);
+  for (uint8_t axis = 0; axis < 6; axis++)
+    LineProtocolBatch::escapeKey(keys[axis], sizeof(keys[axis]), FieldNames[axis]);
+  LineProtocolBatch batch;
+  CHECK(batch.begin(BatchPoints * 192));
+
+  allocations = Allocations;
+  size_t batchBytes = 0;
+  begin = nowNs();
+  for (uint32_t b = 0; b < batches; b++) {
+    batch.clear();
+    for (uint16_t i = 0; i < BatchPoints; i++) {
+      uint32_t r = b * BatchPoints + i;
+      batch.beginPoint(prefix);
+      for (uint8_t axis = 0; axis < 6; axis++)
+        batch.addField(keys[axis], valueOf(r, axis), 6);
+      batch.endPoint(start + r * 1200ULL);
+    }
+    batchBytes += batch.length();
+  }
+  double batchNs = (double)(nowNs() - begin) / ((double)batches * BatchPoints);
+  double batchAllocations = (double)(Allocations - allocations) / ((double)batches * BatchPoints);
+
+  printf("%u batches of %u points\n", batches, BatchPoints);
+  printf("Point objects:     %6.0f ns, %4.1f allocations, %5.1f bytes per point\n", pointNs, pointAllocations, (double)pointBytes / ((double)batches * BatchPoints));
+  printf("LineProtocolBatch: %6.0f ns, %4.1f allocations, %5.1f bytes per point\n", batchNs, batchAllocations, (double)batchBytes / ((double)batches * BatchPoints));
+
+  // The last batch of both holds the same points
+  CHECK_EQ(batch.points(), BatchPoints);
+  CHECK_NEAR(valueSum(batch.data()), valueSum(pointBody.c_str()), 1e-3);
+  CHECK_EQ(batchAllocations, 0);
+  CHECK(batchBytes <= pointBytes);
+
+  free((void*)batch.data());
+  return testResult();
+}
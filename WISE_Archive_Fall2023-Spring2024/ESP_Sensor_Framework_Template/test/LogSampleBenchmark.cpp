@@ -0,0 +1,135 @@
+/**
+ * @file LogSampleBenchmark.cpp
+ * @brief Cost of logging a value with the old String overloads and the typed API.
+ *
+ * Both versions write the text line of the SD log for every value of one
+ * ISM330DHCX reading (six values) into the same preallocated buffer:
+ *
+ * - String: the former `logDataPoint(uS, S, String Module, String Sensor, float Value)`
+ *   chain; the names are copied into a String at every call and passed on by
+ *   value, the value is formatted with `dtostrf()` into a String, and the line is
+ *   concatenated before it is printed. `std::string` stands in for the Arduino
+ *   String; it keeps short strings without allocating, so on the ESP32 the old
+ *   version allocated at least as often as counted here.
+ * - Typed: `SampleFrame` values with the names taken from the sensor tables and
+ *   the line formatted on the stack, as `logDataSD()` does.
+ *
+ * The time and the heap allocations (operator new) per value are printed. Pass
+ * the number of readings as the first argument (default 200000).
+ */
+
+#include "HostTest.h"
+#include "SampleTypes.h"
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+static size_t Allocations = 0;
+
+void* operator new(size_t size) {
+  Allocations++;
+  void* data = malloc(size ? size : 1);
+  if (data == nullptr)
+    throw std::bad_alloc();
+  return data;
+}
+void operator delete(void* data) noexcept {
+  free(data);
+}
+void operator delete(void* data, size_t) noexcept {
+  free(data);
+}
+
+#define DEVICE "ESP32-Bench"
+
+static const char* const Module = "Onboard Gyro/Accelerometer";
+static const char* const FieldNames[6] = { "Gyro X", "Gyro Y", "Gyro Z", "Accel X", "Accel Y", "Accel Z" };
+
+static char Sink[1 << 16];
+static size_t SinkLength = 0;
+static size_t SinkBytes = 0;
+
+static void sinkWrite(const char* data, size_t length) {
+  if (SinkLength + length > sizeof(Sink))
+    SinkLength = 0;
+  memcpy(Sink + SinkLength, data, length);
+  SinkLength += length;
+  SinkBytes += length;
+}
+
+// The former String overloads (Functions.cpp before the typed API)
+typedef std::string String;
+
+static void dtostrf(double value, int width, unsigned int precision, char* out) {
+  sprintf(out, "%*.*f", width, precision, value);
+}
+
+static void logDataSD(unsigned long long uS, unsigned long long S, String Module, String Sensor, String Value) {
+  String data = String(DEVICE) + " - Time: " + std::to_string(S) + "S " + std::to_string(uS) + "uS - " + Module + ": " + Sensor + " - " + Value;
+  sinkWrite(data.c_str(), data.length());
+  sinkWrite("\r\n", 2);
+}
+
+static void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, String Value) {
+  logDataSD(uS, S, Module, Sensor, Value);
+}
+
+static void logDataPoint(unsigned long long uS, unsigned long long S, String Module, String Sensor, float Value) {
+  char buffer[20];
+  dtostrf(Value, 12, 6, buffer);
+  logDataPoint(uS, S, Module, Sensor, String(buffer));
+}
+
+// The typed version (logDataSD() of a SampleFrame)
+static void logFrameText(const SampleFrame& Frame) {
+  for (uint8_t i = 0; i < Frame.FieldCount; i++) {
+    char line[128];
+    int length = snprintf(line, sizeof(line), DEVICE " - Time: %lluS %lluuS - %s: %s - %.*f\r\n",
+                          (unsigned long long)(Frame.Timestamp / 1000000ULL), (unsigned long long)(Frame.Timestamp % 1000000ULL),
+                          Module, FieldNames[i], 6, Frame.Values[i].F);
+    if (length > 0 && (size_t)length < sizeof(line))
+      sinkWrite(line, length);
+  }
+}
+
+static float valueOf(uint32_t reading, uint8_t axis) {
+  return (float)((int32_t)(reading * 2654435761u >> 16) % 20000 - 10000) * (axis < 3 ? 0.0175f : 0.000598f);
+}
+
+int main(int argc, char** argv) {
+  uint32_t readings = argc > 1 ? (uint32_t)atol(argv[1]) : 200000;
+  uint64_t start = 1718000000000000ULL;
+
+  size_t allocations = Allocations;
+  SinkBytes = 0;
+  uint64_t begin = nowNs();
+  for (uint32_t r = 0; r < readings; r++) {
+    uint64_t timestamp = start + r * 1200ULL;
+    for (uint8_t axis = 0; axis < 6; axis++)
+      logDataPoint(timestamp % 1000000ULL, timestamp / 1000000ULL, Module, FieldNames[axis], valueOf(r, axis));
+  }
+  double stringNs = (double)(nowNs() - begin) / (readings * 6.0);
+  double stringAllocations = (double)(Allocations - allocations) / (readings * 6.0);
+  double stringBytes = (double)SinkBytes / (readings * 6.0);
+
+  allocations = Allocations;
+  SinkBytes = 0;
+  begin = nowNs();
+  for (uint32_t r = 0; r < readings; r++) {
+    SampleFrame frame;
+    frame.begin(0, start + r * 1200ULL);
+    for (uint8_t axis = 0; axis < 6; axis++)
+      frame.add(valueOf(r, axis));
+    logFrameText(frame);
+  }
+  double typedNs = (double)(nowNs() - begin) / (readings * 6.0);
+  double typedAllocations = (double)(Allocations - allocations) / (readings * 6.0);
+  double typedBytes = (double)SinkBytes / (readings * 6.0);
+
+  printf("%u readings of 6 values\n", readings);
+  printf("String overloads: %7.1f ns, %4.1f allocations, %5.1f bytes per value\n", stringNs, stringAllocations, stringBytes);
+  printf("Typed SampleFrame: %6.1f ns, %4.1f allocations, %5.1f bytes per value\n", typedNs, typedAllocations, typedBytes);
+  CHECK_EQ(typedAllocations, 0);
+  return testResult();
+}
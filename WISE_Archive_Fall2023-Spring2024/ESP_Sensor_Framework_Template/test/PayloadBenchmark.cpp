@@ -0,0 +1,111 @@
+/**
+ * @file PayloadBenchmark.cpp
+ * @brief Line protocol bytes of padded string fields and native numeric fields.
+ *
+ * Encodes the same ISM330DHCX readings (a sensor at rest: small gyro noise,
+ * gravity on Z) and RSSI readings in two ways:
+ *
+ * - String: every value formatted with `dtostrf(value, 12, 6)` and sent as an
+ *   Influx string field, `Gyro\ X="   -0.012345"`, as before the values kept
+ *   their type.
+ * - Native: float and integer fields written by `LineProtocolBatch`,
+ *   `Gyro\ X=-0.012345` and `RSSI=-67i`.
+ *
+ * The bytes per value and per point are printed. Every native float is also
+ * parsed back and must match the value to the written precision. Pass the number
+ * of readings as the first argument (default 100000).
+ */
+
+#include "HostTest.h"
+#include "LineProtocol.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const Prefix = "Onboard\\ Gyro/Accelerometer,device=ESP32-Bench";
+static const char* const FieldKeys[6] = { "Gyro\\ X", "Gyro\\ Y", "Gyro\\ Z", "Accel\\ X", "Accel\\ Y", "Accel\\ Z" };
+static const char* const RssiPrefix = "WiFi,device=ESP32-Bench";
+static const uint8_t Precision = 6;
+
+// Deterministic noise in [-1, 1)
+static float noise(uint32_t n) {
+  n = n * 2654435761u;
+  n ^= n >> 15;
+  return (float)(int32_t)(n % 20000 - 10000) / 10000.0f;
+}
+
+static float axisValue(uint32_t reading, uint8_t axis) {
+  if (axis < 3)
+    return 0.4f * noise(reading * 6 + axis);  // dps
+  return (axis == 5 ? 9.80665f : 0.0f) + 0.05f * noise(reading * 6 + axis);  // m/s^2
+}
+
+// One line with string fields, as the client wrote a Point with addField(String, String)
+static size_t stringLine(char* out, size_t size, const char* prefix, const char* const* keys, char (*texts)[20], uint8_t count, unsigned long long timestamp) {
+  size_t length = snprintf(out, size, "%s ", prefix);
+  for (uint8_t i = 0; i < count; i++)
+    length += snprintf(out + length, size - length, "%s%s=\"%s\"", i ? "," : "", keys[i], texts[i]);
+  length += snprintf(out + length, size - length, " %llu\n", timestamp);
+  return length;
+}
+
+int main(int argc, char** argv) {
+  uint32_t readings = argc > 1 ? (uint32_t)atol(argv[1]) : 100000;
+  unsigned long long start = 1718000000000000ULL;
+
+  LineProtocolBatch batch;
+  CHECK(batch.begin(512));
+  size_t stringBytes = 0, nativeBytes = 0, stringRssiBytes = 0, nativeRssiBytes = 0;
+  uint32_t inaccurate = 0;
+
+  for (uint32_t r = 0; r < readings; r++) {
+    unsigned long long timestamp = start + r * 1200ULL;
+    float values[6];
+    char texts[6][20];
+    for (uint8_t axis = 0; axis < 6; axis++) {
+      values[axis] = axisValue(r, axis);
+      snprintf(texts[axis], sizeof(texts[axis]), "%12.6f", values[axis]);  // dtostrf(Value, 12, 6, buffer)
+    }
+
+    char line[512];
+    stringBytes += stringLine(line, sizeof(line), Prefix, FieldKeys, texts, 6, timestamp);
+
+    batch.clear();
+    batch.beginPoint(Prefix);
+    for (uint8_t axis = 0; axis < 6; axis++)
+      batch.addField(FieldKeys[axis], values[axis], Precision);
+    CHECK(batch.endPoint(timestamp));
+    nativeBytes += batch.length();
+
+    // Parse the native values back
+    const char* text = batch.data() + strlen(Prefix);
+    for (uint8_t axis = 0; axis < 6; axis++) {
+      text = strchr(text, '=') + 1;
+      if (fabs(atof(text) - (double)values[axis]) > 0.5e-6 + 1e-7 * fabs(values[axis]))
+        inaccurate++;
+    }
+
+    // RSSI, an integer field
+    long rssi = -40 - (long)(r % 50);
+    const char* const rssiKey[1] = { "RSSI" };
+    char rssiText[1][20];
+    snprintf(rssiText[0], sizeof(rssiText[0]), "%ld", rssi);  // String(Value) of the long overload
+    stringRssiBytes += stringLine(line, sizeof(line), RssiPrefix, rssiKey, rssiText, 1, timestamp);
+    batch.clear();
+    batch.beginPoint(RssiPrefix);
+    batch.addField(rssiKey[0], rssi);
+    CHECK(batch.endPoint(timestamp));
+    nativeRssiBytes += batch.length();
+  }
+
+  printf("%u readings\n", readings);
+  printf("ISM330DHCX point, 6 fields: string %.1f bytes, native %.1f bytes (%.0f%% smaller)\n",
+         (double)stringBytes / readings, (double)nativeBytes / readings, 100.0 * (1.0 - (double)nativeBytes / stringBytes));
+  printf("  per value, with its key: string %.1f bytes, native %.1f bytes\n",
+         (double)(stringBytes - readings * (strlen(Prefix) + 18)) / (readings * 6.0), (double)(nativeBytes - readings * (strlen(Prefix) + 18)) / (readings * 6.0));
+  printf("RSSI point: string %.1f bytes, native %.1f bytes\n", (double)stringRssiBytes / readings, (double)nativeRssiBytes / readings);
+  CHECK_EQ(inaccurate, 0);
+  CHECK(nativeBytes < stringBytes);
+
+  free((void*)batch.data());
+  return testResult();
+}
@@ -0,0 +1,125 @@
+/**
+ * @file SampleRingTest.cpp
+ * @brief Two-thread stress test of SampleRing.
+ *
+ * A producer thread pushes numbered records into a small ring while the main
+ * thread pops them, so the indices wrap around the ring many times with both
+ * sides running at once. Each record carries a check value derived from its
+ * number, so a record read while it was being written shows up as well as a lost,
+ * repeated or reordered one.
+ *
+ * - Retrying: the producer retries a full ring, so every record must arrive, in
+ *   order, and each refused push is counted as dropped.
+ * - Dropping: the producer never retries, like the timer callback; the records
+ *   that arrive must still be in order and intact, and together with the dropped
+ *   count add up to the records pushed.
+ *
+ * Build with `-DSENSOR_TEST_SANITIZERS=thread` to also run it under
+ * ThreadSanitizer (see README.md).
+ */
+
+#include "HostTest.h"
+#include "SampleRing.h"
+#include <atomic>
+#include <thread>
+
+struct Record {
+  uint32_t Sequence;
+  uint32_t Check;
+  uint64_t Payload[3];  // Makes the record copy long enough to be interrupted
+};
+
+static Record makeRecord(uint32_t sequence) {
+  Record r;
+  r.Sequence = sequence;
+  r.Check = sequence * 2654435761u;
+  for (int i = 0; i < 3; i++)
+    r.Payload[i] = (uint64_t)sequence * (i + 3);
+  return r;
+}
+
+static bool intact(const Record& r) {
+  if (r.Check != r.Sequence * 2654435761u)
+    return false;
+  for (int i = 0; i < 3; i++)
+    if (r.Payload[i] != (uint64_t)r.Sequence * (i + 3))
+      return false;
+  return true;
+}
+
+static const uint32_t Records = 500000;
+
+static void retrying() {
+  static SampleRing<Record, 64> ring;
+  uint32_t refused = 0;
+  std::thread producer([&refused] {
+    for (uint32_t i = 0; i < Records;) {
+      if (ring.push(makeRecord(i))) {
+        i++;
+      } else {
+        refused++;
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t next = 0, errors = 0;
+  Record r;
+  while (next < Records) {
+    if (!ring.pop(r)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (r.Sequence != next || !intact(r))
+      errors++;
+    next = r.Sequence + 1;
+  }
+  producer.join();
+
+  CHECK_EQ(errors, 0);
+  CHECK_EQ(ring.dropped(), refused);
+  CHECK_EQ(ring.size(), 0);
+  CHECK(!ring.pop(r));
+}
+
+static void dropping() {
+  static SampleRing<Record, 64> ring;
+  std::atomic<bool> done{ false };
+  std::thread producer([&done] {
+    for (uint32_t i = 0; i < Records; i++) {
+      ring.push(makeRecord(i));
+      if (i % 100 == 0)
+        std::this_thread::yield();  // Lets the consumer keep up part of the time
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  uint32_t received = 0, errors = 0;
+  int64_t last = -1;
+  Record r;
+  for (;;) {
+    bool finished = done.load(std::memory_order_acquire);  // Read before popping, so nothing is left after the last pop
+    if (ring.pop(r)) {
+      if ((int64_t)r.Sequence <= last || !intact(r))
+        errors++;
+      last = r.Sequence;
+      received++;
+    } else if (finished) {
+      break;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+
+  printf("Dropping: %u of %u records received, %u dropped\n", received, Records, ring.dropped());
+  CHECK_EQ(errors, 0);
+  CHECK_EQ(received + ring.dropped(), Records);
+  CHECK(received > 0);
+}
+
+int main() {
+  retrying();
+  dropping();
+  return testResult();
+}
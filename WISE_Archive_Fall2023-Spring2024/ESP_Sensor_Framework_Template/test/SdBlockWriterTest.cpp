@@ -0,0 +1,192 @@
+/**
+ * @file SdBlockWriterTest.cpp
+ * @brief File system calls of the buffered SD log against opening the file per frame.
+ *
+ * 60 seconds of six-field ISM330DHCX frames at 100 Hz are logged as text lines
+ * to the in-memory file system (fakes/FS.h) twice:
+ *
+ * - Per frame: as `logDataSD()` did before the block writer; the file is opened
+ *   for every frame, each line is printed piece by piece, and the file is flushed
+ *   and closed again.
+ * - Blocks: the lines go through `SdBlockWriter` with the pool size of
+ *   Configuration.h, and a fake writer task handles the queued blocks as
+ *   `sdWriterTask()` does after every loop() iteration. loop() polls the flush
+ *   interval, and closes the file at the end.
+ *
+ * Both files must hold the same bytes. The block version must open and close the
+ * file once, make at most one write per block plus one per sync, write every full
+ * block on a block boundary of the file, and drop nothing. The calls of both are
+ * printed.
+ */
+
+#include "HostTest.h"
+#include "FS.h"
+#include "SdBlockWriter.h"
+#include <deque>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static const size_t BlockSize = 4096;  // SDBlockSize
+static const int Blocks = 4;           // SDBlockCount
+static const uint32_t FlushIntervalMs = 1000;
+static const uint32_t Frames = 6000;   // 60 s at 100 Hz
+static const char* const FieldNames[6] = { "Gyro X", "Gyro Y", "Gyro Z", "Accel X", "Accel Y", "Accel Z" };
+
+struct FsCalls {
+  uint32_t Opens = 0;
+  uint32_t Writes = 0;
+  uint32_t Flushes = 0;
+  uint32_t Closes = 0;
+};
+
+// Counts the calls on the fake file system by kind
+struct CountingFile {
+  fs::File File;
+  FsCalls* Calls;
+
+  void open(fs::FS& fs, const char* path) {
+    Calls->Opens++;
+    File = fs.open(path, FILE_APPEND);
+  }
+  bool write(const void* data, size_t length) {
+    Calls->Writes++;
+    return File.write((const uint8_t*)data, length) == length;
+  }
+  void print(const char* text) {
+    write(text, strlen(text));
+  }
+  void flush() {
+    Calls->Flushes++;
+  }
+  void close() {
+    Calls->Closes++;
+    File.close();
+  }
+};
+
+// Block pool with the interface of SdBlockQueue
+struct FakeQueue {
+  std::vector<uint8_t*> Free;
+  std::deque<SdBlock> Pending;
+
+  uint8_t* acquire() {
+    if (Free.empty())
+      return nullptr;
+    uint8_t* block = Free.back();
+    Free.pop_back();
+    return block;
+  }
+  bool submit(const SdBlock& block) {
+    Pending.push_back(block);
+    return true;
+  }
+  bool takeFailure() {
+    return false;
+  }
+};
+
+static float valueOf(uint32_t frame, uint8_t axis) {
+  return (float)((int32_t)(frame * 2654435761u >> 16) % 20000 - 10000) * (axis < 3 ? 0.0175f : 0.000598f);
+}
+
+static uint64_t timestampOf(uint32_t frame) {
+  return 1718000000000000ULL + frame * 10000ULL;
+}
+
+// The former logDataSD(): open, print every piece of every line, flush and close, for every frame
+static void perFrame(fs::FS& fs, FsCalls& calls) {
+  CountingFile file = { fs::File(), &calls };
+  for (uint32_t frame = 0; frame < Frames; frame++) {
+    file.open(fs, "/perframe.txt");
+    uint64_t timestamp = timestampOf(frame);
+    for (uint8_t axis = 0; axis < 6; axis++) {
+      char seconds[24], micros[24], value[24];
+      snprintf(seconds, sizeof(seconds), "%llu", (unsigned long long)(timestamp / 1000000ULL));
+      snprintf(micros, sizeof(micros), "%llu", (unsigned long long)(timestamp % 1000000ULL));
+      snprintf(value, sizeof(value), "%.6f", valueOf(frame, axis));
+      const char* const Pieces[] = { "ESP32 - Time: ", seconds, "S ", micros, "uS - ", "Onboard Gyro/Accelerometer", ": ", FieldNames[axis], " - ", value, "\r\n" };
+      for (const char* piece : Pieces)
+        file.print(piece);
+    }
+    file.flush();
+    file.close();
+  }
+}
+
+// The block writer, with a fake writer task that handles the queued blocks after every frame
+static void blocks(fs::FS& fs, FsCalls& calls, uint32_t& misaligned, uint32_t& dropped) {
+  std::vector<std::vector<uint8_t>> memory(Blocks, std::vector<uint8_t>(BlockSize));
+  FakeQueue queue;
+  for (std::vector<uint8_t>& block : memory)
+    queue.Free.push_back(block.data());
+  SdBlockWriter<BlockSize, FakeQueue> writer;
+  writer.setQueue(&queue);
+  CountingFile file = { fs::File(), &calls };
+  uint64_t offset = 0;
+
+  auto writerTask = [&]() {
+    while (!queue.Pending.empty()) {
+      SdBlock block = queue.Pending.front();
+      queue.Pending.pop_front();
+      if (block.Flags & SdBlockNewFile) {
+        file.open(fs, "/blocks.txt");
+        offset = 0;
+      }
+      if (block.Length > 0)
+        file.write(block.Data, block.Length);
+      offset += block.Length;
+      if (block.Length == BlockSize && offset % BlockSize != 0)
+        misaligned++;
+      if (block.Flags & SdBlockSync)
+        file.flush();
+      if (block.Flags & SdBlockClose)
+        file.close();
+      queue.Free.push_back(block.Data);
+    }
+  };
+
+  CHECK(writer.begin());
+  for (uint32_t frame = 0; frame < Frames; frame++) {
+    uint32_t nowMs = frame * 10;
+    uint64_t timestamp = timestampOf(frame);
+    for (uint8_t axis = 0; axis < 6; axis++) {
+      char line[128];
+      int length = snprintf(line, sizeof(line), "ESP32 - Time: %lluS %lluuS - %s: %s - %.6f\r\n",
+                            (unsigned long long)(timestamp / 1000000ULL), (unsigned long long)(timestamp % 1000000ULL),
+                            "Onboard Gyro/Accelerometer", FieldNames[axis], valueOf(frame, axis));
+      if (!writer.write(line, length, nowMs))
+        dropped++;
+    }
+    writer.poll(nowMs, FlushIntervalMs);
+    writerTask();
+  }
+  CHECK(writer.close());
+  writerTask();
+  dropped += writer.dropped();
+}
+
+int main() {
+  fs::FS fs;
+  FsCalls before, after;
+  uint32_t misaligned = 0, dropped = 0;
+  perFrame(fs, before);
+  blocks(fs, after, misaligned, dropped);
+
+  std::vector<uint8_t>& perFrameFile = fs::fakeStorage().Files["/perframe.txt"];
+  std::vector<uint8_t>& blockFile = fs::fakeStorage().Files["/blocks.txt"];
+  size_t fullBlocks = blockFile.size() / BlockSize;
+  printf("%u frames, %zu bytes\n", Frames, blockFile.size());
+  printf("Per frame: %6u opens, %6u writes, %4u flushes, %4u closes\n", before.Opens, before.Writes, before.Flushes, before.Closes);
+  printf("Blocks:    %6u opens, %6u writes, %4u syncs,   %4u closes (%zu full blocks)\n", after.Opens, after.Writes, after.Flushes, after.Closes, fullBlocks);
+
+  CHECK(perFrameFile == blockFile);
+  CHECK_EQ(before.Opens, Frames);
+  CHECK_EQ(after.Opens, 1);
+  CHECK_EQ(after.Closes, 1);
+  CHECK(after.Writes <= fullBlocks + 1 + after.Flushes);
+  CHECK(after.Flushes <= Frames * 10 / FlushIntervalMs + 1);
+  CHECK_EQ(misaligned, 0);
+  CHECK_EQ(dropped, 0);
+  return testResult();
+}
@@ -0,0 +1,165 @@
+/**
+ * @file SdLogDecoderTest.cpp
+ * @brief Round trip of binary SD logs through the SD_Log_Decoder tool.
+ *
+ * Encodes two log files with `SdLogEncoder`, as `logDataSD()` writes them: the
+ * first with a raw sensor and a sensor of integer and float fields, a scale
+ * change and gaps that need absolute timestamps; the second a new session whose
+ * last entry was torn by a power cut and followed by zeros. The built decoder
+ * (its path is the test's argument) is run on them with `--csv` and `--lp`, and
+ * its output must equal the CSV lines and the line protocol the sketch would have
+ * sent (built with `LineProtocolBatch`, as `transmitInfluxBuffer()` does), without
+ * the torn frame. The torn tail is reported with exit status 1; the intact file
+ * alone decodes with status 0.
+ */
+
+#include "HostTest.h"
+#include "SdLogFormat.h"
+#include "LineProtocol.h"
+#include <string>
+#include <sys/wait.h>
+#include <vector>
+
+static const char* DecoderPath;
+static const char* const Device = "Test Device";
+static const char* const Modules[] = { "Onboard Gyro/Accelerometer", "RSSI" };
+static const char* const FieldNames[2][3] = { { "Gyro X", "Gyro Y", "Gyro Z" }, { "RSSI", "Temp C" } };
+static LineProtocolBatch Expected;  // Line protocol of the frames that reached the file
+
+struct LogFile {
+  SdLogEncoder<2> Encoder;
+  std::vector<uint8_t> Bytes;
+  std::string Csv;
+  float Scale = 0.01f;
+
+  void header() {
+    uint8_t entry[64];
+    size_t length = Encoder.beginFile(entry, sizeof(entry), Device);
+    CHECK(length > 0);
+    Bytes.insert(Bytes.end(), entry, entry + length);
+  }
+
+  // Logs frame `n` of `sensor`, returns the length of its entry
+  size_t frame(uint8_t sensor, uint32_t n, uint64_t timestamp) {
+    SampleFrame frame;
+    frame.begin(sensor, timestamp);
+    float values[3];
+    long integer = 0;
+    if (sensor == 0) {
+      for (int i = 0; i < 3; i++) {
+        int16_t raw = (int16_t)(n * 37 - 500 + i * 1000);
+        frame.addRaw(raw);
+        values[i] = raw * Scale;
+      }
+    } else {
+      integer = -40 - (long)(n % 50);
+      values[1] = 20.0f + n * 0.125f;
+      frame.add(integer);
+      frame.add(values[1]);
+    }
+    uint8_t entry[128];
+    float scale = Scale;
+    size_t length = Encoder.encodeFrame(entry, sizeof(entry), frame, Modules[sensor], [sensor, scale](uint8_t i) {
+      SdLogField field = { FieldNames[sensor][i], sensor == 0 ? scale : 1.0f };
+      return field;
+    });
+    CHECK(length > 0);
+    Bytes.insert(Bytes.end(), entry, entry + length);
+    Encoder.commitFrame();
+
+    char prefix[128], key[32];
+    LineProtocolBatch::escapeMeasurement(prefix, sizeof(prefix), Modules[sensor]);
+    std::string point = std::string(prefix) + ",device=";
+    LineProtocolBatch::escapeKey(prefix, sizeof(prefix), Device);
+    point += prefix;
+    Expected.beginPoint(point.c_str());
+    for (int i = 0; i < (sensor == 0 ? 3 : 2); i++) {
+      LineProtocolBatch::escapeKey(key, sizeof(key), FieldNames[sensor][i]);
+      char line[160];
+      if (sensor == 1 && i == 0) {
+        Expected.addField(key, integer);
+        snprintf(line, sizeof(line), "%s,%s,%s,%llu,%ld\n", Device, Modules[sensor], FieldNames[sensor][i], (unsigned long long)timestamp, integer);
+      } else {
+        Expected.addField(key, values[i], 6);
+        snprintf(line, sizeof(line), "%s,%s,%s,%llu,%.6f\n", Device, Modules[sensor], FieldNames[sensor][i], (unsigned long long)timestamp, values[i]);
+      }
+      Csv += line;
+    }
+    CHECK(Expected.endPoint(timestamp));
+    return length;
+  }
+
+  void save(const char* path) const {
+    FILE* file = fopen(path, "wb");
+    CHECK(file != nullptr);
+    if (!file)
+      return;
+    CHECK_EQ(fwrite(Bytes.data(), 1, Bytes.size(), file), Bytes.size());
+    fclose(file);
+  }
+};
+
+static std::string readText(const char* path) {
+  std::string text;
+  FILE* file = fopen(path, "rb");
+  if (!file)
+    return text;
+  char buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    text.append(buffer, read);
+  fclose(file);
+  return text;
+}
+
+// Runs the decoder, returns its exit status
+static int decodeFiles(const char* format, const char* output, const char* files) {
+  std::string command = std::string("\"") + DecoderPath + "\" " + format + " -o " + output + " " + files;
+  int status = system(command.c_str());
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("Usage: %s <SD_Log_Decoder>\n", argv[0]);
+    return 2;
+  }
+  DecoderPath = argv[1];
+  CHECK(Expected.begin(1 << 20));
+
+  uint64_t timestamp = 1718000000000000ULL;
+  LogFile first;
+  first.header();
+  for (uint32_t n = 0; n < 300; n++) {
+    timestamp += n % 97 == 96 ? 250000 : 1200 + n % 7;  // Now and then more than a 16 bit delta
+    if (n == 150)
+      first.Scale = 0.02f;  // Defines the sensor again
+    first.frame(n % 10 == 9 ? 1 : 0, n, timestamp);
+  }
+  first.save("SdLogDecoderTest_1.bin");
+  std::string firstLp(Expected.data(), Expected.length());
+
+  LogFile second;
+  second.header();
+  for (uint32_t n = 0; n < 40; n++)
+    second.frame(n % 4 == 3 ? 1 : 0, n, timestamp += 1200);
+  std::string expectedLp(Expected.data(), Expected.length());
+  std::string expectedCsv = "device,module,field,timestamp_us,value\n" + first.Csv + second.Csv;
+  size_t torn = second.frame(0, 40, timestamp += 1200);  // Cut short by a power cut
+  second.Bytes.resize(second.Bytes.size() - torn / 2);
+  size_t tail = torn - torn / 2 + 512;
+  second.Bytes.resize(second.Bytes.size() + 512, 0);
+  second.save("SdLogDecoderTest_2.bin");
+
+  CHECK_EQ(decodeFiles("--csv", "SdLogDecoderTest.csv", "SdLogDecoderTest_1.bin SdLogDecoderTest_2.bin"), 1);
+  std::string csv = readText("SdLogDecoderTest.csv");
+  CHECK(csv == expectedCsv);
+  CHECK_EQ(decodeFiles("--lp", "SdLogDecoderTest.lp", "SdLogDecoderTest_1.bin SdLogDecoderTest_2.bin"), 1);
+  std::string lp = readText("SdLogDecoderTest.lp");
+  CHECK(lp == expectedLp);
+  CHECK_EQ(decodeFiles("--lp", "SdLogDecoderTest.lp", "SdLogDecoderTest_1.bin"), 0);
+  CHECK(readText("SdLogDecoderTest.lp") == firstLp);
+
+  printf("Decoded %zu CSV bytes and %zu line protocol bytes, %zu byte torn tail\n", csv.size(), lp.size(), tail);
+  return testResult();
+}
@@ -0,0 +1,303 @@
+/**
+ * @file SdLogFormatTest.cpp
+ * @brief The binary SD log encoder when entries are dropped before the file.
+ *
+ * `logDataSD()` drops an entry when no SD block is free, and only commits the
+ * encoder state of the entries that were written. The test encodes frames of two
+ * sensors, drops the entries at chosen points (the first frame after a file
+ * header, the frame after a scale change, frames in the middle of a sequence and
+ * runs of frames), and decodes the written entries with a small decoder that
+ * follows the format described in SdLogFormat.h:
+ *
+ * - Every written frame must decode to its exact timestamp and values; a frame
+ *   that refers to a definition or a previous timestamp that never reached the
+ *   file fails to decode.
+ * - A new file header defines every sensor again.
+ *
+ * `sdLogValidEnd()`, which `recoverDataLogSD()` uses to truncate a file after its
+ * last intact entry at boot, is checked on the tail of an encoded file cut at
+ * every byte (a torn write), followed by zeros (clusters allocated but never
+ * written) or by random junk, with a corrupt entry in the middle, and on windows
+ * that start at every byte, in the middle of an entry too. The truncated file must
+ * still decode and take new entries.
+ */
+
+#include "HostTest.h"
+#include "SdLogFormat.h"
+#include <random>
+#include <vector>
+
+static const char* const FieldNames[] = { "X", "Y", "Z" };
+
+struct Decoded {
+  uint8_t Sensor;
+  uint64_t Timestamp;
+  std::vector<double> Values;
+};
+
+// Decodes every entry of `file`; `false` at the first entry or record it can not decode
+static bool decode(const std::vector<uint8_t>& file, std::vector<Decoded>& frames) {
+  struct Definition {
+    bool Defined = false;
+    bool HaveTimestamp = false;
+    uint64_t LastUs = 0;
+    std::vector<uint8_t> Types;
+    std::vector<float> Scales;
+  } sensors[SdLogMaxSensors];
+
+  size_t position = 0;
+  while (position < file.size()) {
+    size_t entry = sdLogEntryLength(file.data() + position, file.size() - position);
+    if (entry == 0)
+      return false;
+    const uint8_t* p = file.data() + position + 2;
+    const uint8_t* end = file.data() + position + entry - 4;
+    position += entry;
+    while (p < end) {
+      uint8_t tag = *p++;
+      if (tag == SdLogFileTag) {
+        p += 5;
+        p += 1 + *p;
+        for (Definition& sensor : sensors)
+          sensor = Definition();
+      } else if (tag == SdLogSensorTag) {
+        Definition& sensor = sensors[*p++];
+        p += 1 + *p;
+        uint8_t count = *p++;
+        sensor = Definition();
+        for (uint8_t i = 0; i < count; i++) {
+          float scale;
+          sensor.Types.push_back(*p++);
+          memcpy(&scale, p, 4);
+          sensor.Scales.push_back(scale);
+          p += 4;
+          p += 1 + *p;
+        }
+        sensor.Defined = true;
+      } else {
+        Decoded frame;
+        frame.Sensor = tag & ~SdLogAbsoluteFlag;
+        Definition& sensor = sensors[frame.Sensor];
+        if (!sensor.Defined)
+          return false;
+        if (tag & SdLogAbsoluteFlag) {
+          memcpy(&frame.Timestamp, p, 8);
+          p += 8;
+        } else {
+          uint16_t delta;
+          memcpy(&delta, p, 2);
+          p += 2;
+          if (!sensor.HaveTimestamp)
+            return false;
+          frame.Timestamp = sensor.LastUs + delta;
+        }
+        sensor.LastUs = frame.Timestamp;
+        sensor.HaveTimestamp = true;
+        for (size_t i = 0; i < sensor.Types.size(); i++) {
+          if (sensor.Types[i] == SdLogRaw) {
+            int16_t value;
+            memcpy(&value, p, 2);
+            frame.Values.push_back(value * (double)sensor.Scales[i]);
+          } else if (sensor.Types[i] == SdLogFloat) {
+            float value;
+            memcpy(&value, p, 4);
+            frame.Values.push_back(value);
+          } else {
+            int32_t value;
+            memcpy(&value, p, 4);
+            frame.Values.push_back(value);
+          }
+          p += sdLogValueSize(sensor.Types[i]);
+        }
+        frames.push_back(frame);
+      }
+    }
+    if (p != end)
+      return false;
+  }
+  return true;
+}
+
+struct Log {
+  SdLogEncoder<2> Encoder;
+  std::vector<uint8_t> File;
+  std::vector<Decoded> Expected;
+  float Scale = 0.5f;
+
+  void header(bool write) {
+    uint8_t entry[64];
+    size_t length = Encoder.beginFile(entry, sizeof(entry), "test");
+    CHECK(length > 0);
+    if (write)
+      File.insert(File.end(), entry, entry + length);
+  }
+
+  // Encodes frame `n` of `sensor`; only a written entry is committed, as in logDataSD()
+  void frame(uint8_t sensor, uint32_t n, bool write) {
+    SampleFrame frame;
+    Decoded expected;
+    expected.Sensor = sensor;
+    expected.Timestamp = 1718000000000000ULL + n * 10000ULL + sensor * 3;
+    frame.begin(sensor, expected.Timestamp);
+    if (sensor == 0) {
+      for (int i = 0; i < 3; i++) {
+        frame.addRaw((int16_t)(n * 7 + i));
+        expected.Values.push_back((n * 7 + i) * (double)Scale);
+      }
+    } else {
+      frame.add(n * 0.25f);
+      frame.add((long)n * -3);
+      expected.Values.push_back(n * 0.25f);
+      expected.Values.push_back(n * -3.0);
+    }
+    uint8_t entry[128];
+    float scale = Scale;
+    size_t length = Encoder.encodeFrame(entry, sizeof(entry), frame, sensor == 0 ? "Raw" : "Mixed", [scale](uint8_t i) {
+      SdLogField field = { FieldNames[i], scale };
+      return field;
+    });
+    CHECK(length > 0);
+    if (!write)
+      return;
+    File.insert(File.end(), entry, entry + length);
+    Encoder.commitFrame();
+    Expected.push_back(expected);
+  }
+};
+
+static bool decodesAsExpected(const Log& log) {
+  std::vector<Decoded> frames;
+  if (!decode(log.File, frames) || frames.size() != log.Expected.size())
+    return false;
+  for (size_t i = 0; i < frames.size(); i++) {
+    const Decoded& a = frames[i];
+    const Decoded& e = log.Expected[i];
+    if (a.Sensor != e.Sensor || a.Timestamp != e.Timestamp || a.Values != e.Values)
+      return false;
+  }
+  return true;
+}
+
+static void droppedEntries() {
+  Log log;
+  log.header(true);
+  log.frame(0, 0, false);  // Definition and absolute timestamp dropped
+  log.frame(1, 0, false);
+  log.frame(0, 1, true);
+  log.frame(1, 1, true);
+  log.frame(0, 2, true);
+  log.frame(0, 3, false);  // Delta dropped
+  log.frame(0, 4, true);
+  for (uint32_t n = 5; n < 20; n++)  // A run of drops longer than a 16 bit delta
+    log.frame(0, n, false);
+  log.frame(0, 20, true);
+  log.Scale = 0.25f;
+  log.frame(0, 21, false);  // New definition dropped
+  log.frame(0, 22, true);
+  log.frame(1, 2, true);
+  CHECK(decodesAsExpected(log));
+  printf("Dropped entries: %zu frames written, %zu bytes\n", log.Expected.size(), log.File.size());
+}
+
+static void newFile() {
+  Log log;
+  log.header(true);
+  log.frame(0, 0, true);
+  log.frame(1, 0, true);
+  log.File.clear();  // The writer task lost the file, loop() starts a new one
+  log.Expected.clear();
+  log.header(true);
+  log.frame(0, 1, true);
+  log.frame(1, 1, true);
+  CHECK(decodesAsExpected(log));
+}
+
+// Tail check as in recoverDataLogSD(): `end` is relative to `from`, SIZE_MAX if no intact entry was found
+static size_t tailEnd(const std::vector<uint8_t>& file, size_t from, size_t to) {
+  size_t end = SIZE_MAX;
+  if (!sdLogValidEnd(file.data() + from, to - from, end))
+    return SIZE_MAX;
+  return end;
+}
+
+static void validEnd() {
+  Log log;
+  log.header(true);
+  for (uint32_t n = 0; n < 40; n++)
+    log.frame(n % 3 == 0 ? 1 : 0, n, true);
+  const std::vector<uint8_t> intact = log.File;
+  std::vector<size_t> starts;  // Offsets of the entries
+  for (size_t position = 0; position < intact.size(); position += sdLogEntryLength(intact.data() + position, intact.size() - position))
+    starts.push_back(position);
+  starts.push_back(intact.size());
+
+  // Torn write: cut at every byte, the end is that of the last complete entry
+  uint32_t wrong = 0;
+  for (size_t cut = 1; cut <= intact.size(); cut++) {
+    size_t expected = 0;
+    for (size_t start : starts)
+      if (start <= cut)
+        expected = start;
+    size_t end = tailEnd(intact, 0, cut);
+    if (expected == 0 ? end != SIZE_MAX : end != expected)
+      wrong++;
+  }
+  CHECK_EQ(wrong, 0);
+
+  std::vector<uint8_t> file = intact;
+  file.resize(intact.size() + 4096, 0);  // Zero-filled tail
+  CHECK_EQ(tailEnd(file, 0, file.size()), intact.size());
+  std::vector<uint8_t> zeros(4096, 0);
+  CHECK_EQ(tailEnd(zeros, 0, zeros.size()), SIZE_MAX);
+
+  std::mt19937 random(5);
+  file = intact;
+  for (int i = 0; i < 4096; i++)  // Junk tail
+    file.push_back((uint8_t)random());
+  CHECK_EQ(tailEnd(file, 0, file.size()), intact.size());
+  std::vector<uint8_t> junk(file.begin() + intact.size(), file.end());
+  CHECK_EQ(tailEnd(junk, 0, junk.size()), SIZE_MAX);
+
+  file = intact;
+  file[starts[starts.size() / 2] + 4] ^= 0x10;  // Corrupt entry in the middle is skipped
+  CHECK_EQ(tailEnd(file, 0, file.size()), intact.size());
+
+  // Windows starting at every byte, over a torn tail: found once a whole entry is inside
+  file = intact;
+  size_t lastStart = starts[starts.size() - 2];
+  file.resize(lastStart + 5);
+  file.resize(file.size() + 512, 0);
+  wrong = 0;
+  uint32_t midEntry = 0;
+  for (size_t from = 0; from < file.size(); from++) {
+    bool whole = false;
+    for (size_t i = 0; i + 1 < starts.size() - 1; i++)
+      whole = whole || (starts[i] >= from && starts[i + 1] <= lastStart);
+    size_t end = tailEnd(file, from, file.size());
+    if (whole ? end != lastStart - from : end != SIZE_MAX)
+      wrong++;
+    bool boundary = false;
+    for (size_t start : starts)
+      boundary = boundary || start == from;
+    midEntry += whole && !boundary ? 1 : 0;
+  }
+  CHECK_EQ(wrong, 0);
+  CHECK(midEntry > 0);
+
+  // recoverDataLogSD() truncates there; the next session appends to the file
+  file.resize(tailEnd(file, 0, file.size()));
+  log.File = file;
+  log.Expected.resize(log.Expected.size() - 1);  // The torn frame
+  log.header(true);
+  log.frame(0, 40, true);
+  log.frame(1, 40, true);
+  CHECK(decodesAsExpected(log));
+  printf("Valid end: %zu entries, %zu byte file\n", starts.size() - 1, intact.size());
+}
+
+int main() {
+  droppedEntries();
+  newFile();
+  validEnd();
+  return testResult();
+}
@@ -0,0 +1,106 @@
+/**
+ * @file SensorCommandTest.cpp
+ * @brief The remote sensor command parser and SensorControlState.
+ *
+ * - Parser: the `NODE_RED_*` verbs with and without a sensor, sensor names with
+ *   spaces and in any case, rates, extra spaces, and malformed commands (unknown
+ *   verbs and sensors, a reset with an argument, missing, negative, zero or
+ *   non-numeric rates).
+ * - State: a sequence of commands applied to one sensor, checking the action the
+ *   sketch takes, whether the sensor runs and its rate after each: starting a
+ *   running sensor and stopping a stopped one do nothing, a rate set while stopped
+ *   is kept for the next start, and rates outside the range are rejected.
+ */
+
+#include "HostTest.h"
+#include "SensorCommand.h"
+#include <math.h>
+
+static const char* const SensorNames[] = { "Onboard Gyro/Accelerometer", "RSSI" };
+static const char* const Verbs[SensorCommandTypes] = { "", "reset", "start", "stop", "rate" };
+
+static const char* nameOf(uint8_t sensor) {
+  return SensorNames[sensor];
+}
+
+static bool parses(const char* payload, SensorCommandType type, uint8_t sensor = SensorCommandAll, float rateHz = 0) {
+  SensorCommand command = parseSensorCommand(payload, Verbs, 2, nameOf);
+  bool ok = command.Type == type && (type == SensorCommandUnknown || (command.Sensor == sensor && (type != SensorCommandRate || fabsf(command.RateHz - rateHz) < 1e-6f)));
+  if (!ok)
+    printf("\"%s\" parsed as type %u, sensor %u, rate %g\n", payload, command.Type, command.Sensor, command.RateHz);
+  return ok;
+}
+
+static void parser() {
+  CHECK(parses("start", SensorCommandStart));
+  CHECK(parses(" stop ", SensorCommandStop));
+  CHECK(parses("reset", SensorCommandReset));
+  CHECK(parses("STOP rssi", SensorCommandStop, 1));
+  CHECK(parses("start Onboard Gyro/Accelerometer", SensorCommandStart, 0));
+  CHECK(parses("stop onboard gyro/accelerometer", SensorCommandStop, 0));
+  CHECK(parses("rate RSSI 0.2", SensorCommandRate, 1, 0.2f));
+  CHECK(parses("rate Onboard Gyro/Accelerometer 52", SensorCommandRate, 0, 52));
+  CHECK(parses("rate  RSSI   3 ", SensorCommandRate, 1, 3));
+
+  CHECK(parses("reset RSSI", SensorCommandUnknown));  // Reset restarts the whole device
+  CHECK(parses("stop Onboard  Gyro/Accelerometer", SensorCommandUnknown));
+  CHECK(parses("stop Onboard", SensorCommandUnknown));
+  CHECK(parses("stop RSS", SensorCommandUnknown));
+  CHECK(parses("stop RSSIX", SensorCommandUnknown));
+  CHECK(parses("rate RSSI", SensorCommandUnknown));
+  CHECK(parses("rate 5", SensorCommandUnknown));
+  CHECK(parses("rate", SensorCommandUnknown));
+  CHECK(parses("rate RSSI abc", SensorCommandUnknown));
+  CHECK(parses("rate RSSI 5Hz", SensorCommandUnknown));
+  CHECK(parses("rate RSSI -1", SensorCommandUnknown));
+  CHECK(parses("rate RSSI 0", SensorCommandUnknown));
+  CHECK(parses("rate RSSI nan", SensorCommandUnknown));
+  CHECK(parses("rate RSSI 12345678901234567890", SensorCommandUnknown));
+  CHECK(parses("", SensorCommandUnknown));
+  CHECK(parses("starts", SensorCommandUnknown));
+  CHECK(parses("Device connected.", SensorCommandUnknown));
+}
+
+struct Step {
+  SensorCommandType Type;
+  float RateHz;
+  SensorAction Action;
+  bool Running;
+  float StateHz;
+};
+
+static void state() {
+  SensorControlState control;
+  control.begin(104, 0.001f, 104);
+  const Step Steps[] = {
+    { SensorCommandStart, 0, SensorActionNone, true, 104 },     // Already running
+    { SensorCommandRate, 208, SensorActionRejected, true, 104 },
+    { SensorCommandRate, 52, SensorActionSetRate, true, 52 },
+    { SensorCommandRate, 52, SensorActionNone, true, 52 },      // Already at that rate
+    { SensorCommandStop, 0, SensorActionStop, false, 52 },
+    { SensorCommandStop, 0, SensorActionNone, false, 52 },      // Already stopped
+    { SensorCommandRate, 13, SensorActionNone, false, 13 },     // Kept for the next start
+    { SensorCommandRate, 0.0001f, SensorActionRejected, false, 13 },
+    { SensorCommandStart, 0, SensorActionStart, true, 13 },     // Starts at the kept rate
+    { SensorCommandRate, 104, SensorActionSetRate, true, 104 },
+    { SensorCommandReset, 0, SensorActionNone, true, 104 },     // Handled by the sketch, not per sensor
+  };
+  for (const Step& step : Steps) {
+    SensorAction action = control.apply(step.Type, step.RateHz);
+    if (action != step.Action || control.running() != step.Running || control.rateHz() != step.StateHz)
+      printf("Command %u at %g Hz: action %u, running %d, %g Hz\n", step.Type, step.RateHz, action, control.running(), control.rateHz());
+    CHECK_EQ(action, step.Action);
+    CHECK_EQ(control.running(), step.Running);
+    CHECK(control.rateHz() == step.StateHz);
+  }
+
+  control.applied(104.2f);  // Rounded to a sensor data rate above the range
+  CHECK_EQ(control.apply(SensorCommandRate, 104.2f), SensorActionRejected);
+  CHECK(control.rateHz() == 104.2f);
+}
+
+int main() {
+  parser();
+  state();
+  return testResult();
+}
@@ -0,0 +1,289 @@
+/**
+ * @file SpillQueueTest.cpp
+ * @brief SpillQueue on an in-memory file system, with a fake Influx server.
+ *
+ * Uses the fake `fs::FS` of fakes/FS.h:
+ *
+ * - Limits: a full queue drops its oldest segments, a batch larger than the
+ *   limit is dropped.
+ * - Boot: the queue is rebuilt from the directory, with either style of listed
+ *   names; a segment torn by a power cut (left under its temporary name) is
+ *   removed, other files are ignored.
+ * - Failures: a short write leaves no segment behind, a segment removed from
+ *   outside is skipped.
+ * - Outage: a fake server fails every write for a while; the batches are stored
+ *   as `influxTransmitTask()` does and replayed, oldest first, by the same steps
+ *   as `replayInfluxSpill()` once writes succeed, one per live batch. Every batch
+ *   must reach the server exactly once and unchanged, the stored ones in order;
+ *   a rejected batch (HTTP 400) is discarded instead of retried.
+ * - Throttled: after an outage the batch controller sends small live batches more
+ *   often than `InfluxSpillReplayIntervalMs`. Replaying only when no live batch
+ *   arrived for that long never drains the queue; replaying one stored batch after
+ *   every live write drains it without delaying the live batches.
+ */
+
+#include "HostTest.h"
+#include <FS.h>
+#include "SpillQueue.h"
+#include <vector>
+
+static fs::FS Flash;
+
+static std::vector<uint8_t> batchBody(uint32_t number, size_t length) {
+  std::vector<uint8_t> body(length);
+  for (size_t i = 0; i < length; i++)
+    body[i] = (uint8_t)(number * 31 + i);
+  return body;
+}
+
+static void limits() {
+  fs::fakeStorage().reset();
+  SpillQueue queue;
+  CHECK(queue.begin(Flash, "/spill", 1000));
+  CHECK(queue.empty());
+
+  std::vector<uint8_t> body = batchBody(0, 400);
+  for (int i = 0; i < 5; i++)
+    CHECK(queue.push(body.data(), 300, i % 2 == 1));
+  CHECK_EQ(queue.depth(), 3);  // The two oldest were dropped to make room
+  CHECK_EQ(queue.bytes(), 900);
+  CHECK_EQ(queue.dropped(), 2);
+  CHECK_EQ(queue.spilled(), 5);
+  CHECK(fs::fakeStorage().Files.count("/spill/0000000002.lp") == 1);
+  CHECK(fs::fakeStorage().Files.count("/spill/0000000003.gz") == 1);
+
+  std::vector<uint8_t> large(1001);
+  CHECK(!queue.push(large.data(), large.size(), false));
+  CHECK_EQ(queue.dropped(), 3);
+  CHECK_EQ(queue.depth(), 3);
+}
+
+static void boot(bool fullPathNames) {
+  fs::fakeStorage().reset();
+  fs::fakeStorage().FullPathNames = fullPathNames;
+  std::vector<uint8_t> body = batchBody(0, 300);
+  {
+    SpillQueue queue;
+    CHECK(queue.begin(Flash, "/spill", 1000));
+    for (int i = 0; i < 3; i++)
+      CHECK(queue.push(body.data(), body.size(), i == 1));
+  }
+  fs::fakeStorage().Files["/spill/0000000003.tmp"] = std::vector<uint8_t>(10);  // Torn by a power cut
+  fs::fakeStorage().Files["/spill/notes.txt"] = std::vector<uint8_t>(5);
+
+  SpillQueue queue;
+  CHECK(queue.begin(Flash, "/spill", 1000));
+  CHECK_EQ(queue.depth(), 3);
+  CHECK_EQ(queue.bytes(), 900);
+  CHECK(fs::fakeStorage().Files.count("/spill/0000000003.tmp") == 0);
+  CHECK(fs::fakeStorage().Files.count("/spill/notes.txt") == 1);
+
+  for (uint32_t expected = 0; expected < 3; expected++) {
+    bool compressed = false;
+    fs::File file = queue.openOldest(compressed);
+    CHECK(file);
+    CHECK_EQ(compressed, expected == 1);
+    size_t length = file.size();
+    CHECK_EQ(length, 300);
+    file.close();
+    queue.pop(length);
+  }
+  CHECK(queue.empty());
+  CHECK_EQ(queue.replayed(), 3);
+  CHECK_EQ(queue.replayedBytes(), 900);
+
+  CHECK(queue.push(body.data(), 100, false));  // Continues the numbering
+  CHECK(fs::fakeStorage().Files.count("/spill/0000000003.lp") == 1);
+}
+
+static void failures() {
+  fs::fakeStorage().reset();
+  SpillQueue queue;
+  CHECK(queue.begin(Flash, "/spill", 1000));
+  std::vector<uint8_t> body = batchBody(0, 100);
+
+  fs::fakeStorage().FailWrites = true;
+  CHECK(!queue.push(body.data(), body.size(), false));
+  fs::fakeStorage().FailWrites = false;
+  CHECK_EQ(queue.dropped(), 1);
+  CHECK(queue.empty());
+  CHECK_EQ(fs::fakeStorage().Files.size(), 0);  // No temporary file left
+
+  CHECK(queue.push(body.data(), body.size(), false));
+  CHECK(queue.push(body.data(), 50, true));
+  fs::fakeStorage().Files.erase("/spill/0000000000.lp");  // Lost from outside
+  bool compressed = false;
+  fs::File file = queue.openOldest(compressed);
+  CHECK(file);
+  CHECK(compressed);
+  CHECK_EQ(file.size(), 50);
+  file.close();
+}
+
+// Fake Influx server: HTTP status of a write
+struct FakeServer {
+  uint32_t DownFrom, DownTo;  // Live batch numbers during which every write fails
+  uint32_t Rejected;          // Batch number the server refuses as malformed
+  uint32_t Now;
+  std::vector<uint32_t> Received;
+
+  int post(const std::vector<uint8_t>& body) {
+    if (Now >= DownFrom && Now < DownTo)
+      return -1;  // Connection refused
+    uint32_t number = body[0] | (uint32_t)body[1] << 8;
+    if (number == Rejected)
+      return 400;
+    for (size_t i = 2; i < body.size(); i++)
+      if (body[i] != (uint8_t)(number * 31 + i))
+        return 400;  // Corrupted
+    Received.push_back(number);
+    return 204;
+  }
+};
+
+static bool retryable(int status) {
+  return status < 0 || status == 429 || status >= 500;
+}
+
+static std::vector<uint8_t> numberedBody(uint32_t number) {
+  std::vector<uint8_t> body = batchBody(number, 200 + number % 50);
+  body[0] = (uint8_t)number;
+  body[1] = (uint8_t)(number >> 8);
+  return body;
+}
+
+// replayInfluxSpill(): sends the oldest stored batch, returns false if it should be tried again later
+static bool replayOldest(SpillQueue& queue, FakeServer& server) {
+  bool compressed;
+  fs::File file = queue.openOldest(compressed);
+  if (!file)
+    return true;
+  size_t length = file.size();
+  std::vector<uint8_t> replay(length);
+  CHECK_EQ(file.read(replay.data(), length), length);
+  file.close();
+  int status = server.post(replay);
+  bool success = status >= 200 && status <= 299;
+  if (success)
+    queue.pop(length);
+  else if (!retryable(status))
+    queue.discard(length);
+  return success || !retryable(status);
+}
+
+static void outage(size_t maxBytes, uint32_t& lost) {
+  fs::fakeStorage().reset();
+  SpillQueue queue;
+  CHECK(queue.begin(Flash, "/spill", maxBytes));
+  FakeServer server = { 20, 60, 45, 0, {} };
+  const uint32_t Batches = 120;
+
+  bool linkUp = true;
+  std::vector<uint32_t> stored;
+  for (uint32_t number = 0; number < Batches; number++) {
+    server.Now = number;
+
+    // influxTransmitTask(): the live batch first
+    std::vector<uint8_t> body = numberedBody(number);
+    int status = server.post(body);
+    bool success = status >= 200 && status <= 299;
+    linkUp = success;
+    if (!success && retryable(status) && queue.push(body.data(), body.size(), false))
+      stored.push_back(number);
+
+    // One stored batch after every successful live write
+    if (linkUp && !queue.empty())
+      linkUp = replayOldest(queue, server);
+  }
+
+  // Every batch arrived once; the live ones in order and the replayed ones in order
+  std::vector<int> seen(Batches, 0);
+  for (uint32_t number : server.Received)
+    seen[number]++;
+  uint32_t missing = 0, repeated = 0;
+  for (uint32_t number = 0; number < Batches; number++) {
+    missing += seen[number] == 0 ? 1 : 0;
+    repeated += seen[number] > 1 ? 1 : 0;
+  }
+  std::vector<uint32_t> replayed;
+  for (size_t i = 0; i < server.Received.size(); i++)
+    if (server.Received[i] >= server.DownFrom && server.Received[i] < server.DownTo)
+      replayed.push_back(server.Received[i]);
+  bool ordered = true;
+  for (size_t i = 1; i < replayed.size(); i++)
+    ordered = ordered && replayed[i] > replayed[i - 1];
+  bool oldestDropped = true;  // A full queue makes room by dropping its oldest batches
+  for (uint32_t number : stored)
+    if (seen[number] == 0 && number != server.Rejected && !replayed.empty())
+      oldestDropped = oldestDropped && number < replayed[0];
+
+  printf("Outage, %zu byte queue: %u batches, %zu stored, %u replayed, %u dropped, %u missing\n",
+         maxBytes, Batches, stored.size(), queue.replayed(), queue.dropped(), missing);
+  CHECK_EQ(repeated, 0);
+  CHECK(ordered);
+  CHECK(oldestDropped);
+  CHECK(queue.empty());
+  CHECK_EQ(seen[server.Rejected], 0);
+  CHECK_EQ(missing, queue.dropped());  // Only dropped batches are missing
+  lost = missing;
+}
+
+// Timeline of influxTransmitTask() with live batches every PeriodMs, returns the stored batches left
+static size_t throttled(bool replayAfterLive, uint32_t& maxLagMs) {
+  fs::fakeStorage().reset();
+  SpillQueue queue;
+  CHECK(queue.begin(Flash, "/spill", 100000));
+  FakeServer server = { 0, 0, 100000, 0, {} };
+  const uint32_t Stored = 20;
+  for (uint32_t number = 0; number < Stored; number++) {
+    std::vector<uint8_t> body = numberedBody(number);
+    CHECK(queue.push(body.data(), body.size(), false));
+  }
+
+  const uint32_t ReplayIntervalMs = 500;  // InfluxSpillReplayIntervalMs
+  const uint32_t PeriodMs = 295;          // 31 point batches at 105 points/s
+  const uint32_t PostMs = 100;
+  uint32_t now = 0, next = 0;
+  maxLagMs = 0;
+  for (uint32_t number = Stored; number < Stored + 60; number++, next += PeriodMs) {
+    // xQueueReceive() with the replay interval as timeout while batches are stored
+    while (!queue.empty() && next > now + ReplayIntervalMs) {
+      now += ReplayIntervalMs;
+      replayOldest(queue, server);
+      now += PostMs;
+    }
+    if (next > now)
+      now = next;
+    if (now - next > maxLagMs)
+      maxLagMs = now - next;
+
+    std::vector<uint8_t> body = numberedBody(number);
+    CHECK_EQ(server.post(body), 204);
+    now += PostMs;
+    if (replayAfterLive && !queue.empty()) {
+      replayOldest(queue, server);
+      now += PostMs;
+    }
+  }
+  return queue.depth();
+}
+
+int main() {
+  limits();
+  boot(false);
+  boot(true);
+  failures();
+
+  uint32_t lost;
+  outage(100000, lost);
+  CHECK_EQ(lost, 1);  // Only the rejected batch
+  outage(2000, lost);
+  CHECK(lost > 1);  // The oldest stored batches made room
+
+  uint32_t maxLagMs;
+  CHECK_EQ(throttled(false, maxLagMs), 20);  // Idle replay alone never runs
+  CHECK_EQ(throttled(true, maxLagMs), 0);
+  CHECK_EQ(maxLagMs, 0);  // The live batches were never held back
+  printf("Throttled: queue drained, live batches held back by at most %u ms\n", maxLagMs);
+  return testResult();
+}
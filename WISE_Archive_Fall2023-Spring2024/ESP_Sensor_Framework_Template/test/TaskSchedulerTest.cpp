@@ -0,0 +1,186 @@
+/**
+ * @file TaskSchedulerTest.cpp
+ * @brief TaskScheduler against a reference model of its schedule.
+ *
+ * - Ordering: 40 tasks with random periods run from a loop() that is called at
+ *   random intervals and now and then held up for longer than some periods. Every
+ *   call must come from a task that is due, in the order of the due times, and
+ *   after each pass no task may be left due. The run, overrun and largest delay
+ *   counts must match the model.
+ * - Overrun: a task late by several periods runs once, counts the skipped runs and
+ *   keeps its phase.
+ * - Period: `setPeriod()` moves a task earlier and later in the heap.
+ * - Run flag and limits: a disabled task keeps its schedule without being called,
+ *   tasks beyond `MaxTasks` are refused, and a task may clear the scheduler.
+ */
+
+#include "HostTest.h"
+#include "TaskScheduler.h"
+#include <atomic>
+#include <random>
+#include <vector>
+
+static const uint8_t TaskCount = 40;
+static std::vector<uint8_t> Calls;  // Task numbers, in the order the functions were called
+
+template<uint8_t Number>
+static void recordCall() {
+  Calls.push_back(Number);
+}
+
+// Fills functions[0..N-1] with recordCall<0..N-1>
+template<uint8_t N>
+struct CallFunctions {
+  static void fill(ScheduledFunction* functions) {
+    functions[N - 1] = recordCall<N - 1>;
+    CallFunctions<N - 1>::fill(functions);
+  }
+};
+template<>
+struct CallFunctions<0> {
+  static void fill(ScheduledFunction*) {}
+};
+
+static void ordering() {
+  std::mt19937 random(11);
+  ScheduledFunction functions[TaskCount];
+  CallFunctions<TaskCount>::fill(functions);
+  static const char* Names[TaskCount];
+  static char NameText[TaskCount][8];
+
+  TaskScheduler<TaskCount> scheduler;
+  int64_t due[TaskCount];
+  uint32_t period[TaskCount], runs[TaskCount] = {}, overruns[TaskCount] = {}, maxLate[TaskCount] = {};
+  int64_t now = 1000;
+  for (uint8_t i = 0; i < TaskCount; i++) {
+    snprintf(NameText[i], sizeof(NameText[i]), "T%u", i);
+    Names[i] = NameText[i];
+    period[i] = 1 + random() % 500;
+    CHECK(scheduler.add(Names[i], functions[i], period[i], nullptr, now));
+    due[i] = now + period[i];
+    now += random() % 3;
+  }
+  CHECK_EQ(scheduler.count(), TaskCount);
+
+  uint32_t wrongTask = 0, outOfOrder = 0, leftDue = 0, calls = 0;
+  while (now < 200000) {
+    now += random() % 100 == 0 ? 200 + random() % 800 : random() % 4;  // Sometimes held up
+    Calls.clear();
+    uint8_t ran = scheduler.run(now);
+    CHECK_EQ(ran, Calls.size());
+    int64_t lastDue = INT64_MIN;
+    for (uint8_t i : Calls) {
+      if (due[i] > now)
+        wrongTask++;
+      if (due[i] < lastDue)
+        outOfOrder++;
+      lastDue = due[i];
+      uint64_t late = (uint64_t)(now - due[i]);
+      if (late > maxLate[i])
+        maxLate[i] = (uint32_t)late;
+      overruns[i] += (uint32_t)(late / period[i]);
+      due[i] += (int64_t)(late / period[i] + 1) * period[i];
+      runs[i]++;
+    }
+    for (uint8_t i = 0; i < TaskCount; i++)
+      if (due[i] <= now)
+        leftDue++;
+    calls += ran;
+  }
+
+  uint32_t wrongStats = 0, totalOverruns = 0;
+  for (uint8_t i = 0; i < TaskCount; i++) {
+    const TaskScheduler<TaskCount>::Task& task = scheduler.task(i);
+    if (task.Name != Names[i] || task.Runs != runs[i] || task.Overruns != overruns[i] || task.MaxLateMs != maxLate[i] || task.DueMs != due[i])
+      wrongStats++;
+    totalOverruns += task.Overruns;
+  }
+  printf("Ordering: %u calls of %u tasks, %u overruns\n", calls, TaskCount, totalOverruns);
+  CHECK_EQ(wrongTask, 0);
+  CHECK_EQ(outOfOrder, 0);
+  CHECK_EQ(leftDue, 0);
+  CHECK_EQ(wrongStats, 0);
+  CHECK(totalOverruns > 0);
+}
+
+static void overrun() {
+  TaskScheduler<3> scheduler;
+  CHECK(scheduler.add("A", recordCall<0>, 10, nullptr, 0));
+  CHECK_EQ(scheduler.run(9), 0);
+  CHECK_EQ(scheduler.run(10), 1);
+  CHECK_EQ(scheduler.task(0).MaxLateMs, 0);
+
+  CHECK_EQ(scheduler.run(45), 1);  // Due at 20, 30 and 40: runs once
+  CHECK_EQ(scheduler.task(0).Overruns, 2);
+  CHECK_EQ(scheduler.task(0).MaxLateMs, 25);
+  CHECK_EQ(scheduler.task(0).DueMs, 50);  // Same phase as before
+  CHECK_EQ(scheduler.run(49), 0);
+  CHECK_EQ(scheduler.run(51), 1);
+  CHECK_EQ(scheduler.task(0).MaxLateMs, 25);
+  CHECK_EQ(scheduler.task(0).Runs, 3);
+}
+
+static void period() {
+  static const char* A = "A";
+  static const char* B = "B";
+  static const char* C = "C";
+  TaskScheduler<3> scheduler;
+  scheduler.add(A, recordCall<0>, 100, nullptr, 0);
+  scheduler.add(B, recordCall<1>, 200, nullptr, 0);
+  scheduler.add(C, recordCall<2>, 300, nullptr, 0);
+
+  CHECK(scheduler.setPeriod(B, 20, 50));  // Now the earliest
+  Calls.clear();
+  CHECK_EQ(scheduler.run(69), 0);
+  CHECK_EQ(scheduler.run(70), 1);
+  CHECK(Calls.size() == 1 && Calls[0] == 1);
+  CHECK_EQ(scheduler.task(1).DueMs, 90);
+
+  CHECK(scheduler.setPeriod(B, 1000, 80));  // Now the latest
+  Calls.clear();
+  CHECK_EQ(scheduler.run(300), 2);
+  CHECK(Calls.size() == 2 && Calls[0] == 0 && Calls[1] == 2);
+  CHECK_EQ(scheduler.task(1).DueMs, 1080);
+
+  char name[] = "A";  // Same text, not the registered name
+  CHECK(!scheduler.setPeriod(name, 10, 300));
+  CHECK(scheduler.setPeriod(A, 0, 300));
+  CHECK_EQ(scheduler.task(0).PeriodMs, 1);  // At least 1 ms
+}
+
+static TaskScheduler<3> ClearedScheduler;
+
+static void clearScheduler() {
+  ClearedScheduler.clear();
+}
+
+static void runFlagAndLimits() {
+  std::atomic<bool> run(false);
+  TaskScheduler<3> scheduler;
+  CHECK(scheduler.add("A", recordCall<0>, 10, &run, 0));
+  CHECK(scheduler.add("B", recordCall<1>, 10, nullptr, 0));
+  CHECK(scheduler.add("C", recordCall<2>, 30, nullptr, 0));
+  CHECK(!scheduler.add("D", recordCall<3>, 10, nullptr, 0));
+  CHECK_EQ(scheduler.count(), 3);
+
+  Calls.clear();
+  CHECK_EQ(scheduler.run(10), 1);  // Only B
+  CHECK_EQ(scheduler.task(0).Runs, 0);
+  CHECK_EQ(scheduler.task(0).DueMs, 20);  // Still scheduled
+  run = true;
+  CHECK_EQ(scheduler.run(20), 2);
+  CHECK_EQ(scheduler.task(0).Runs, 1);
+
+  CHECK(ClearedScheduler.add("Clear", clearScheduler, 10, nullptr, 0));
+  CHECK(ClearedScheduler.add("B", recordCall<1>, 10, nullptr, 0));
+  CHECK_EQ(ClearedScheduler.run(10), 1);  // The first due task cleared the scheduler
+  CHECK_EQ(ClearedScheduler.count(), 0);
+}
+
+int main() {
+  ordering();
+  overrun();
+  period();
+  runFlagAndLimits();
+  return testResult();
+}
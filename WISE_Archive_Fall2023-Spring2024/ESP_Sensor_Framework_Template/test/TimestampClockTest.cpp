@@ -0,0 +1,117 @@
+/**
+ * @file TimestampClockTest.cpp
+ * @brief Two-thread test of the TimestampClock sequence lock.
+ *
+ * A writer thread calls `set()` while the main thread calls `at()`, with the
+ * anchor fields crossing a 32-bit boundary, so a reader that mixed the halves or
+ * the fields of two updates gets a timestamp that is off by hours.
+ *
+ * - Slewing: the reader advances its own monotonic time and the writer keeps
+ *   moving the anchor to the latest time the reader published, the way time
+ *   synchronization moves it every second. Every timestamp must be later than the
+ *   one before, by no more than the monotonic step.
+ * - Alternating: the writer switches between two unrelated anchors and rates;
+ *   every timestamp must be exactly the one of either, never a mix of both.
+ *
+ * Build with `-DSENSOR_TEST_SANITIZERS=thread` to also run it under
+ * ThreadSanitizer (see README.md).
+ */
+
+#include "HostTest.h"
+#include "TimestampClock.h"
+#include <atomic>
+#include <thread>
+
+static const int64_t StartUs = 0xFFF00000LL;                 // The monotonic low word wraps after about 1 s
+static const int64_t StartEpochUs = 0x0005FFFFFFF80000LL;    // The epoch high word changes after about 0.5 s
+static const int64_t StepUs = 3;
+static const int32_t RatePpb = 25000;
+
+static void slewing() {
+  static TimestampClock clock;
+  clock.set(StartUs, StartEpochUs, RatePpb);
+  std::atomic<int64_t> published{ StartUs };
+  std::atomic<bool> done{ false };
+  uint32_t updates = 0;
+  std::thread writer([&] {
+    int64_t last = StartUs;
+    while (!done.load(std::memory_order_acquire)) {
+      int64_t monotonic = published.load(std::memory_order_acquire);
+      if (monotonic == last) {
+        std::this_thread::yield();
+        continue;
+      }
+      clock.set(monotonic, (int64_t)clock.at(monotonic), RatePpb);  // Continues the line from the new anchor
+      last = monotonic;
+      updates++;
+    }
+  });
+
+  const int64_t EndUs = 0x100000000LL + 1000000;
+  uint64_t previous = clock.at(StartUs);
+  uint32_t reads = 0, errors = 0;
+  for (int64_t monotonic = StartUs + StepUs; monotonic < EndUs; monotonic += StepUs) {
+    published.store(monotonic, std::memory_order_release);
+    uint64_t timestamp = clock.at(monotonic);
+    if (timestamp <= previous || timestamp - previous > 2 * StepUs)
+      errors++;
+    previous = timestamp;
+    if (++reads % 64 == 0)
+      std::this_thread::yield();  // Lets the writer move the anchor part of the time
+  }
+  done.store(true, std::memory_order_release);
+  writer.join();
+
+  printf("Slewing: %u reads, %u anchor updates\n", reads, updates);
+  CHECK_EQ(errors, 0);
+  CHECK(updates > 0);
+  CHECK(previous > (uint64_t)0x0006000000000000LL);
+}
+
+static void alternating() {
+  static TimestampClock clock;
+  const int64_t MonotonicUs = 0x100100000LL;
+  const int64_t BaseA = 0x100000010LL, EpochA = 0x0006000000001000LL;
+  const int64_t BaseB = 0x0FFFFFFF0LL, EpochB = 0x0005FFFFFFFFF000LL;
+  const int32_t RateA = 30000, RateB = -30000;
+  clock.set(BaseA, EpochA, RateA);
+  const uint64_t ExpectedA = clock.at(MonotonicUs);
+  clock.set(BaseB, EpochB, RateB);
+  const uint64_t ExpectedB = clock.at(MonotonicUs);
+  CHECK(ExpectedA != ExpectedB);
+
+  std::atomic<bool> done{ false };
+  std::thread writer([&] {
+    for (uint32_t i = 0; i < 300000; i++) {
+      if (i & 1)
+        clock.set(BaseB, EpochB, RateB);
+      else
+        clock.set(BaseA, EpochA, RateA);
+      if (i % 3 == 0)
+        std::this_thread::yield();  // Leaves either anchor set in turn
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  uint32_t reads = 0, seenA = 0, errors = 0;
+  while (!done.load(std::memory_order_acquire)) {
+    uint64_t timestamp = clock.at(MonotonicUs);
+    if (timestamp == ExpectedA)
+      seenA++;
+    else if (timestamp != ExpectedB)
+      errors++;
+    if (++reads % 64 == 0)
+      std::this_thread::yield();
+  }
+  writer.join();
+
+  printf("Alternating: %u reads, %u of the first anchor\n", reads, seenA);
+  CHECK_EQ(errors, 0);
+  CHECK(reads > 0);
+}
+
+int main() {
+  slewing();
+  alternating();
+  return testResult();
+}
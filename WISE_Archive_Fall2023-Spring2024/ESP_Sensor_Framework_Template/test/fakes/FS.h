@@ -0,0 +1,178 @@
+/**
+ * @file FS.h
+ * @brief In-memory stand-in for the Arduino `fs::FS` file system, for the host tests.
+ *
+ * This file provides the part of `fs::FS` and `fs::File` the sketch's file code
+ * uses, backed by a map of paths to byte vectors (`fs::fakeStorage()`), so a test
+ * can inspect and change the files directly, e.g. leave a torn file behind as a
+ * power cut would. It also counts the file system calls and can make writes fail.
+ *
+ * Listing a directory returns the file names without the directory, like the
+ * ESP32 core 2.x, or the full paths like older cores with `FullPathNames`.
+ */
+
+#ifndef FakeFSCode
+#define FakeFSCode
+
+#include <map>
+#include <memory>
+#include <set>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+struct FakeStorage {
+  std::map<std::string, std::vector<uint8_t>> Files;
+  std::set<std::string> Directories;
+  bool FailWrites = false;     // Writes store only half of the data
+  bool FullPathNames = false;  // File names listed with their directory
+  uint32_t Operations = 0;     // Opens, closes, writes, reads, renames, removes and checks
+
+  void reset() {
+    *this = FakeStorage();
+  }
+};
+
+inline FakeStorage& fakeStorage() {
+  static FakeStorage storage;
+  return storage;
+}
+
+struct FakeHandle {
+  std::string Path;
+  std::string Name;
+  bool Directory = false;
+  size_t Position = 0;
+  std::vector<std::string> Entries;  // Directory listing
+  size_t NextEntry = 0;
+};
+
+class File {
+public:
+  explicit operator bool() const {
+    return (bool)Handle;
+  }
+
+  size_t write(const uint8_t* data, size_t length) {
+    FakeStorage& storage = fakeStorage();
+    storage.Operations++;
+    if (!Handle || Handle->Directory)
+      return 0;
+    if (storage.FailWrites)
+      length /= 2;
+    std::vector<uint8_t>& file = storage.Files[Handle->Path];
+    file.insert(file.end(), data, data + length);
+    return length;
+  }
+
+  size_t read(uint8_t* data, size_t length) {
+    FakeStorage& storage = fakeStorage();
+    storage.Operations++;
+    if (!Handle || Handle->Directory)
+      return 0;
+    const std::vector<uint8_t>& file = storage.Files[Handle->Path];
+    size_t count = Handle->Position < file.size() ? file.size() - Handle->Position : 0;
+    count = count < length ? count : length;
+    memcpy(data, file.data() + Handle->Position, count);
+    Handle->Position += count;
+    return count;
+  }
+
+  size_t size() const {
+    return Handle ? fakeStorage().Files[Handle->Path].size() : 0;
+  }
+
+  void close() {
+    fakeStorage().Operations++;
+    Handle.reset();
+  }
+
+  const char* name() const {
+    return Handle ? Handle->Name.c_str() : "";
+  }
+
+  bool isDirectory() const {
+    return Handle && Handle->Directory;
+  }
+
+  File openNextFile() {
+    File file;
+    if (Handle && Handle->NextEntry < Handle->Entries.size())
+      file.Handle = open(Handle->Entries[Handle->NextEntry++], false);
+    return file;
+  }
+
+  static std::shared_ptr<FakeHandle> open(const std::string& path, bool directory) {
+    std::shared_ptr<FakeHandle> handle = std::make_shared<FakeHandle>();
+    handle->Path = path;
+    handle->Name = fakeStorage().FullPathNames ? path : path.substr(path.rfind('/') + 1);
+    handle->Directory = directory;
+    return handle;
+  }
+
+  std::shared_ptr<FakeHandle> Handle;
+};
+
+class FS {
+public:
+  bool exists(const char* path) {
+    FakeStorage& storage = fakeStorage();
+    storage.Operations++;
+    return storage.Files.count(path) > 0 || storage.Directories.count(path) > 0;
+  }
+
+  bool mkdir(const char* path) {
+    fakeStorage().Directories.insert(path);
+    return true;
+  }
+
+  bool remove(const char* path) {
+    FakeStorage& storage = fakeStorage();
+    storage.Operations++;
+    return storage.Files.erase(path) > 0;
+  }
+
+  bool rename(const char* from, const char* to) {
+    FakeStorage& storage = fakeStorage();
+    storage.Operations++;
+    if (storage.Files.count(from) == 0)
+      return false;
+    storage.Files[to] = storage.Files[from];
+    storage.Files.erase(from);
+    return true;
+  }
+
+  File open(const char* path, const char* mode = FILE_READ) {
+    FakeStorage& storage = fakeStorage();
+    storage.Operations++;
+    File file;
+    std::string name(path);
+    if (strcmp(mode, FILE_WRITE) == 0) {
+      storage.Files[name].clear();
+      file.Handle = File::open(name, false);
+    } else if (strcmp(mode, FILE_APPEND) == 0) {
+      storage.Files[name];
+      file.Handle = File::open(name, false);
+    } else if (storage.Files.count(name) > 0) {
+      file.Handle = File::open(name, false);
+    } else if (storage.Directories.count(name) > 0) {
+      file.Handle = File::open(name, true);
+      for (const auto& entry : storage.Files)
+        if (entry.first.compare(0, name.size() + 1, name + "/") == 0)
+          file.Handle->Entries.push_back(entry.first);
+    }
+    return file;
+  }
+};
+
+}  // namespace fs
+
+#endif  // FakeFSCode
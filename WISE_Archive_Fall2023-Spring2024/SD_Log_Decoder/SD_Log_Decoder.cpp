@@ -0,0 +1,421 @@
+/**
+ * @file SD_Log_Decoder.cpp
+ * @brief Decodes binary SD card logs of the ESP Sensor Framework to CSV or line protocol.
+ *
+ * This program reads the log files written with `SDBinaryLogging` (the record
+ * format is described in ESP_Sensor_Framework_Template/Code/SdLogFormat.h) and
+ * writes every value either as CSV:
+ *
+ *   device,module,field,timestamp_us,value
+ *
+ * or as InfluxDB line protocol with microsecond timestamps, exactly as the sketch
+ * sends it, so the file can be loaded into the database with `influx write
+ * --precision us`.
+ *
+ * Files are decoded in the order given, into one output; pass the numbered files
+ * of the card's /log directory in order to decode a whole recording. Entries with
+ * a wrong CRC (a torn write or a corrupt sector) are skipped byte by byte until the
+ * next intact entry, and reported. Version 1 files, without the entry framing, are
+ * decoded too, but stop at the first invalid record.
+ *
+ * The files are read and the output written in large blocks, and values are
+ * formatted with the same encoder the sketch uses, so decoding runs at about the
+ * speed of the disk.
+ *
+ * Usage: SD_Log_Decoder [--csv | --lp] [-o output file] <log file>...
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../ESP_Sensor_Framework_Template/Code/SdLogFormat.h"
+#include "../ESP_Sensor_Framework_Template/Code/LineProtocol.h"
+
+#define ReadBlockSize (1024 * 1024)
+#define OutputBlockSize (1024 * 1024)
+#define FloatFieldPrecision 6  // Same as the sketch (Configuration.h)
+
+static const uint8_t SdLogUnframedVersion = 1;  // Records without the length and CRC of each entry
+
+struct SensorSchema {
+  bool Defined = false;
+  std::string Module;
+  std::string Prefix;  // Escaped "<measurement>,device=<device>"
+  std::vector<std::string> Fields;
+  std::vector<std::string> Keys;  // Escaped field names
+  std::vector<uint8_t> Types;
+  std::vector<float> Scales;
+  size_t ValuesSize = 0;
+  uint64_t LastUs = 0;
+};
+
+class LogDecoder {
+public:
+  LogDecoder(FILE* output, bool lineProtocol) : Output(output), LineProtocol(lineProtocol) {
+    Batch.begin(OutputBlockSize);
+    if (!LineProtocol)
+      Text = "device,module,field,timestamp_us,value\n";
+  }
+
+  // Starts the next file; its first bytes tell its version
+  void beginFile() {
+    Format = Unknown;
+    HaveHeader = false;
+    Skipped = 0;
+    SkipStart = -1;
+    SkipLength = 0;
+    for (SensorSchema& sensor : Sensors)
+      sensor.Defined = false;
+  }
+
+  /**
+   * @brief Decodes the complete entries at the start of `data`.
+   *
+   * @param data The log bytes.
+   * @param length Number of bytes.
+   * @param offset File offset of `data`, for error messages.
+   * @param end `true` if `data` reaches the end of the file, so nothing is incomplete.
+   *
+   * @return The number of bytes used, or -1 if a version 1 file holds an invalid record.
+   */
+  long decode(const uint8_t* data, size_t length, uint64_t offset, bool end) {
+    if (Format == Unknown) {
+      if (length < 2 + 1 + sizeof(SdLogMagic) + 1 && !end)
+        return 0;
+      bool unframed = length >= 1 + sizeof(SdLogMagic) + 1 && data[0] == SdLogFileTag && memcmp(data + 1, SdLogMagic, sizeof(SdLogMagic)) == 0 && data[1 + sizeof(SdLogMagic)] == SdLogUnframedVersion;
+      Format = unframed ? Unframed : Framed;
+    }
+
+    size_t position = 0;
+    while (position < length) {
+      if (Format == Unframed) {
+        long used = decodeRecord(data + position, length - position);
+        if (used < 0) {
+          fprintf(stderr, "Invalid record 0x%02X at offset %llu\n", data[position], (unsigned long long)(offset + position));
+          return -1;
+        }
+        if (used == 0)  // Incomplete, continued in the next block
+          break;
+        position += used;
+        continue;
+      }
+
+      size_t entry = sdLogEntryLength(data + position, length - position);
+      if (entry == 0) {
+        size_t payload = length - position >= 2 ? data[position] | (size_t)data[position + 1] << 8 : 0;
+        bool incomplete = length - position < SdLogEntryOverhead || (payload > 0 && payload <= SdLogMaxEntry && payload + SdLogEntryOverhead > length - position);
+        if (incomplete && !end)  // Continued in the next block
+          break;
+        skip(offset + position, 1);
+        position++;
+        continue;
+      }
+      if (decodeEntry(data + position + 2, entry - SdLogEntryOverhead))
+        reportSkipped();
+      else  // Intact but undecodable, e.g. frames of a sensor whose definition was lost
+        skip(offset + position, entry);
+      position += entry;
+    }
+    if (end)
+      reportSkipped();
+    return (long)position;
+  }
+
+  void finish() {
+    flushBatch();
+    fwrite(Text.data(), 1, Text.size(), Output);
+    Text.clear();
+  }
+
+  uint64_t frames() const {
+    return Frames;
+  }
+  // Bytes of the current file that were not decoded
+  uint64_t skipped() const {
+    return Skipped;
+  }
+
+private:
+  enum FileFormat { Unknown, Unframed, Framed };
+
+  // Decodes the records of one intact entry, returns `false` if any is invalid
+  bool decodeEntry(const uint8_t* payload, size_t length) {
+    size_t position = 0;
+    while (position < length) {
+      long used = decodeRecord(payload + position, length - position);
+      if (used <= 0)  // Records never continue in the next entry
+        return false;
+      position += used;
+    }
+    return true;
+  }
+
+  void skip(uint64_t offset, size_t length) {
+    if (SkipStart < 0)
+      SkipStart = (int64_t)offset;
+    SkipLength += length;
+    Skipped += length;
+  }
+
+  // Reports the bytes skipped since the last decoded entry
+  void reportSkipped() {
+    if (SkipStart < 0)
+      return;
+    fprintf(stderr, "Could not decode %llu bytes at offset %llu\n", (unsigned long long)SkipLength, (unsigned long long)SkipStart);
+    SkipStart = -1;
+    SkipLength = 0;
+  }
+
+  // Returns the record length, 0 if it is incomplete, or -1 if it is invalid
+  long decodeRecord(const uint8_t* data, size_t length) {
+    uint8_t tag = data[0];
+    size_t position = 1;
+
+    if (tag == SdLogFileTag) {
+      std::string device;
+      if (length < 1 + sizeof(SdLogMagic) + 1)
+        return 0;
+      uint8_t version = Format == Unframed ? SdLogUnframedVersion : SdLogVersion;
+      if (memcmp(data + 1, SdLogMagic, sizeof(SdLogMagic)) != 0 || data[1 + sizeof(SdLogMagic)] != version)
+        return -1;
+      position += sizeof(SdLogMagic) + 1;
+      if (!readName(data, length, position, device))
+        return 0;
+      Device = device;
+      HaveHeader = true;
+      for (SensorSchema& sensor : Sensors)
+        sensor.Defined = false;
+      return (long)position;
+    }
+    if (!HaveHeader)  // Every session starts with a file header
+      return -1;
+
+    if (tag == SdLogSensorTag) {
+      SensorSchema schema;
+      uint8_t sensor, count;
+      if (!readByte(data, length, position, sensor) || !readName(data, length, position, schema.Module) || !readByte(data, length, position, count))
+        return 0;
+      if (sensor >= SdLogMaxSensors || count > SampleFrameMaxFields)
+        return -1;
+      for (uint8_t i = 0; i < count; i++) {
+        uint8_t type;
+        std::string name;
+        if (!readByte(data, length, position, type) || position + 4 > length)
+          return 0;
+        if (type > SdLogRaw)
+          return -1;
+        schema.Types.push_back(type);
+        schema.Scales.push_back(readNumber<float>(data + position));
+        position += 4;
+        if (!readName(data, length, position, name))
+          return 0;
+        schema.Fields.push_back(name);
+        schema.ValuesSize += sdLogValueSize(type);
+      }
+      define(sensor, schema);
+      return (long)position;
+    }
+
+    uint8_t sensor = (uint8_t)(tag & ~SdLogAbsoluteFlag);
+    if (sensor >= Sensors.size() || !Sensors[sensor].Defined)
+      return -1;
+    SensorSchema& schema = Sensors[sensor];
+    size_t timestampSize = tag & SdLogAbsoluteFlag ? 8 : 2;
+    if (length < 1 + timestampSize + schema.ValuesSize)
+      return 0;
+    uint64_t timestamp = tag & SdLogAbsoluteFlag ? readNumber<uint64_t>(data + 1) : schema.LastUs + readNumber<uint16_t>(data + 1);
+    schema.LastUs = timestamp;
+    writeFrame(schema, timestamp, data + 1 + timestampSize);
+    Frames++;
+    return (long)(1 + timestampSize + schema.ValuesSize);
+  }
+
+  void define(uint8_t sensor, SensorSchema& schema) {
+    char escaped[600];
+    schema.Defined = true;
+    LineProtocolBatch::escapeMeasurement(escaped, sizeof(escaped), schema.Module.c_str());
+    schema.Prefix = escaped;
+    LineProtocolBatch::escapeKey(escaped, sizeof(escaped), Device.c_str());
+    schema.Prefix += ",device=";
+    schema.Prefix += escaped;
+    for (const std::string& field : schema.Fields) {
+      LineProtocolBatch::escapeKey(escaped, sizeof(escaped), field.c_str());
+      schema.Keys.push_back(escaped);
+    }
+    if (Sensors.size() <= sensor)
+      Sensors.resize(sensor + 1);
+    Sensors[sensor] = schema;
+  }
+
+  void writeFrame(const SensorSchema& schema, uint64_t timestamp, const uint8_t* values) {
+    if (LineProtocol) {
+      if (Batch.available() < 1024)
+        flushBatch();
+      Batch.beginPoint(schema.Prefix.c_str());
+    }
+    for (size_t i = 0; i < schema.Types.size(); i++) {
+      bool isFloat = schema.Types[i] != SdLogInteger;
+      float value = 0;
+      long integer = 0;
+      if (schema.Types[i] == SdLogRaw)
+        value = readNumber<int16_t>(values) * schema.Scales[i];
+      else if (schema.Types[i] == SdLogFloat)
+        value = readNumber<float>(values);
+      else
+        integer = readNumber<int32_t>(values);
+      values += sdLogValueSize(schema.Types[i]);
+
+      if (LineProtocol) {
+        if (isFloat)
+          Batch.addField(schema.Keys[i].c_str(), value, FloatFieldPrecision);
+        else
+          Batch.addField(schema.Keys[i].c_str(), integer);
+        continue;
+      }
+      char line[128];
+      int length;
+      if (isFloat)
+        length = snprintf(line, sizeof(line), ",%llu,%.*f\n", (unsigned long long)timestamp, FloatFieldPrecision, value);
+      else
+        length = snprintf(line, sizeof(line), ",%llu,%ld\n", (unsigned long long)timestamp, integer);
+      Text += Device;
+      Text += ',';
+      Text += schema.Module;
+      Text += ',';
+      Text += schema.Fields[i];
+      Text.append(line, length);
+    }
+    if (LineProtocol)
+      Batch.endPoint(timestamp);
+    else if (Text.size() >= OutputBlockSize)
+      finish();
+  }
+
+  void flushBatch() {
+    fwrite(Batch.data(), 1, Batch.length(), Output);
+    Batch.clear();
+  }
+
+  // Little-endian, independent of the host
+  template<typename T>
+  static T readNumber(const uint8_t* data) {
+    uint8_t bytes[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); i++)
+      bytes[i] = data[i];
+    uint16_t probe = 1;
+    if (*(uint8_t*)&probe == 0) {  // Big-endian host
+      for (size_t i = 0; i < sizeof(T) / 2; i++) {
+        uint8_t byte = bytes[i];
+        bytes[i] = bytes[sizeof(T) - 1 - i];
+        bytes[sizeof(T) - 1 - i] = byte;
+      }
+    }
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    return value;
+  }
+
+  static bool readByte(const uint8_t* data, size_t length, size_t& position, uint8_t& value) {
+    if (position >= length)
+      return false;
+    value = data[position++];
+    return true;
+  }
+
+  static bool readName(const uint8_t* data, size_t length, size_t& position, std::string& name) {
+    uint8_t nameLength;
+    if (!readByte(data, length, position, nameLength) || position + nameLength > length)
+      return false;
+    name.assign((const char*)data + position, nameLength);
+    position += nameLength;
+    return true;
+  }
+
+  FILE* Output;
+  bool LineProtocol;
+  LineProtocolBatch Batch;
+  std::string Text;
+  std::string Device;
+  std::vector<SensorSchema> Sensors;
+  uint64_t Frames = 0;
+  uint64_t Skipped = 0;
+  int64_t SkipStart = -1;  // File offset of the bytes being skipped, -1 if none
+  uint64_t SkipLength = 0;
+  FileFormat Format = Unknown;
+  bool HaveHeader = false;
+};
+
+// Decodes one file, returns `false` if anything in it could not be decoded
+static bool decodeFile(LogDecoder& decoder, const char* path, std::vector<uint8_t>& buffer) {
+  FILE* input = fopen(path, "rb");
+  if (!input) {
+    perror(path);
+    return false;
+  }
+  fprintf(stderr, "%s\n", path);
+  decoder.beginFile();
+  size_t buffered = 0;
+  uint64_t offset = 0;
+  bool valid = true;
+  for (;;) {
+    size_t read = fread(buffer.data() + buffered, 1, buffer.size() - buffered, input);
+    buffered += read;
+    long used = decoder.decode(buffer.data(), buffered, offset, read == 0);
+    if (used < 0) {
+      valid = false;
+      break;
+    }
+    memmove(buffer.data(), buffer.data() + used, buffered - used);  // Keep the incomplete entry
+    buffered -= used;
+    offset += used;
+    if (read == 0) {
+      if (buffered > 0) {
+        fprintf(stderr, "Incomplete record at the end of the file (offset %llu)\n", (unsigned long long)offset);
+        valid = false;
+      }
+      break;
+    }
+  }
+  fclose(input);
+  return valid && decoder.skipped() == 0;
+}
+
+int main(int argc, char** argv) {
+  bool lineProtocol = false;
+  const char* outputPath = nullptr;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "--csv") == 0 || strcmp(argv[arg], "--lp") == 0)
+      lineProtocol = strcmp(argv[arg], "--lp") == 0;
+    else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+      outputPath = argv[++arg];
+    else
+      break;
+  }
+  if (arg >= argc || argv[arg][0] == '-') {
+    fprintf(stderr, "Usage: %s [--csv | --lp] [-o output file] <log file>...\n", argv[0]);
+    return 2;
+  }
+
+  FILE* output = outputPath ? fopen(outputPath, "wb") : stdout;
+  if (!output) {
+    perror(outputPath);
+    return 1;
+  }
+
+  LogDecoder decoder(output, lineProtocol);
+  std::vector<uint8_t> buffer(ReadBlockSize);
+  int result = 0;
+  for (; arg < argc; arg++) {
+    if (!decodeFile(decoder, argv[arg], buffer))
+      result = 1;
+  }
+  decoder.finish();
+
+  fprintf(stderr, "%llu frames decoded\n", (unsigned long long)decoder.frames());
+  if (output != stdout)
+    fclose(output);
+  return result;
+}